@@ -92,7 +92,9 @@ while IFS= read -r -d '' DIR; do
 
   # Read classification (if present)
   CLS=""
-  if [[ -s "$OUTDIR/report.txt" ]]; then
+  if [[ -s "$OUTDIR/report.json" ]] && command -v jq >/dev/null 2>&1; then
+    CLS="$(jq -r '.classification // empty' "$OUTDIR/report.json")"
+  elif [[ -s "$OUTDIR/report.txt" ]]; then
     CLS="$(grep -m1 '^Classification:' "$OUTDIR/report.txt" | cut -d: -f2- | sed 's/^[[:space:]]*//')"
   fi
 
@@ -100,6 +102,7 @@ while IFS= read -r -d '' DIR; do
   REL_OVER="$(relpath "$OUTDIR")/spectrum_overlay.png"
   REL_SPEC_PRETTY="$(relpath "$OUTDIR")/spectrogram_pretty.png"
   REL_REP="$(relpath "$OUTDIR")/report.txt"
+  REL_JSON="$(relpath "$OUTDIR")/report.json"
   REL_SPEC_RAW="$(relpath "$OUTDIR")/spectrogram.png"
   REL_SPECTRUM_AVG="$(relpath "$OUTDIR")/spectrum_avg.png"
 
@@ -116,6 +119,7 @@ while IFS= read -r -d '' DIR; do
     [[ -s "$OUTDIR/spectrogram_pretty.png" ]] && printf '<img src="%s" alt="spectrogram_pretty for %s">\n' "$REL_SPEC_PRETTY" "$BASE"
     printf '%s\n' '</div>'
     printf '<p><a href="%s">report.txt</a>' "$REL_REP"
+    [[ -s "$OUTDIR/report.json" ]]      && printf ' &middot; <a href="%s">report.json</a>' "$REL_JSON"
     [[ -s "$OUTDIR/spectrogram.png" ]]   && printf ' &middot; <a href="%s">spectrogram.png</a>' "$REL_SPEC_RAW"
     [[ -s "$OUTDIR/spectrum_avg.png" ]]  && printf ' &middot; <a href="%s">spectrum_avg.png</a>' "$REL_SPECTRUM_AVG"
     printf '%s\n' '</p>'
@@ -0,0 +1,368 @@
+// dsd_bench — per-stage throughput of the analyzer on synthetic inputs.
+//
+// Corpora are generated on the fly (no files or network needed):
+//   dsd64/dsd128/dsd256  second-order sigma-delta tones + white noise, written as DSF
+//   (dsd512 on request)  same, at 22.5792 MHz
+//   pcm22/pcm24          band-limited noise + tones with a brickwall at 22/24 kHz,
+//                        synthesized at 88.2/96 kHz and written as float WAV
+// and every stage is timed on its own (best of --reps):
+//   decode    reader + DSD->PCM / FFmpeg decode + swr, end to end
+//   resample  DSD: the native decimator on in-memory bytes; PCM: swr alone
+//   stft      mono (with spectrogram) + L/R average spectra, as process_file does
+//   metrics   analyze_metrics + dynamic metrics
+//   png       spectrogram.png + spectrum_avg.png
+//   render    spectrogram_pretty.png + spectrum_overlay.png
+// Results go to stdout (or --json FILE) as JSON; a stage that fails records
+// its error and the later stages run on the synthesized PCM instead.
+//
+// The analysis comes from libdsdinspect and the PNG writers and renderers
+// from render.cpp, the same code dsd_inspector runs.
+#include <cstdio>
+#include <cstdint>
+#include <cmath>
+#include <complex>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <random>
+
+#include <unistd.h>
+
+#include "core.h"
+#include "render.h"
+
+extern "C" {
+#include <libavutil/log.h>
+#include <libavutil/channel_layout.h>
+#include <libavutil/mathematics.h>
+#include <libswresample/swresample.h>
+}
+
+struct StageResult {
+    std::string stage, error;
+    double seconds = 0;      // best wall time
+    uint64_t samples = 0;    // audio frames handled (at the stage's output rate)
+    uint64_t bytes = 0;      // stage input bytes
+    double audio_s = 0;      // audio duration covered
+};
+
+struct Corpus {
+    std::string name, kind;  // kind: "dsd" | "pcm"
+    int rate = 0;            // DSD bit rate or PCM source rate
+    double cutoff_hz = 0;    // pcm brickwall
+    std::string path;
+    uint64_t file_bytes = 0;
+    std::string classification;
+    std::vector<StageResult> stages;
+};
+
+struct BenchOptions {
+    Options base;
+    double seconds = 10;
+    int reps = 3;
+    std::vector<std::string> corpora = {"dsd64","dsd128","dsd256","pcm22","pcm24"};
+    std::string json;
+};
+
+static void bench_usage(){
+    std::cout << "\ndsd_bench — per-stage throughput on synthetic DSD/PCM\n\n"
+              << "Usage: dsd_bench [--sec 10] [--reps 3] [--corpus dsd64,dsd128,dsd256,pcm22,pcm24|dsd512] [--threads N] [--fft 4096] [--hop 2048] [--sr 176400] [--decimator native|ffmpeg] [--png-level 1] [--no-simd] [--json out.json]\n\n";
+}
+
+static uint32_t xorshift(uint32_t& s){ s ^= s<<13; s ^= s>>17; s ^= s<<5; return s; }
+
+// Second-order sigma-delta modulator over amp*sin(2*pi*freq*t) + white noise,
+// packed LSB first as DSF stores it. |input| stays below 0.5, where the loop is stable.
+static std::vector<uint8_t> sdm_channel(uint64_t nbits, double rate, double freq, double amp, double noise, uint32_t seed){
+    std::vector<uint8_t> out(nbits/8, 0);
+    std::complex<double> ph(1.0, 0.0), rot(std::cos(2*M_PI*freq/rate), std::sin(2*M_PI*freq/rate));
+    double i1=0, i2=0;
+    for(uint64_t i=0;i<nbits;++i){
+        if((i & 4095)==0) ph /= std::abs(ph);
+        double x = amp*ph.imag() + noise*((double)xorshift(seed)/2147483648.0 - 1.0);
+        ph *= rot;
+        double y = i2>=0 ? 1.0 : -1.0;
+        i1 += x - y; i2 += i1 - y;
+        if(y>0) out[i>>3] |= (uint8_t)(1u << (i&7));
+    }
+    return out;
+}
+
+static void write_dsf(const std::string& path, int rate, const std::vector<uint8_t>* ch, int channels){
+    const uint32_t bs = 4096;
+    uint64_t bytes = ch[0].size(), blocks = (bytes+bs-1)/bs, data = blocks*bs*channels;
+    std::ofstream f(path, std::ios::binary); BinWriter w(f);
+    f.write("DSD ", 4); w.u64(28); w.u64(28 + 52 + 12 + data); w.u64(0);
+    f.write("fmt ", 4); w.u64(52); w.u32(1); w.u32(0); w.u32(channels==2 ? 2 : 1); w.u32(channels); w.u32(rate); w.u32(1); w.u64(bytes*8); w.u32(bs); w.u32(0);
+    f.write("data", 4); w.u64(12 + data);
+    std::vector<uint8_t> blk(bs);
+    for(uint64_t b=0;b<blocks;++b) for(int c=0;c<channels;++c){
+        size_t n = (size_t)std::min<uint64_t>(bs, bytes - b*bs);
+        std::fill(blk.begin(), blk.end(), 0); std::memcpy(blk.data(), ch[c].data()+b*bs, n);
+        f.write((const char*)blk.data(), bs);
+    }
+    if(!f) throw std::runtime_error("cannot write " + path);
+}
+
+// Band-limited stereo noise: random-phase flat spectrum below cutoff_hz,
+// independent bins for positive and negative frequencies so one inverse
+// complex FFT yields two real channels (re -> L, im -> R). Tones at 1 and
+// 5 kHz are added on top; peaks land around -3 dBFS.
+static void synth_pcm(int sr, double secs, double cutoff_hz, uint32_t seed, std::vector<float>& L, std::vector<float>& R){
+    size_t n = (size_t)(sr*secs), M = 1; while(M < n) M <<= 1;
+    fftw_complex* X = (fftw_complex*)fftw_malloc(sizeof(fftw_complex)*M);
+    fftw_plan p;
+    { std::lock_guard<std::mutex> lk(fftw_planner_mutex()); p = fftw_plan_dft_1d((int)M, X, X, FFTW_BACKWARD, FFTW_ESTIMATE); }
+    std::mt19937 rng(seed); std::uniform_real_distribution<double> ph(0, 2*M_PI);
+    size_t kc = (size_t)(cutoff_hz * M / sr);
+    for(size_t k=0;k<M;++k){ X[k][0]=0; X[k][1]=0; }
+    for(size_t k=1;k<kc && k<M/2;++k) for(size_t kk : {k, M-k}){ double a = ph(rng); X[kk][0]=std::cos(a); X[kk][1]=std::sin(a); }
+    fftw_execute(p);
+    double rms = 0; for(size_t i=0;i<n;++i) rms += X[i][0]*X[i][0] + X[i][1]*X[i][1];
+    double g = 0.1 / std::sqrt(std::max(rms/(2.0*n), 1e-30));   // noise at -20 dBFS RMS
+    L.resize(n); R.resize(n);
+    for(size_t i=0;i<n;++i){
+        double t = (double)i/sr;
+        L[i] = (float)(g*X[i][0] + 0.35*std::sin(2*M_PI*1000*t));
+        R[i] = (float)(g*X[i][1] + 0.35*std::sin(2*M_PI*5000*t));
+    }
+    { std::lock_guard<std::mutex> lk(fftw_planner_mutex()); fftw_destroy_plan(p); }
+    fftw_free(X);
+}
+
+static void write_wav_float(const std::string& path, int sr, const std::vector<float>& L, const std::vector<float>& R){
+    uint32_t n = (uint32_t)L.size(), data = n*8;
+    std::ofstream f(path, std::ios::binary); BinWriter w(f);
+    f.write("RIFF", 4); w.u32(36 + data); f.write("WAVE", 4);
+    f.write("fmt ", 4); w.u32(16); w.u16(3); w.u16(2); w.u32(sr); w.u32(sr*8); w.u16(8); w.u16(32);
+    f.write("data", 4); w.u32(data);
+    for(uint32_t i=0;i<n;++i){ w.f32(L[i]); w.f32(R[i]); }
+    if(!f) throw std::runtime_error("cannot write " + path);
+}
+
+static uint64_t file_bytes(const std::string& path){ std::error_code ec; auto n = std::filesystem::file_size(path, ec); return ec ? 0 : (uint64_t)n; }
+
+// Runs fn reps times and keeps the best wall time; fn fills samples/bytes/audio_s.
+template<class F>
+static StageResult time_stage(const std::string& name, int reps, F&& fn){
+    StageResult r; r.stage = name; r.seconds = 1e300;
+    try{
+        for(int i=0;i<std::max(1,reps);++i){
+            auto t0 = std::chrono::steady_clock::now();
+            fn(r);
+            r.seconds = std::min(r.seconds, std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count());
+        }
+    } catch(const std::exception& e){ r.error = e.what(); r.seconds = 0; }
+    std::cerr << "  " << name << ": " << (r.error.empty() ? std::to_string(r.seconds) + " s" : "error: " + r.error) << "\n";
+    return r;
+}
+
+struct Pcm { std::vector<float> L, R, M; };
+
+static void bench_corpus(const BenchOptions& b, const std::string& tmp, Corpus& c){
+    const int sr = b.base.target_sr;
+    Options opt = b.base; opt.seconds = 0; opt.outdir = tmp;
+    Pcm pcm, fallback;
+    std::vector<uint8_t> dsd[2];
+    std::vector<float> srcL, srcR;
+    std::cerr << c.name << ": generating\n";
+    if(c.kind == "dsd"){
+        uint64_t nbits = (uint64_t)(c.rate*b.seconds)/8*8;
+        dsd[0] = sdm_channel(nbits, c.rate, 1000.0, 0.35, 0.002, 0x1234567u);
+        dsd[1] = sdm_channel(nbits, c.rate, 3000.0, 0.25, 0.002, 0x89abcdeu);
+        c.path = tmp + "/" + c.name + ".dsf";
+        write_dsf(c.path, c.rate, dsd, 2);
+    } else {
+        synth_pcm(c.rate, b.seconds, c.cutoff_hz, 42u, srcL, srcR);
+        c.path = tmp + "/" + c.name + ".wav";
+        write_wav_float(c.path, c.rate, srcL, srcR);
+    }
+    c.file_bytes = file_bytes(c.path);
+    opt.input = c.path;
+
+    auto collect = [&](Pcm& p){ return [&p](const AudioBlock& blk){ p.L.insert(p.L.end(), blk.left, blk.left+blk.n); p.R.insert(p.R.end(), blk.right, blk.right+blk.n); p.M.insert(p.M.end(), blk.mono, blk.mono+blk.n); }; };
+    auto clear = [](Pcm& p){ p.L.clear(); p.R.clear(); p.M.clear(); };
+
+    c.stages.push_back(time_stage("decode", b.reps, [&](StageResult& r){
+        clear(pcm);
+        StreamInfo si = decode_stream(opt, collect(pcm));
+        r.samples = pcm.M.size(); r.bytes = c.file_bytes; r.audio_s = (double)r.samples/sr;
+        if(r.samples == 0) throw std::runtime_error("no samples decoded (" + si.decimator + ")");
+    }));
+
+    if(c.kind == "dsd" && opt.native_decimator){
+        c.stages.push_back(time_stage("resample", b.reps, [&](StageResult& r){
+            DsdDecimator dec(c.rate, sr, true, 2, opt.simd);
+            clear(fallback);
+            const size_t chunk = 4096;
+            std::vector<float> out[2];
+            for(size_t off=0; off<dsd[0].size(); off+=chunk){
+                size_t nb = std::min(chunk, dsd[0].size()-off);
+                for(int ch=0; ch<2; ++ch){ out[ch].clear(); dec.process(ch, dsd[ch].data()+off, nb, 1, out[ch]); }
+                size_t n = std::min(out[0].size(), out[1].size());
+                fallback.L.insert(fallback.L.end(), out[0].begin(), out[0].begin()+n);
+                fallback.R.insert(fallback.R.end(), out[1].begin(), out[1].begin()+n);
+            }
+            r.samples = fallback.L.size(); r.bytes = dsd[0].size()*2; r.audio_s = (double)r.samples/sr;
+        }));
+    } else if(c.kind == "pcm"){
+        c.stages.push_back(time_stage("resample", b.reps, [&](StageResult& r){
+            SwrContext* swr = swr_alloc_set_opts(nullptr, AV_CH_LAYOUT_STEREO, AV_SAMPLE_FMT_FLTP, sr,
+                                                 AV_CH_LAYOUT_STEREO, AV_SAMPLE_FMT_FLTP, c.rate, 0, nullptr);
+            if(!swr || swr_init(swr) < 0){ swr_free(&swr); throw std::runtime_error("swr init failed"); }
+            clear(fallback);
+            const int chunk = 4096;
+            std::vector<float> oL, oR;
+            for(size_t off=0; off<srcL.size()+chunk; off+=chunk){
+                int n = off<srcL.size() ? (int)std::min<size_t>(chunk, srcL.size()-off) : 0;   // the extra pass (n == 0) flushes
+                int cap = (int)av_rescale_rnd(swr_get_delay(swr, c.rate) + n, sr, c.rate, AV_ROUND_UP);
+                oL.resize(cap); oR.resize(cap);
+                const uint8_t* in[2] = { (const uint8_t*)(srcL.data()+off), (const uint8_t*)(srcR.data()+off) };
+                uint8_t* outp[2] = { (uint8_t*)oL.data(), (uint8_t*)oR.data() };
+                int got = swr_convert(swr, outp, cap, n ? in : nullptr, n);
+                if(got < 0){ swr_free(&swr); throw std::runtime_error("swr_convert failed"); }
+                fallback.L.insert(fallback.L.end(), oL.begin(), oL.begin()+got);
+                fallback.R.insert(fallback.R.end(), oR.begin(), oR.begin()+got);
+            }
+            swr_free(&swr);
+            r.samples = fallback.L.size(); r.bytes = srcL.size()*8; r.audio_s = (double)r.samples/sr;
+        }));
+    }
+
+    if(pcm.M.empty()){
+        // decode failed (e.g. no FFmpeg decoder): analyze the resampled or synthesized PCM instead
+        if(fallback.L.empty() && c.kind == "pcm") synth_pcm(sr, b.seconds, c.cutoff_hz, 42u, fallback.L, fallback.R);
+        pcm.L = std::move(fallback.L); pcm.R = std::move(fallback.R);
+        pcm.M.resize(pcm.L.size());
+        for(size_t i=0;i<pcm.M.size();++i) pcm.M[i] = (float)((pcm.L[i] + pcm.R[i]) * M_SQRT1_2);
+    }
+    if(pcm.M.empty()) return;
+    const size_t n = pcm.M.size();
+    const double audio_s = (double)n/sr;
+
+    ThreadPool pool(opt.threads);
+    SpectralOutputs so, sL, sR;
+    c.stages.push_back(time_stage("stft", b.reps, [&](StageResult& r){
+        // stereo accumulator as Analyzer::analyze runs it: mono + L/R from one complex FFT per frame
+        SpectralAccumulator acc(sr, opt.fft_size, opt.hop_size, true, &pool, opt.fft_double, opt.simd, SpectrogramLayout(), true);
+        const size_t chunk = 16384;
+        for(size_t off=0; off<n; off+=chunk){
+            size_t k = std::min(chunk, n-off);
+            acc.push(pcm.L.data()+off, pcm.R.data()+off, k);
+        }
+        so = acc.finish(&sL, &sR);
+        r.samples = n; r.bytes = n*2*sizeof(float); r.audio_s = audio_s;
+    }));
+
+    Metrics m;
+    c.stages.push_back(time_stage("metrics", b.reps, [&](StageResult& r){
+        m = analyze_metrics(so);
+        DynamicAccumulator dyn(sr, true, opt.simd); dyn.push(pcm.M.data(), pcm.L.data(), pcm.R.data(), n); dyn.finish(m);
+        r.samples = n; r.bytes = n*sizeof(float); r.audio_s = audio_s;
+    }));
+    c.stages.push_back(time_stage("true-peak", b.reps, [&](StageResult& r){
+        TruePeakDetector tp(sr, opt.simd); ClipStats clips;
+        const size_t chunk = 16384;
+        for(size_t off=0; off<n; off+=chunk) tp.push(pcm.L.data()+off, pcm.R.data()+off, std::min(chunk, n-off), (double)off/sr);
+        tp.finish(m, clips);
+        r.samples = n; r.bytes = n*2*sizeof(float); r.audio_s = audio_s;
+    }));
+    c.classification = classify(m);
+
+    c.stages.push_back(time_stage("png", b.reps, [&](StageResult& r){
+        save_spectrogram_png(so, tmp+"/spectrogram.png");
+        save_average_spectrum_png(so, tmp+"/spectrum_avg.png");
+        r.samples = n; r.bytes = so.spectrogram_png.size(); r.audio_s = audio_s;
+    }));
+
+    c.stages.push_back(time_stage("render", b.reps, [&](StageResult& r){
+        save_pretty_spectrogram(so, sr, tmp+"/spectrogram_pretty.png");
+        save_pretty_spectrum_overlay(sL, sR, sr, m, c.classification, tmp+"/spectrum_overlay.png");
+        r.samples = n; r.bytes = so.spectrogram_png.size(); r.audio_s = audio_s;
+    }));
+}
+
+
+static void write_json(std::ostream& o, const BenchOptions& b, const std::vector<Corpus>& cs){
+    std::string dot_kernel; select_dot(b.base.simd, dot_kernel);
+    int threads = b.base.threads>0 ? b.base.threads : (int)std::max(1u, std::thread::hardware_concurrency());
+    char num[64];
+    auto f = [&](double v){ snprintf(num, sizeof num, "%.6g", v); return std::string(num); };
+    o << "{\n  \"tool\": \"dsd_bench\",\n  \"config\": {"
+      << "\"seconds\": " << f(b.seconds) << ", \"reps\": " << b.reps << ", \"threads\": " << threads
+      << ", \"hardware_threads\": " << std::thread::hardware_concurrency()
+      << ", \"target_sr\": " << b.base.target_sr << ", \"fft\": " << b.base.fft_size << ", \"hop\": " << b.base.hop_size
+      << ", \"decimator\": \"" << (b.base.native_decimator ? "native" : "ffmpeg") << "\""
+      << ", \"fft_precision\": \"" << (b.base.fft_double ? "double" : "float") << "\""
+      << ", \"png_level\": " << b.base.png_level
+      << ", \"kernels\": {\"stft\": \"" << (b.base.fft_double ? "double" : select_spectral_kernels(b.base.simd).name) << "\", \"decimator\": \"" << dot_kernel << "\"}},\n"
+      << "  \"corpora\": [";
+    for(size_t i=0;i<cs.size();++i){
+        const Corpus& c = cs[i];
+        o << (i ? ",\n" : "\n") << "    {\"name\": \"" << c.name << "\", \"kind\": \"" << c.kind << "\", \"rate\": " << c.rate
+          << ", \"file_bytes\": " << c.file_bytes << ", \"classification\": \"" << json_escape(c.classification) << "\",\n     \"stages\": [";
+        for(size_t j=0;j<c.stages.size();++j){
+            const StageResult& s = c.stages[j];
+            o << (j ? ",\n" : "\n") << "      {\"stage\": \"" << s.stage << "\"";
+            if(!s.error.empty()) o << ", \"error\": \"" << json_escape(s.error) << "\"}";
+            else {
+                double t = std::max(s.seconds, 1e-9);
+                o << ", \"seconds\": " << f(s.seconds) << ", \"samples\": " << s.samples << ", \"bytes\": " << s.bytes
+                  << ", \"samples_per_s\": " << f(s.samples/t) << ", \"mb_per_s\": " << f(s.bytes/t/1e6)
+                  << ", \"realtime\": " << f(s.audio_s/t) << "}";
+            }
+        }
+        o << "\n     ]}";
+    }
+    o << "\n  ]\n}\n";
+}
+
+int main(int argc, char** argv){
+    av_log_set_level(AV_LOG_ERROR);
+    BenchOptions b;
+    for(int i=1;i<argc;++i){ std::string a=argv[i];
+        if(a=="--sec" && i+1<argc){ b.seconds=std::stod(argv[++i]); }
+        else if(a=="--reps" && i+1<argc){ b.reps=std::stoi(argv[++i]); }
+        else if(a=="--corpus" && i+1<argc){ b.corpora.clear(); std::string s=argv[++i]; size_t p=0; while(p<=s.size()){ size_t q=s.find(',',p); if(q==std::string::npos) q=s.size(); if(q>p) b.corpora.push_back(s.substr(p,q-p)); p=q+1; } }
+        else if(a=="--threads" && i+1<argc){ b.base.threads=std::stoi(argv[++i]); }
+        else if(a=="--fft" && i+1<argc){ b.base.fft_size=std::stoi(argv[++i]); }
+        else if(a=="--hop" && i+1<argc){ b.base.hop_size=std::stoi(argv[++i]); }
+        else if(a=="--sr" && i+1<argc){ b.base.target_sr=std::stoi(argv[++i]); }
+        else if(a=="--decimator" && i+1<argc){ b.base.native_decimator = std::string(argv[++i])!="ffmpeg"; }
+        else if(a=="--fft-precision" && i+1<argc){ b.base.fft_double = std::string(argv[++i])=="double"; }
+        else if(a=="--png-level" && i+1<argc){ b.base.png_level=std::clamp(std::stoi(argv[++i]), 0, 9); }
+        else if(a=="--no-simd"){ b.base.simd=false; }
+        else if(a=="--json" && i+1<argc){ b.json=argv[++i]; }
+        else { bench_usage(); return (a=="-h"||a=="--help") ? 0 : 1; }
+    }
+    if(b.seconds <= 0 || b.base.fft_size < 2 || b.base.hop_size < 1){ bench_usage(); return 1; }
+    g_png.level = b.base.png_level; g_png.threads = b.base.threads;
+
+    std::filesystem::path tmp = std::filesystem::temp_directory_path() / ("dsd_bench." + std::to_string(::getpid()));
+    std::filesystem::create_directories(tmp);
+    std::vector<Corpus> cs;
+    int rc = 0;
+    try{
+        for(const std::string& name : b.corpora){
+            Corpus c; c.name = name;
+            if(name=="dsd64"){ c.kind="dsd"; c.rate=2822400; }
+            else if(name=="dsd128"){ c.kind="dsd"; c.rate=5644800; }
+            else if(name=="dsd256"){ c.kind="dsd"; c.rate=11289600; }
+            else if(name=="dsd512"){ c.kind="dsd"; c.rate=22579200; }
+            else if(name=="pcm22"){ c.kind="pcm"; c.rate=88200; c.cutoff_hz=22000; }
+            else if(name=="pcm24"){ c.kind="pcm"; c.rate=96000; c.cutoff_hz=24000; }
+            else throw std::runtime_error("unknown corpus: " + name);
+            bench_corpus(b, tmp.string(), c);
+            std::filesystem::remove(c.path);
+            cs.push_back(std::move(c));
+        }
+        if(b.json.empty()) write_json(std::cout, b, cs);
+        else { std::ofstream f(b.json); write_json(f, b, cs); if(!f) throw std::runtime_error("cannot write " + b.json); }
+    } catch(const std::exception& e){ std::cerr << "Error: " << e.what() << "\n"; rc = 2; }
+    std::error_code ec; std::filesystem::remove_all(tmp, ec);
+    return rc;
+}
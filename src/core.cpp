@@ -0,0 +1,1009 @@
+// libdsdinspect internals: profiling, DSF/DFF reader, DSD decimator, decode
+// paths, STFT kernels, metrics and classification (see core.h).
+#include "core.h"
+
+#include <exception>
+#include <stdexcept>
+#include <sys/resource.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libavutil/avutil.h>
+#include <libavutil/opt.h>
+#include <libswresample/swresample.h>
+}
+
+// ----------------- Profiling (--profile) -----------------
+thread_local uint64_t t_allocs = 0, t_alloc_bytes = 0;
+thread_local Profile* t_profile = nullptr;
+thread_local StageTimer* StageTimer::t_stage = nullptr;
+
+double wall_now(){ return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count(); }
+double cpu_now(bool process){ timespec ts; clock_gettime(process ? CLOCK_PROCESS_CPUTIME_ID : CLOCK_THREAD_CPUTIME_ID, &ts); return ts.tv_sec + ts.tv_nsec*1e-9; }
+long peak_rss_kb(){ rusage ru; getrusage(RUSAGE_SELF, &ru); return ru.ru_maxrss; }
+
+std::string json_escape(const std::string& s){
+    std::string o; for(char ch : s){ if(ch=='"'||ch=='\\'){ o+='\\'; o+=ch; } else if((unsigned char)ch<0x20) o+=' '; else o+=ch; } return o;
+}
+
+void print_profile(std::ostream& o, const Profile& p){
+    char line[160];
+    snprintf(line, sizeof line, "%-14s %10s %10s %8s %10s %10s\n", "stage", "wall s", "cpu s", "calls", "allocs", "alloc MB"); o << line;
+    double sw=0, sc=0;
+    for(const auto& kv : p.stages){
+        const StageStats& s = kv.second; sw += s.wall; sc += s.cpu;
+        snprintf(line, sizeof line, "%-14s %10.3f %10.3f %8llu %10llu %10.1f\n", kv.first.c_str(), s.wall, s.cpu,
+                 (unsigned long long)s.calls, (unsigned long long)s.allocs, s.alloc_bytes/1e6); o << line;
+    }
+    snprintf(line, sizeof line, "%-14s %10.3f %10.3f\n", "(other)", std::max(0.0, p.wall-sw), std::max(0.0, p.cpu-sc)); o << line;
+    snprintf(line, sizeof line, "%-14s %10.3f %10.3f %8s %10llu %10.1f\n", "total", p.wall, p.cpu, "",
+             (unsigned long long)p.allocs, p.alloc_bytes/1e6); o << line;
+    snprintf(line, sizeof line, "read %.1f MB, %llu input samples, %llu PCM frames (%.1f s audio, %.1fx realtime), %llu FFT frames, peak RSS %.1f MB\n",
+             p.bytes_read/1e6, (unsigned long long)p.samples_in, (unsigned long long)p.samples_out, p.audio_s, p.wall>0 ? p.audio_s/p.wall : 0.0,
+             (unsigned long long)p.fft_frames, p.peak_rss_kb/1024.0); o << line;
+}
+
+void write_profile_json(std::ostream& o, const Profile& p, const std::string& indent){
+    char num[64]; auto f = [&](double v){ snprintf(num, sizeof num, "%.6g", v); return std::string(num); };
+    o << "{\n" << indent << "  \"wall_s\": " << f(p.wall) << ", \"cpu_s\": " << f(p.cpu) << ", \"cpu_clock\": \"" << (p.process_cpu ? "process" : "thread") << "\""
+      << ", \"files\": " << p.files << ", \"audio_s\": " << f(p.audio_s) << ", \"realtime\": " << f(p.wall>0 ? p.audio_s/p.wall : 0.0) << ",\n"
+      << indent << "  \"bytes_read\": " << p.bytes_read << ", \"samples_in\": " << p.samples_in << ", \"samples_out\": " << p.samples_out
+      << ", \"fft_frames\": " << p.fft_frames << ", \"peak_rss_kb\": " << p.peak_rss_kb
+      << ", \"allocs\": " << p.allocs << ", \"alloc_bytes\": " << p.alloc_bytes << ",\n" << indent << "  \"stages\": {";
+    bool first = true;
+    for(const auto& kv : p.stages){
+        const StageStats& s = kv.second;
+        o << (first ? "\n" : ",\n") << indent << "    \"" << json_escape(kv.first) << "\": {\"wall_s\": " << f(s.wall) << ", \"cpu_s\": " << f(s.cpu)
+          << ", \"calls\": " << s.calls << ", \"allocs\": " << s.allocs << ", \"alloc_bytes\": " << s.alloc_bytes << "}";
+        first = false;
+    }
+    o << "\n" << indent << "  }\n" << indent << "}";
+}
+
+// ----------------- Native DSF / DSDIFF reader -----------------
+static uint16_t rd_be16(const uint8_t* p){ return (uint16_t)(p[0]<<8 | p[1]); }
+static uint32_t rd_be32(const uint8_t* p){ return (uint32_t)p[0]<<24 | (uint32_t)p[1]<<16 | (uint32_t)p[2]<<8 | (uint32_t)p[3]; }
+static uint64_t rd_be64(const uint8_t* p){ return (uint64_t)rd_be32(p)<<32 | rd_be32(p+4); }
+
+static bool parse_dsf(DsdFile& d){
+    const uint8_t* p = d.map.data(); size_t n = d.map.size();
+    if(n < 28+52+12 || std::memcmp(p,"DSD ",4)!=0) return false;
+    size_t off = (size_t)rd_le64(p+4);                       // DSD chunk size (28)
+    if(off+52 > n || std::memcmp(p+off,"fmt ",4)!=0) throw std::runtime_error("DSF: missing fmt chunk");
+    const uint8_t* f = p+off;
+    if(rd_le32(f+16)!=0) throw std::runtime_error("DSF: unsupported format id");
+    d.channels   = (int)rd_le32(f+24);
+    d.dsd_rate   = (int)rd_le32(f+28);
+    d.lsb_first  = rd_le32(f+32)==1;                          // 1: LSB first, 8: MSB first
+    d.samples    = rd_le64(f+36);
+    d.block_size = rd_le32(f+44);
+    off += (size_t)rd_le64(f+4);
+    if(off+12 > n || std::memcmp(p+off,"data",4)!=0) throw std::runtime_error("DSF: missing data chunk");
+    d.data_off   = off+12;
+    d.data_bytes = std::min<size_t>((size_t)rd_le64(p+off+4) - 12, n - d.data_off);
+    if(d.channels<1 || d.dsd_rate<=0 || d.block_size==0) throw std::runtime_error("DSF: bad fmt chunk");
+    d.dsf = true;
+    return true;
+}
+
+static bool parse_dff(DsdFile& d){
+    const uint8_t* p = d.map.data(); size_t n = d.map.size();
+    if(n < 16 || std::memcmp(p,"FRM8",4)!=0 || std::memcmp(p+12,"DSD ",4)!=0) return false;
+    size_t end = std::min<size_t>(n, 12 + (size_t)rd_be64(p+4));
+    bool dst = false;
+    for(size_t off=16; off+12<=end; ){
+        const uint8_t* c = p+off; uint64_t sz = rd_be64(c+4); size_t body = off+12;
+        if(std::memcmp(c,"PROP",4)==0 && body+4<=end && std::memcmp(p+body,"SND ",4)==0){
+            size_t pend = std::min<size_t>(end, body+sz);
+            for(size_t q=body+4; q+12<=pend; ){
+                const uint8_t* sc = p+q; uint64_t ssz = rd_be64(sc+4);
+                if(std::memcmp(sc,"FS  ",4)==0 && ssz>=4) d.dsd_rate = (int)rd_be32(sc+12);
+                else if(std::memcmp(sc,"CHNL",4)==0 && ssz>=2) d.channels = rd_be16(sc+12);
+                else if(std::memcmp(sc,"CMPR",4)==0 && ssz>=4) dst = std::memcmp(sc+12,"DSD ",4)!=0;
+                q += 12 + (size_t)ssz + (ssz&1);
+            }
+        } else if(std::memcmp(c,"DSD ",4)==0){
+            d.data_off = body; d.data_bytes = std::min<size_t>((size_t)sz, n-body);
+        } else if(std::memcmp(c,"DST ",4)==0){
+            dst = true;
+        }
+        off = body + (size_t)sz + (sz&1);
+    }
+    if(dst || d.data_off==0) return false;                    // DST-compressed: leave to FFmpeg
+    if(d.channels<1 || d.dsd_rate<=0) throw std::runtime_error("DFF: bad PROP chunk");
+    d.dsf = false; d.lsb_first = false;
+    d.samples = (uint64_t)(d.data_bytes / d.channels) * 8;
+    return true;
+}
+
+bool open_dsd_file(const std::string& path, DsdFile& d){
+    if(!d.map.open(path)) return false;
+    return parse_dsf(d) || parse_dff(d);
+}
+
+// ----------------- Native DSD decimator -----------------
+static double bessel_i0(double x){ double s=1, t=1; for(int k=1;k<64;++k){ t *= (x/(2*k))*(x/(2*k)); s+=t; if(t<1e-14*s) break; } return s; }
+
+static int kaiser_length(double atten_db, double transition){ return (int)std::ceil((atten_db-7.95)/(2.285*2*M_PI*transition)) + 1; }
+
+// Lowpass with cutoff fc (cycles/sample), unity DC gain.
+static std::vector<double> kaiser_lowpass(int ntaps, double fc, double atten_db){
+    double beta = 0.1102*(atten_db-8.7);
+    std::vector<double> h(ntaps); double c = (ntaps-1)/2.0, sum=0, i0b = bessel_i0(beta);
+    for(int j=0;j<ntaps;++j){
+        double t = j - c, r = (ntaps>1) ? t/c : 0.0;
+        double sinc = (t==0) ? 2*fc : std::sin(2*M_PI*fc*t)/(M_PI*t);
+        h[j] = sinc * bessel_i0(beta*std::sqrt(std::max(0.0, 1-r*r))) / i0b; sum += h[j];
+    }
+    for(double& v : h) v /= sum;
+    return h;
+}
+
+
+static float dot_scalar(const float* a, const float* b, size_t n){
+    float s0=0,s1=0,s2=0,s3=0;
+    for(size_t i=0;i<n;i+=4){ s0+=a[i]*b[i]; s1+=a[i+1]*b[i+1]; s2+=a[i+2]*b[i+2]; s3+=a[i+3]*b[i+3]; }
+    return (s0+s1)+(s2+s3);
+}
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("avx2,fma")))
+static float dot_avx2(const float* a, const float* b, size_t n){
+    __m256 acc0=_mm256_setzero_ps(), acc1=_mm256_setzero_ps();
+    size_t i=0;
+    for(; i+16<=n; i+=16){
+        acc0=_mm256_fmadd_ps(_mm256_loadu_ps(a+i),   _mm256_loadu_ps(b+i),   acc0);
+        acc1=_mm256_fmadd_ps(_mm256_loadu_ps(a+i+8), _mm256_loadu_ps(b+i+8), acc1);
+    }
+    if(i<n) acc0=_mm256_fmadd_ps(_mm256_loadu_ps(a+i), _mm256_loadu_ps(b+i), acc0);
+    __m256 acc=_mm256_add_ps(acc0,acc1);
+    __m128 v=_mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc,1));
+    v=_mm_add_ps(v,_mm_movehl_ps(v,v)); v=_mm_add_ss(v,_mm_shuffle_ps(v,v,1));
+    return _mm_cvtss_f32(v);
+}
+#endif
+#if defined(__ARM_NEON)
+static float dot_neon(const float* a, const float* b, size_t n){
+    float32x4_t acc0=vdupq_n_f32(0), acc1=vdupq_n_f32(0);
+    for(size_t i=0;i<n;i+=8){ acc0=vmlaq_f32(acc0,vld1q_f32(a+i),vld1q_f32(b+i)); acc1=vmlaq_f32(acc1,vld1q_f32(a+i+4),vld1q_f32(b+i+4)); }
+    float32x4_t acc=vaddq_f32(acc0,acc1);
+    float32x2_t s=vadd_f32(vget_low_f32(acc),vget_high_f32(acc));
+    return vget_lane_f32(vpadd_f32(s,s),0);
+}
+#endif
+
+DotFn select_dot(bool simd, std::string& name){
+#if defined(__x86_64__) || defined(__i386__)
+    if(simd && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")){ name="avx2"; return dot_avx2; }
+#endif
+#if defined(__ARM_NEON)
+    if(simd){ name="neon"; return dot_neon; }
+#endif
+    (void)simd; name="scalar"; return dot_scalar;
+}
+
+HalfbandStage HalfbandStage::design(int r, double fp, double atten_db){
+    HalfbandStage hb;
+    int n = kaiser_length(atten_db, (r/2.0 - 2*fp)/r);
+    int K = std::max(0, (n-3+3)/4); n = 4*K+3;
+    std::vector<double> hh = kaiser_lowpass(n, 0.25, atten_db);
+    hb.hc = (float)hh[(n-1)/2];
+    size_t G = (size_t)(n+1)/2, Gp = (G+7)/8*8;           // even-phase taps, padded for SIMD
+    hb.grev.assign(Gp, 0.0f);
+    for(size_t i=0;i<G;++i) hb.grev[Gp-1-i] = (float)hh[2*i];
+    hb.G = Gp; hb.K = (size_t)K;
+    return hb;
+}
+
+DsdDecimator::DsdDecimator(int dsd_rate, int target_sr, bool lsb_first, int channels, bool simd)
+{
+    int r1=0, k=0;
+    if(!plan(dsd_rate, target_sr, r1, k)) throw std::runtime_error("DSD decimator: unsupported rate");
+    dot_ = select_dot(simd, kernel_);
+    const double A = 120.0, fp = 0.45*target_sr;
+
+    // stage 1: 1-bit -> r1, protecting [0,fp] from everything folding down
+    m_ = (size_t)(dsd_rate/8/r1);
+    int n1 = kaiser_length(A, (r1 - 2*fp)/dsd_rate);
+    T_ = (size_t)(n1+7)/8;
+    std::vector<double> h = kaiser_lowpass((int)T_*8, 0.5*r1/dsd_rate, A);
+    lut_.assign(T_*256, 0.0f);
+    for(size_t t=0;t<T_;++t) for(int b=0;b<256;++b){
+        double v=0;
+        for(int j=0;j<8;++j){ int bit = lsb_first ? (b>>j)&1 : (b>>(7-j))&1; v += h[t*8+j] * (bit ? 1.0 : -1.0); }
+        lut_[t*256+b] = (float)v;
+    }
+
+    // half-band stages r -> r/2
+    for(int s=0, r=r1; s<k; ++s, r/=2) halfbands_.push_back(HalfbandStage::design(r, fp, A));
+    chans_.resize(channels);
+    reset();
+}
+
+// ----------------- Decode paths -----------------
+// Common tail of every decode path: enforces the --sec limit, derives mono
+// and hands planar L/R chunks to the sink.
+class PcmEmitter {
+public:
+    // --sec limits the whole stream; with --sample each window is limited by begin_window().
+    PcmEmitter(const Options& opt, const std::function<void(const AudioBlock&)>& sink)
+        : sink_(sink), sr_(opt.target_sr), max_samples_((opt.seconds>0 && opt.sample_windows<=0) ? (int64_t)opt.target_sr*opt.seconds : INT64_MAX) {}
+
+    bool done() const { return stopped_ || written_ >= max_samples_; }
+    bool stopped() const { return stopped_; }           // the sink ended decoding (AudioBlock::stop)
+
+    // Starts a sampled window after a seek: the first `skip` samples (decoder
+    // warm-up) are dropped, then at most max_samples are passed on, the first
+    // block flagged as a discontinuity. Block times count from start_s.
+    void begin_window(int64_t max_samples, int64_t skip, double start_s){ max_samples_ = max_samples; written_ = 0; skip_ = skip; gap_ = true; t0_ = start_s; }
+
+    // After a seek that can land early, before the window's first sample:
+    // the decoded audio starts at first_s. Everything before start_s is
+    // dropped as well (it doubles as warm-up), and block times count from
+    // where the kept audio really starts.
+    void anchor(double first_s){ skip_ = std::max<int64_t>(skip_, std::llround((t0_ - first_s)*sr_)); t0_ = first_s + (double)skip_/sr_; }
+
+    // Returns false once the sample limit is reached.
+    bool emit(const float* L, const float* R, size_t n){
+        if (skip_>0){ int64_t k = std::min<int64_t>(skip_, (int64_t)n); L += k; R += k; n -= (size_t)k; skip_ -= k; }
+        int64_t can = std::min<int64_t>((int64_t)n, max_samples_ - written_);
+        if (can>0){
+            if ((size_t)can > M_.size()) M_.resize(can);
+            for (int64_t i=0;i<can;++i) M_[i] = (float)((L[i] + R[i]) * M_SQRT1_2);
+            AudioBlock blk; blk.left=L; blk.right=R; blk.mono=M_.data(); blk.n=(size_t)can; blk.t=t0_+(double)written_/sr_; blk.discontinuity=gap_; gap_=false;
+            sink_(blk);
+            stopped_ = stopped_ || blk.stop;
+            written_ += can;
+            if(t_profile) t_profile->samples_out += can;
+        }
+        return !done();
+    }
+
+private:
+    const std::function<void(const AudioBlock&)>& sink_;
+    int sr_;
+    int64_t max_samples_, written_ = 0, skip_ = 0;
+    double t0_ = 0;                     // source time of the window's first emitted sample
+    bool gap_ = false, stopped_ = false;
+    std::vector<float> M_;
+};
+
+// Resamples libavcodec frames to planar float L/R at opt.target_sr.
+class FrameResampler {
+public:
+    FrameResampler(const Options& opt, AVCodecContext* ctx, PcmEmitter& em)
+        : em_(em), out_sr_(opt.target_sr), in_sr_(ctx->sample_rate)
+    {
+        int in_channels = ctx->ch_layout.nb_channels ? ctx->ch_layout.nb_channels : ctx->channels;
+        int64_t in_layout = av_get_default_channel_layout(in_channels);
+        // planar float output: swr writes straight into the L/R scratch planes
+        swr_ = swr_alloc_set_opts(nullptr,
+            AV_CH_LAYOUT_STEREO, AV_SAMPLE_FMT_FLTP, opt.target_sr,
+            in_layout, ctx->sample_fmt, ctx->sample_rate, 0, nullptr);
+        if (!swr_ || swr_init(swr_) < 0) throw std::runtime_error("swr init failed");
+    }
+    ~FrameResampler(){ swr_free(&swr_); }
+
+    bool done() const { return em_.done(); }
+
+    // Returns false once the sample limit is reached.
+    bool feed(const AVFrame* frm){
+        const uint8_t** in = (const uint8_t**)frm->extended_data;
+        int outcount = av_rescale_rnd(swr_get_delay(swr_, in_sr_) + frm->nb_samples, out_sr_, in_sr_, AV_ROUND_UP);
+        if ((size_t)outcount > L_.size()){ L_.resize(outcount); R_.resize(outcount); }
+        uint8_t* outptr[2] = { (uint8_t*)L_.data(), (uint8_t*)R_.data() };
+        int conv;
+        { StageTimer st("resample"); conv = swr_convert(swr_, outptr, outcount, in, frm->nb_samples); }
+        return (conv>0) ? em_.emit(L_.data(), R_.data(), (size_t)conv) : !done();
+    }
+
+private:
+    PcmEmitter& em_;
+    SwrContext* swr_ = nullptr;
+    int out_sr_, in_sr_;
+    std::vector<float> L_, R_;
+};
+
+// --sample K:D: start times (s) of K windows of D s spread evenly over a
+// stream of total_s seconds, each centred in its K-th of the file. Empty
+// when not sampling or when the windows would cover the whole file anyway.
+static std::vector<double> sample_starts(const Options& opt, double total_s){
+    std::vector<double> st;
+    const int K = opt.sample_windows; const double D = opt.sample_seconds;
+    if(K<=0 || D<=0 || total_s<=0 || K*D >= total_s) return st;
+    for(int i=0;i<K;++i) st.push_back(std::clamp((i+0.5)*total_s/K - 0.5*D, 0.0, total_s-D));
+    return st;
+}
+
+// Owners for libav objects, so an exception mid-decode still frees them.
+struct FormatCloser { void operator()(AVFormatContext* p) const { avformat_close_input(&p); } };
+struct CodecFree { void operator()(AVCodecContext* p) const { avcodec_free_context(&p); } };
+struct PacketFree { void operator()(AVPacket* p) const { av_packet_free(&p); } };
+struct FrameFree { void operator()(AVFrame* p) const { av_frame_free(&p); } };
+using FormatPtr = std::unique_ptr<AVFormatContext, FormatCloser>;
+using CodecPtr = std::unique_ptr<AVCodecContext, CodecFree>;
+using PacketPtr = std::unique_ptr<AVPacket, PacketFree>;
+using FramePtr = std::unique_ptr<AVFrame, FrameFree>;
+
+// Samples dropped after each seek while filters/resampler settle (~12 ms).
+static const int64_t SEEK_WARMUP_SAMPLES = 2048;
+
+// Native DSD -> PCM straight from the mapping. Mono sources are spread to
+// L = R = x/sqrt(2), as swresample does. With --sample each window starts one
+// block group early from a reset decimator, and that group's output is dropped.
+static void decode_dsd_native(const Options& opt, DsdFile& d, PcmEmitter& em, StreamInfo& info){
+    DsdDecimator dec(d.dsd_rate, opt.target_sr, d.lsb_first, d.channels, opt.simd);
+    info.decimator = "native-" + dec.kernel();
+    const size_t per_ch = d.dsf ? d.block_size : 4096;
+    const size_t group = per_ch*d.channels;
+    const uint8_t* base = d.map.data() + d.data_off;
+    const uint64_t total_bytes = d.samples/8;                 // per channel, without DSF zero padding
+    std::vector<float> out[2];
+    auto run = [&](uint64_t g0){
+        uint64_t left_bytes = total_bytes > g0*per_ch ? total_bytes - g0*per_ch : 0;
+        for (size_t off=g0*group; off<d.data_bytes && left_bytes>0 && !em.done(); off+=group){
+            size_t len = std::min(group, (d.data_bytes-off) / d.channels * d.channels);
+            if (len==0 || (d.dsf && len<group)) break;
+            size_t nb = std::min<uint64_t>(len/d.channels, left_bytes);
+            {
+                StageTimer st("resample");
+                for (int ch=0; ch<d.channels; ++ch){
+                    const uint8_t* src = d.dsf ? base+off+ch*per_ch : base+off+ch;
+                    dec.process(ch, src, nb, d.dsf ? 1 : d.channels, out[ch]);
+                }
+            }
+            if(t_profile){ t_profile->bytes_read += len; t_profile->samples_in += (uint64_t)nb*8; }
+            left_bytes -= nb;
+            if (d.channels==1){ for(float& v : out[0]) v *= (float)M_SQRT1_2; out[1] = out[0]; }
+            em.emit(out[0].data(), out[1].data(), std::min(out[0].size(), out[1].size()));
+            out[0].clear(); out[1].clear();
+            d.map.release_until(d.data_off + off);
+        }
+    };
+    std::vector<double> starts = sample_starts(opt, info.duration_s());
+    if (starts.empty()){ run(0); return; }
+    const int64_t win = (int64_t)(opt.sample_seconds*opt.target_sr);
+    const int64_t warm = (int64_t)per_ch*8*opt.target_sr/d.dsd_rate;
+    for (double s : starts){
+        if (em.stopped()) break;
+        uint64_t g = (uint64_t)(s*d.dsd_rate/8) / per_ch, g0 = g>0 ? g-1 : 0;
+        d.map.prefetch(d.data_off + g0*group, (size_t)((opt.sample_seconds*d.dsd_rate/8 + 2*per_ch)*d.channels));
+        dec.reset();
+        em.begin_window(win, g>0 ? warm : 0, s);
+        run(g0);
+    }
+    info.windows = (int)starts.size();
+}
+
+// DSF/DFF via libavcodec: packets point straight into the mapping (wrapped in
+// a no-op-free AVBufferRef so libavcodec references them instead of copying)
+// and go to the DSD decoder without a demuxer, then through swresample.
+static void decode_dsd_ffmpeg(const Options& opt, DsdFile& d, PcmEmitter& em, StreamInfo& info){
+    AVCodecID id = d.dsf ? (d.lsb_first ? AV_CODEC_ID_DSD_LSBF_PLANAR : AV_CODEC_ID_DSD_MSBF_PLANAR)
+                         : (d.lsb_first ? AV_CODEC_ID_DSD_LSBF : AV_CODEC_ID_DSD_MSBF);
+    const AVCodec* dec = avcodec_find_decoder(id);
+    if (!dec) throw std::runtime_error("No DSD decoder");
+    CodecPtr ctxp(avcodec_alloc_context3(dec));
+    AVCodecContext* ctx = ctxp.get();
+    if (!ctx) throw std::runtime_error("No codec ctx");
+    ctx->sample_rate = d.dsd_rate/8;                          // one output sample per byte
+    av_channel_layout_default(&ctx->ch_layout, d.channels);
+    if (avcodec_open2(ctx, dec, nullptr) < 0) throw std::runtime_error("open decoder failed");
+    info.decimator = "ffmpeg";
+
+    PacketPtr pktp(av_packet_alloc()); FramePtr frmp(av_frame_alloc());
+    AVPacket* pkt = pktp.get();
+    AVFrame*  frm = frmp.get();
+    const size_t per_ch = d.dsf ? d.block_size : 4096;
+    const size_t group = per_ch*d.channels;
+    const uint8_t* base = d.map.data() + d.data_off;
+    const int64_t total_out = (int64_t)(d.samples/8);         // drop DSF zero padding in the last block
+    auto run = [&](uint64_t g0){
+        FrameResampler rs(opt, ctx, em);                      // fresh swr state per window
+        int64_t left_out = total_out - (int64_t)(g0*per_ch);
+        for (size_t off=g0*group; off<d.data_bytes && left_out>0 && !rs.done(); off+=group){
+            // DSF data is whole block groups; a DFF tail may be short (kept channel-aligned)
+            size_t len = std::min(group, (d.data_bytes-off) / d.channels * d.channels);
+            if (len==0 || (d.dsf && len<group)) break;
+            pkt->buf  = av_buffer_create((uint8_t*)(base+off), len, [](void*, uint8_t*){}, nullptr, AV_BUFFER_FLAG_READONLY);
+            pkt->data = (uint8_t*)(base+off); pkt->size = (int)len;
+            if(t_profile){ t_profile->bytes_read += len; t_profile->samples_in += (uint64_t)(len/d.channels)*8; }
+            int ret = avcodec_send_packet(ctx, pkt);
+            av_packet_unref(pkt);
+            if (ret < 0) break;
+            while (avcodec_receive_frame(ctx, frm) >= 0){
+                if (frm->nb_samples > left_out) frm->nb_samples = (int)left_out;
+                left_out -= frm->nb_samples;
+                bool more = rs.feed(frm);
+                av_frame_unref(frm);
+                if (!more) break;
+            }
+            d.map.release_until(d.data_off + off);
+        }
+    };
+    std::vector<double> starts = sample_starts(opt, info.duration_s());
+    if (starts.empty()) run(0);
+    else {
+        const int64_t win = (int64_t)(opt.sample_seconds*opt.target_sr);
+        for (double s : starts){
+            if (em.stopped()) break;
+            uint64_t g = (uint64_t)(s*d.dsd_rate/8) / per_ch;
+            d.map.prefetch(d.data_off + g*group, (size_t)((opt.sample_seconds*d.dsd_rate/8 + per_ch)*d.channels));
+            avcodec_flush_buffers(ctx);
+            em.begin_window(win, g>0 ? SEEK_WARMUP_SAMPLES : 0, s);
+            run(g);
+        }
+        info.windows = (int)starts.size();
+    }
+}
+
+static StreamInfo decode_stream_dsd(const Options& opt, DsdFile& d, const std::function<void(const AudioBlock&)>& sink){
+    StreamInfo info; info.container = d.dsf ? "dsf" : "dff"; info.channels = d.channels;
+    info.in_rate = d.dsd_rate; info.samples = d.samples; info.out_sr = opt.target_sr;
+    PcmEmitter em(opt, sink);
+    int r1, k;
+    if (opt.native_decimator && d.channels<=2 && DsdDecimator::plan(d.dsd_rate, opt.target_sr, r1, k))
+        decode_dsd_native(opt, d, em, info);
+    else
+        decode_dsd_ffmpeg(opt, d, em, info);
+    return info;
+}
+
+static StreamInfo decode_stream_ffmpeg(const Options& opt, const std::function<void(const AudioBlock&)>& sink){
+    AVFormatContext* fmt = nullptr;
+    if (avformat_open_input(&fmt, opt.input.c_str(), nullptr, nullptr) < 0)
+        throw std::runtime_error("Failed to open input");
+    FormatPtr fmtp(fmt);
+    if (avformat_find_stream_info(fmt, nullptr) < 0)
+        throw std::runtime_error("Failed to find stream info");
+
+    int astream = av_find_best_stream(fmt, AVMEDIA_TYPE_AUDIO, -1, -1, nullptr, 0);
+    if (astream < 0) throw std::runtime_error("No audio stream");
+
+    AVStream* st = fmt->streams[astream];
+    const AVCodec* dec = avcodec_find_decoder(st->codecpar->codec_id);
+    if (!dec) throw std::runtime_error("No decoder");
+
+    CodecPtr ctxp(avcodec_alloc_context3(dec));
+    AVCodecContext* ctx = ctxp.get();
+    if (!ctx) throw std::runtime_error("No codec ctx");
+    if (avcodec_parameters_to_context(ctx, st->codecpar) < 0)
+        throw std::runtime_error("param->ctx failed");
+
+    if (avcodec_open2(ctx, dec, nullptr) < 0)
+        throw std::runtime_error("open decoder failed");
+
+    StreamInfo info; info.container = "ffmpeg"; info.out_sr = opt.target_sr; info.decimator = "ffmpeg";
+    info.channels = ctx->ch_layout.nb_channels ? ctx->ch_layout.nb_channels : ctx->channels;
+    info.in_rate = ctx->sample_rate;
+    if (fmt->duration > 0) info.samples = (uint64_t)av_rescale(fmt->duration, ctx->sample_rate, AV_TIME_BASE);
+
+    PacketPtr pktp(av_packet_alloc()); FramePtr frmp(av_frame_alloc());
+    AVPacket* pkt = pktp.get();
+    AVFrame*  frm = frmp.get();
+    PcmEmitter em(opt, sink);
+    // stream time of a decoded frame, from the start of the file
+    const double origin = fmt->start_time != AV_NOPTS_VALUE ? (double)fmt->start_time/AV_TIME_BASE : 0.0;
+    auto run = [&](bool seeked){
+        FrameResampler rs(opt, ctx, em);                      // fresh swr state per window
+        while (!rs.done() && av_read_frame(fmt, pkt) >= 0){
+            if (pkt->stream_index != astream){ av_packet_unref(pkt); continue; }
+            if (avcodec_send_packet(ctx, pkt) < 0){ av_packet_unref(pkt); break; }
+            av_packet_unref(pkt);
+            while (avcodec_receive_frame(ctx, frm) >= 0){
+                if(t_profile) t_profile->samples_in += frm->nb_samples;
+                if (seeked && frm->best_effort_timestamp != AV_NOPTS_VALUE) em.anchor(frm->best_effort_timestamp*av_q2d(st->time_base) - origin);
+                seeked = false;
+                bool more = rs.feed(frm);
+                av_frame_unref(frm);
+                if (!more) break;
+            }
+        }
+    };
+    std::vector<double> starts = sample_starts(opt, fmt->duration > 0 ? (double)fmt->duration/AV_TIME_BASE : 0.0);
+    if (starts.empty()){
+        // unknown duration: sample mode degrades to the first K*D seconds
+        if (opt.sample_windows>0 && fmt->duration<=0) em.begin_window((int64_t)(opt.sample_windows*opt.sample_seconds*opt.target_sr), 0, 0.0);
+        run(false);
+    } else {
+        const int64_t win = (int64_t)(opt.sample_seconds*opt.target_sr);
+        for (double s : starts){
+            if (em.stopped()) break;
+            // backward: land on the frame at or before s (container time base via stream -1);
+            // the first decoded frame's timestamp then trims the window to s
+            if (av_seek_frame(fmt, -1, (int64_t)((origin + s)*AV_TIME_BASE), AVSEEK_FLAG_BACKWARD) < 0)
+                throw std::runtime_error("seek failed: --sample needs a seekable input");
+            avcodec_flush_buffers(ctx);
+            em.begin_window(win, s>0 ? SEEK_WARMUP_SAMPLES : 0, s);
+            run(true);
+        }
+        info.windows = (int)starts.size();
+    }
+    if(t_profile && fmt->pb) t_profile->bytes_read += (uint64_t)fmt->pb->bytes_read;
+    return info;
+}
+
+// DSF/DFF go through the native reader; everything else (FLAC, WAV, DST
+// DFF, ...) through the FFmpeg demuxer.
+StreamInfo decode_stream(const Options& opt, const std::function<void(const AudioBlock&)>& sink){
+    DsdFile d;
+    return decode_stream(opt, opt.native_reader && open_dsd_file(opt.input, d) ? &d : nullptr, sink);
+}
+
+StreamInfo decode_stream(const Options& opt, DsdFile* d, const std::function<void(const AudioBlock&)>& sink){
+    return d ? decode_stream_dsd(opt, *d, sink) : decode_stream_ffmpeg(opt, sink);
+}
+
+namespace {
+struct PcmBatch { std::vector<float> l, r, m; size_t n = 0; double t = 0; bool discontinuity = false; };
+}
+
+StreamInfo decode_pipelined(const Options& opt, const std::function<bool(const AudioBlock&)>& analyze, size_t depth){
+    DsdFile d;
+    return decode_pipelined(opt, opt.native_reader && open_dsd_file(opt.input, d) ? &d : nullptr, analyze, depth);
+}
+
+StreamInfo decode_pipelined(const Options& opt, DsdFile* d, const std::function<bool(const AudioBlock&)>& analyze, size_t depth){
+    SpscQueue<PcmBatch> q(std::max<size_t>(1, depth));
+    StreamInfo info;
+    std::exception_ptr derr, aerr;
+    Profile* parent = t_profile;
+    Profile dprof;
+    std::thread decoder([&]{
+        t_profile = parent ? &dprof : nullptr;
+        PcmBatch* cur = nullptr;
+        try{
+            StageTimer st("decode");
+            info = decode_stream(opt, d, [&](const AudioBlock& b){
+                if(b.discontinuity && cur){ q.push(); cur = nullptr; }          // a batch never spans a seek
+                for(size_t off=0; off<b.n; ){
+                    if(!cur){
+                        { StageTimer wt("queue-full"); cur = q.back(); }
+                        if(!cur){ b.stop = true; return; }                       // the analysis is done
+                        cur->l.resize(PIPELINE_BATCH); cur->r.resize(PIPELINE_BATCH); cur->m.resize(PIPELINE_BATCH);
+                        cur->n = 0; cur->t = b.t + (double)off/opt.target_sr; cur->discontinuity = b.discontinuity && off==0;
+                    }
+                    size_t k = std::min(PIPELINE_BATCH - cur->n, b.n - off);
+                    std::copy(b.left+off, b.left+off+k, &cur->l[cur->n]);
+                    std::copy(b.right+off, b.right+off+k, &cur->r[cur->n]);
+                    std::copy(b.mono+off, b.mono+off+k, &cur->m[cur->n]);
+                    cur->n += k; off += k;
+                    if(cur->n == PIPELINE_BATCH){ q.push(); cur = nullptr; }
+                }
+            });
+            if(cur && cur->n) q.push();
+        } catch(...){ derr = std::current_exception(); }
+        q.close();
+        t_profile = nullptr;
+    });
+    try{
+        for(;;){
+            PcmBatch* b;
+            { StageTimer wt("queue-empty"); b = q.front(); }
+            if(!b) break;
+            AudioBlock blk; blk.left = b->l.data(); blk.right = b->r.data(); blk.mono = b->m.data(); blk.n = b->n; blk.t = b->t; blk.discontinuity = b->discontinuity;
+            bool stop = analyze(blk);
+            q.pop();
+            if(stop) break;
+        }
+    } catch(...){ aerr = std::current_exception(); }
+    q.close();                                                                  // unblocks a decoder waiting for room
+    decoder.join();
+    if(parent) parent->merge(dprof);
+    if(aerr) std::rethrow_exception(aerr);
+    if(derr) std::rethrow_exception(derr);
+    return info;
+}
+
+// ----------------- Spectral analysis -----------------
+std::mutex& fftw_planner_mutex(){ static std::mutex m; return m; }
+
+void make_hann(std::vector<double>& w){ const size_t N=w.size(); for(size_t n=0;n<N;++n){ w[n]=0.5*(1.0-std::cos(2*M_PI*n/(N-1))); } }
+
+static const float DB_PER_LOG2 = 3.0102999566f;          // 10*log10(2)
+static const float LOG2_C1 = 2.8853900818f, LOG2_C3 = 0.9617966939f, LOG2_C5 = 0.5770780164f, LOG2_C7 = 0.4121985831f; // 2/(k*ln 2)
+
+static inline float fast_log2(float x){
+    uint32_t u; std::memcpy(&u, &x, 4);
+    int e = (int)(u>>23) - 127;                          // x > 0 and normal
+    u = (u & 0x7fffffu) | 0x3f800000u; float m; std::memcpy(&m, &u, 4);
+    if(m > 1.41421356f){ m *= 0.5f; ++e; }              // m in [0.707, 1.414]: |t| <= 0.172
+    float t = (m-1.0f)/(m+1.0f), t2 = t*t;
+    return (float)e + t*(LOG2_C1 + t2*(LOG2_C3 + t2*(LOG2_C5 + t2*LOG2_C7)));
+}
+
+static void window_scalar(const float* x, const float* w, float* out, int n){ for(int i=0;i<n;++i) out[i] = x[i]*w[i]; }
+
+static void power_db_scalar(const float* c, int nb, float scale, float* db, float& mn, float& mx){
+    for(int k=0;k<nb;++k){
+        float p = c[2*k]*c[2*k] + c[2*k+1]*c[2*k+1];
+        float d = std::clamp(DB_PER_LOG2*fast_log2(p*scale + 1e-24f), -120.0f, 0.0f);
+        db[k] = d; mn = std::min(mn, d); mx = std::max(mx, d);
+    }
+}
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("avx2,fma")))
+static void window_avx2(const float* x, const float* w, float* out, int n){
+    int i=0;
+    for(; i+8<=n; i+=8) _mm256_storeu_ps(out+i, _mm256_mul_ps(_mm256_loadu_ps(x+i), _mm256_loadu_ps(w+i)));
+    window_scalar(x+i, w+i, out+i, n-i);
+}
+__attribute__((target("avx2,fma")))
+static void power_db_avx2(const float* c, int nb, float scale, float* db, float& mn, float& mx){
+    const __m256 vs=_mm256_set1_ps(scale), eps=_mm256_set1_ps(1e-24f), one=_mm256_set1_ps(1.0f), half=_mm256_set1_ps(0.5f);
+    const __m256 sqrt2=_mm256_set1_ps(1.41421356f), k10=_mm256_set1_ps(DB_PER_LOG2), lo=_mm256_set1_ps(-120.0f), hi=_mm256_setzero_ps();
+    const __m256 c1=_mm256_set1_ps(LOG2_C1), c3=_mm256_set1_ps(LOG2_C3), c5=_mm256_set1_ps(LOG2_C5), c7=_mm256_set1_ps(LOG2_C7);
+    const __m256i mant=_mm256_set1_epi32(0x7fffff), onebits=_mm256_set1_epi32(0x3f800000), bias=_mm256_set1_epi32(127);
+    __m256 vmn=_mm256_set1_ps(mn), vmx=_mm256_set1_ps(mx);
+    int k=0;
+    for(; k+8<=nb; k+=8){
+        __m256 a=_mm256_loadu_ps(c+2*k), b=_mm256_loadu_ps(c+2*k+8);
+        __m256 p=_mm256_hadd_ps(_mm256_mul_ps(a,a), _mm256_mul_ps(b,b));             // p0 p1 p4 p5 | p2 p3 p6 p7
+        p=_mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(p), 0xD8));      // p0 .. p7
+        __m256i u=_mm256_castps_si256(_mm256_fmadd_ps(p, vs, eps));
+        __m256 m=_mm256_castsi256_ps(_mm256_or_si256(_mm256_and_si256(u, mant), onebits));
+        __m256 big=_mm256_cmp_ps(m, sqrt2, _CMP_GT_OQ);
+        m=_mm256_blendv_ps(m, _mm256_mul_ps(m, half), big);
+        __m256 e=_mm256_add_ps(_mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_srli_epi32(u, 23), bias)), _mm256_and_ps(big, one));
+        __m256 t=_mm256_div_ps(_mm256_sub_ps(m, one), _mm256_add_ps(m, one)), t2=_mm256_mul_ps(t, t);
+        __m256 poly=_mm256_fmadd_ps(_mm256_fmadd_ps(_mm256_fmadd_ps(t2, c7, c5), t2, c3), t2, c1);
+        __m256 d=_mm256_mul_ps(_mm256_fmadd_ps(t, poly, e), k10);
+        d=_mm256_min_ps(_mm256_max_ps(d, lo), hi);
+        _mm256_storeu_ps(db+k, d); vmn=_mm256_min_ps(vmn, d); vmx=_mm256_max_ps(vmx, d);
+    }
+    __m128 a=_mm_min_ps(_mm256_castps256_ps128(vmn), _mm256_extractf128_ps(vmn,1)); a=_mm_min_ps(a,_mm_movehl_ps(a,a)); a=_mm_min_ss(a,_mm_shuffle_ps(a,a,1));
+    __m128 b=_mm_max_ps(_mm256_castps256_ps128(vmx), _mm256_extractf128_ps(vmx,1)); b=_mm_max_ps(b,_mm_movehl_ps(b,b)); b=_mm_max_ss(b,_mm_shuffle_ps(b,b,1));
+    mn=_mm_cvtss_f32(a); mx=_mm_cvtss_f32(b);
+    power_db_scalar(c+2*k, nb-k, scale, db+k, mn, mx);
+}
+#endif
+#if defined(__ARM_NEON)
+static void window_neon(const float* x, const float* w, float* out, int n){
+    int i=0;
+    for(; i+4<=n; i+=4) vst1q_f32(out+i, vmulq_f32(vld1q_f32(x+i), vld1q_f32(w+i)));
+    window_scalar(x+i, w+i, out+i, n-i);
+}
+static void power_db_neon(const float* c, int nb, float scale, float* db, float& mn, float& mx){
+    const float32x4_t vs=vdupq_n_f32(scale), eps=vdupq_n_f32(1e-24f), one=vdupq_n_f32(1.0f), lo=vdupq_n_f32(-120.0f), hi=vdupq_n_f32(0.0f);
+    float32x4_t vmn=vdupq_n_f32(mn), vmx=vdupq_n_f32(mx);
+    int k=0;
+    for(; k+4<=nb; k+=4){
+        float32x4x2_t v=vld2q_f32(c+2*k);                                            // re[4], im[4]
+        float32x4_t p=vmlaq_f32(vmulq_f32(v.val[0],v.val[0]), v.val[1], v.val[1]);
+        uint32x4_t u=vreinterpretq_u32_f32(vmlaq_f32(eps, p, vs));
+        float32x4_t m=vreinterpretq_f32_u32(vorrq_u32(vandq_u32(u, vdupq_n_u32(0x7fffff)), vdupq_n_u32(0x3f800000)));
+        uint32x4_t big=vcgtq_f32(m, vdupq_n_f32(1.41421356f));
+        m=vbslq_f32(big, vmulq_n_f32(m, 0.5f), m);
+        float32x4_t e=vaddq_f32(vcvtq_f32_s32(vsubq_s32(vreinterpretq_s32_u32(vshrq_n_u32(u, 23)), vdupq_n_s32(127))),
+                                vreinterpretq_f32_u32(vandq_u32(big, vreinterpretq_u32_f32(one))));
+        float32x4_t den=vaddq_f32(m, one), r=vrecpeq_f32(den);                       // 1/den, two Newton steps
+        r=vmulq_f32(vrecpsq_f32(den, r), r); r=vmulq_f32(vrecpsq_f32(den, r), r);
+        float32x4_t t=vmulq_f32(vsubq_f32(m, one), r), t2=vmulq_f32(t, t);
+        float32x4_t poly=vmlaq_f32(vdupq_n_f32(LOG2_C1), t2, vmlaq_f32(vdupq_n_f32(LOG2_C3), t2, vmlaq_f32(vdupq_n_f32(LOG2_C5), t2, vdupq_n_f32(LOG2_C7))));
+        float32x4_t d=vmulq_n_f32(vmlaq_f32(e, t, poly), DB_PER_LOG2);
+        d=vminq_f32(vmaxq_f32(d, lo), hi);
+        vst1q_f32(db+k, d); vmn=vminq_f32(vmn, d); vmx=vmaxq_f32(vmx, d);
+    }
+    float32x2_t a=vpmin_f32(vget_low_f32(vmn), vget_high_f32(vmn)); a=vpmin_f32(a,a);
+    float32x2_t b=vpmax_f32(vget_low_f32(vmx), vget_high_f32(vmx)); b=vpmax_f32(b,b);
+    mn=vget_lane_f32(a,0); mx=vget_lane_f32(b,0);
+    power_db_scalar(c+2*k, nb-k, scale, db+k, mn, mx);
+}
+#endif
+
+SpectralKernels select_spectral_kernels(bool simd){
+    SpectralKernels k; k.window=window_scalar; k.power_db=power_db_scalar;
+#if defined(__x86_64__) || defined(__i386__)
+    if(simd && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")){ k.window=window_avx2; k.power_db=power_db_avx2; k.name="avx2"; }
+#endif
+#if defined(__ARM_NEON)
+    if(simd){ k.window=window_neon; k.power_db=power_db_neon; k.name="neon"; }
+#endif
+    (void)simd; return k;
+}
+
+// ----------------- Block peak / energy kernels -----------------
+static void peak_sumsq_scalar(const float* x, size_t n, float& peak, double& sum2){
+    float pk = peak; double s = sum2;
+    for(size_t i=0;i<n;++i){ pk = std::max(pk, std::fabs(x[i])); s += (double)x[i]*x[i]; }
+    peak = pk; sum2 = s;
+}
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("avx2,fma")))
+static void peak_sumsq_avx2(const float* x, size_t n, float& peak, double& sum2){
+    const __m256 absmask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+    __m256 vpk = _mm256_setzero_ps();
+    __m256d s0 = _mm256_setzero_pd(), s1 = _mm256_setzero_pd();
+    size_t i=0;
+    for(; i+8<=n; i+=8){
+        __m256 v = _mm256_loadu_ps(x+i);
+        vpk = _mm256_max_ps(vpk, _mm256_and_ps(v, absmask));
+        __m256d lo = _mm256_cvtps_pd(_mm256_castps256_ps128(v)), hi = _mm256_cvtps_pd(_mm256_extractf128_ps(v,1));
+        s0 = _mm256_fmadd_pd(lo, lo, s0); s1 = _mm256_fmadd_pd(hi, hi, s1);
+    }
+    __m128 p = _mm_max_ps(_mm256_castps256_ps128(vpk), _mm256_extractf128_ps(vpk,1));
+    p = _mm_max_ps(p, _mm_movehl_ps(p,p)); p = _mm_max_ss(p, _mm_shuffle_ps(p,p,1));
+    __m256d s = _mm256_add_pd(s0, s1);
+    __m128d d = _mm_add_pd(_mm256_castpd256_pd128(s), _mm256_extractf128_pd(s,1));
+    d = _mm_add_sd(d, _mm_unpackhi_pd(d,d));
+    peak = std::max(peak, _mm_cvtss_f32(p)); sum2 += _mm_cvtsd_f64(d);
+    peak_sumsq_scalar(x+i, n-i, peak, sum2);
+}
+#endif
+#if defined(__aarch64__)
+static void peak_sumsq_neon(const float* x, size_t n, float& peak, double& sum2){
+    float32x4_t vpk = vdupq_n_f32(0);
+    float64x2_t s0 = vdupq_n_f64(0), s1 = vdupq_n_f64(0);
+    size_t i=0;
+    for(; i+4<=n; i+=4){
+        float32x4_t v = vld1q_f32(x+i);
+        vpk = vmaxq_f32(vpk, vabsq_f32(v));
+        float64x2_t lo = vcvt_f64_f32(vget_low_f32(v)), hi = vcvt_high_f64_f32(v);
+        s0 = vfmaq_f64(s0, lo, lo); s1 = vfmaq_f64(s1, hi, hi);
+    }
+    peak = std::max(peak, vmaxvq_f32(vpk)); sum2 += vaddvq_f64(vaddq_f64(s0, s1));
+    peak_sumsq_scalar(x+i, n-i, peak, sum2);
+}
+#endif
+
+PeakSumFn select_peak_sumsq(bool simd){
+#if defined(__x86_64__) || defined(__i386__)
+    if(simd && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) return peak_sumsq_avx2;
+#endif
+#if defined(__aarch64__)
+    if(simd) return peak_sumsq_neon;
+#endif
+    (void)simd; return peak_sumsq_scalar;
+}
+
+static void peak_step_scalar(const float* x, size_t n, float& peak, float& step){
+    float pk = peak, st = step;
+    for(size_t i=0;i<n;++i){ pk = std::max(pk, std::fabs(x[i])); if(i) st = std::max(st, std::fabs(x[i]-x[i-1])); }
+    peak = pk; step = st;
+}
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("avx2,fma")))
+static inline float hmax_avx2(__m256 a){
+    __m128 p = _mm_max_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a,1));
+    p = _mm_max_ps(p, _mm_movehl_ps(p,p)); return _mm_cvtss_f32(_mm_max_ss(p, _mm_shuffle_ps(p,p,1)));
+}
+__attribute__((target("avx2,fma")))
+static void peak_step_avx2(const float* x, size_t n, float& peak, float& step){
+    if(n < 9){ peak_step_scalar(x, n, peak, step); return; }
+    const __m256 absmask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+    __m256 vpk = _mm256_setzero_ps(), vst = _mm256_setzero_ps();
+    size_t i=1;
+    for(; i+8<=n; i+=8){
+        __m256 v = _mm256_loadu_ps(x+i), u = _mm256_loadu_ps(x+i-1);
+        vpk = _mm256_max_ps(vpk, _mm256_and_ps(v, absmask));
+        vst = _mm256_max_ps(vst, _mm256_and_ps(_mm256_sub_ps(v, u), absmask));
+    }
+    peak = std::max({peak, hmax_avx2(vpk), std::fabs(x[0])}); step = std::max(step, hmax_avx2(vst));
+    peak_step_scalar(x+i-1, n-i+1, peak, step);
+}
+#endif
+#if defined(__aarch64__)
+static void peak_step_neon(const float* x, size_t n, float& peak, float& step){
+    if(n < 5){ peak_step_scalar(x, n, peak, step); return; }
+    float32x4_t vpk = vdupq_n_f32(0), vst = vdupq_n_f32(0);
+    size_t i=1;
+    for(; i+4<=n; i+=4){
+        float32x4_t v = vld1q_f32(x+i), u = vld1q_f32(x+i-1);
+        vpk = vmaxq_f32(vpk, vabsq_f32(v)); vst = vmaxq_f32(vst, vabdq_f32(v, u));
+    }
+    peak = std::max({peak, vmaxvq_f32(vpk), std::fabs(x[0])}); step = std::max(step, vmaxvq_f32(vst));
+    peak_step_scalar(x+i-1, n-i+1, peak, step);
+}
+#endif
+
+PeakStepFn select_peak_step(bool simd){
+#if defined(__x86_64__) || defined(__i386__)
+    if(simd && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) return peak_step_avx2;
+#endif
+#if defined(__aarch64__)
+    if(simd) return peak_step_neon;
+#endif
+    (void)simd; return peak_step_scalar;
+}
+
+// ITU-R BS.1770-4 Annex 2 polyphase coefficients; phase 3 is phase 0 reversed.
+const float kInterp4[4][12] = {
+    { 0.0017089843750f,  0.0109863281250f, -0.0196533203125f,  0.0332031250000f, -0.0594482421875f,  0.1373291015625f,
+      0.9721679687500f, -0.1022949218750f,  0.0476074218750f, -0.0266113281250f,  0.0148925781250f, -0.0083007812500f },
+    {-0.0291748046875f,  0.0292968750000f, -0.0517578125000f,  0.0891113281250f, -0.1665039062500f,  0.4650878906250f,
+      0.7797851562500f, -0.2003173828125f,  0.1015625000000f, -0.0582275390625f,  0.0330810546875f, -0.0189208984375f },
+    {-0.0189208984375f,  0.0330810546875f, -0.0582275390625f,  0.1015625000000f, -0.2003173828125f,  0.7797851562500f,
+      0.4650878906250f, -0.1665039062500f,  0.0891113281250f, -0.0517578125000f,  0.0292968750000f, -0.0291748046875f },
+    {-0.0083007812500f,  0.0148925781250f, -0.0266113281250f,  0.0476074218750f, -0.1022949218750f,  0.9721679687500f,
+      0.1373291015625f, -0.0594482421875f,  0.0332031250000f, -0.0196533203125f,  0.0109863281250f,  0.0017089843750f },
+};
+
+static float interp4_peak_scalar(const float* x, size_t n){
+    float pk = 0;
+    for(size_t i=0;i<n;++i) for(const auto& h : kInterp4){
+        float y = 0; for(int k=0;k<12;++k) y += h[k]*x[(ptrdiff_t)i-11+k];
+        pk = std::max(pk, std::fabs(y));
+    }
+    return pk;
+}
+#if defined(__x86_64__) || defined(__i386__)
+// Eight outputs per phase at a time: the 12 shifted input vectors are loaded
+// once and shared by the four phases.
+__attribute__((target("avx2,fma")))
+static float interp4_peak_avx2(const float* x, size_t n){
+    const __m256 absmask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+    __m256 vpk = _mm256_setzero_ps();
+    size_t i=0;
+    for(; i+8<=n; i+=8){
+        __m256 v[12];
+        for(int k=0;k<12;++k) v[k] = _mm256_loadu_ps(x+i-11+k);
+        for(const auto& h : kInterp4){
+            __m256 y = _mm256_mul_ps(_mm256_set1_ps(h[0]), v[0]);
+            for(int k=1;k<12;++k) y = _mm256_fmadd_ps(_mm256_set1_ps(h[k]), v[k], y);
+            vpk = _mm256_max_ps(vpk, _mm256_and_ps(y, absmask));
+        }
+    }
+    return std::max(hmax_avx2(vpk), interp4_peak_scalar(x+i, n-i));
+}
+#endif
+#if defined(__aarch64__)
+static float interp4_peak_neon(const float* x, size_t n){
+    float32x4_t vpk = vdupq_n_f32(0);
+    size_t i=0;
+    for(; i+4<=n; i+=4){
+        float32x4_t v[12];
+        for(int k=0;k<12;++k) v[k] = vld1q_f32(x+i-11+k);
+        for(const auto& h : kInterp4){
+            float32x4_t y = vmulq_n_f32(v[0], h[0]);
+            for(int k=1;k<12;++k) y = vfmaq_n_f32(y, v[k], h[k]);
+            vpk = vmaxq_f32(vpk, vabsq_f32(y));
+        }
+    }
+    return std::max(vmaxvq_f32(vpk), interp4_peak_scalar(x+i, n-i));
+}
+#endif
+
+Interp4PeakFn select_interp4_peak(bool simd){
+#if defined(__x86_64__) || defined(__i386__)
+    if(simd && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) return interp4_peak_avx2;
+#endif
+#if defined(__aarch64__)
+    if(simd) return interp4_peak_neon;
+#endif
+    (void)simd; return interp4_peak_scalar;
+}
+
+// ----------------- Fingerprint scan -----------------
+FingerprintRecord fingerprint_record(const Fingerprint& fp, double duration_s){
+    FingerprintRecord r{};
+    std::copy(fp.bits, fp.bits+Fingerprint::kWords, r.bits); std::copy(fp.mask, fp.mask+Fingerprint::kWords, r.mask);
+    std::copy(fp.profile, fp.profile+Fingerprint::kBands, r.profile);
+    double s = 0; for(int8_t v : fp.profile) s += (double)v*v;
+    r.norm = (float)std::sqrt(s); r.duration_s = (float)duration_s;
+    return r;
+}
+
+static void fingerprint_scan_scalar(const FingerprintRecord* r, size_t n, const FingerprintRecord& q, uint16_t* diff, uint16_t* common, int32_t* dot){
+    for(size_t i=0;i<n;++i){
+        int d = 0, c = 0, p = 0;
+        for(int w=0;w<Fingerprint::kWords;++w){ uint64_t m = r[i].mask[w] & q.mask[w]; c += __builtin_popcountll(m); d += __builtin_popcountll((r[i].bits[w] ^ q.bits[w]) & m); }
+        for(int b=0;b<Fingerprint::kBands;++b) p += (int)r[i].profile[b]*q.profile[b];
+        diff[i] = (uint16_t)d; common[i] = (uint16_t)c; dot[i] = p;
+    }
+}
+#if defined(__x86_64__) || defined(__i386__)
+// Popcount by nibble lookup (vpshufb) and byte sums (vpsadbw); the int8
+// profiles are widened to int16 and multiplied pairwise (vpmaddwd).
+__attribute__((target("avx2,fma")))
+static inline int popcount_avx2(__m256i v){
+    const __m256i lut = _mm256_setr_epi8(0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4, 0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4), low = _mm256_set1_epi8(0x0f);
+    __m256i c = _mm256_add_epi8(_mm256_shuffle_epi8(lut, _mm256_and_si256(v, low)), _mm256_shuffle_epi8(lut, _mm256_and_si256(_mm256_srli_epi16(v, 4), low)));
+    __m256i s = _mm256_sad_epu8(c, _mm256_setzero_si256());
+    return (int)(_mm256_extract_epi64(s,0) + _mm256_extract_epi64(s,1) + _mm256_extract_epi64(s,2) + _mm256_extract_epi64(s,3));
+}
+__attribute__((target("avx2,fma")))
+static void fingerprint_scan_avx2(const FingerprintRecord* r, size_t n, const FingerprintRecord& q, uint16_t* diff, uint16_t* common, int32_t* dot){
+    const __m256i qb = _mm256_loadu_si256((const __m256i*)q.bits), qm = _mm256_loadu_si256((const __m256i*)q.mask);
+    const __m256i qp0 = _mm256_loadu_si256((const __m256i*)q.profile), qp1 = _mm256_loadu_si256((const __m256i*)(q.profile+32));
+    const __m256i q0 = _mm256_cvtepi8_epi16(_mm256_castsi256_si128(qp0)), q1 = _mm256_cvtepi8_epi16(_mm256_extracti128_si256(qp0,1));
+    const __m256i q2 = _mm256_cvtepi8_epi16(_mm256_castsi256_si128(qp1)), q3 = _mm256_cvtepi8_epi16(_mm256_extracti128_si256(qp1,1));
+    for(size_t i=0;i<n;++i){
+        __m256i m = _mm256_and_si256(_mm256_loadu_si256((const __m256i*)r[i].mask), qm);
+        __m256i x = _mm256_and_si256(_mm256_xor_si256(_mm256_loadu_si256((const __m256i*)r[i].bits), qb), m);
+        diff[i] = (uint16_t)popcount_avx2(x); common[i] = (uint16_t)popcount_avx2(m);
+        __m256i p0 = _mm256_loadu_si256((const __m256i*)r[i].profile), p1 = _mm256_loadu_si256((const __m256i*)(r[i].profile+32));
+        __m256i s = _mm256_add_epi32(_mm256_madd_epi16(_mm256_cvtepi8_epi16(_mm256_castsi256_si128(p0)), q0), _mm256_madd_epi16(_mm256_cvtepi8_epi16(_mm256_extracti128_si256(p0,1)), q1));
+        s = _mm256_add_epi32(s, _mm256_add_epi32(_mm256_madd_epi16(_mm256_cvtepi8_epi16(_mm256_castsi256_si128(p1)), q2), _mm256_madd_epi16(_mm256_cvtepi8_epi16(_mm256_extracti128_si256(p1,1)), q3)));
+        __m128i h = _mm_add_epi32(_mm256_castsi256_si128(s), _mm256_extracti128_si256(s,1));
+        h = _mm_add_epi32(h, _mm_shuffle_epi32(h, 0x4e)); h = _mm_add_epi32(h, _mm_shuffle_epi32(h, 0xb1));
+        dot[i] = _mm_cvtsi128_si32(h);
+    }
+}
+#endif
+#if defined(__aarch64__)
+static void fingerprint_scan_neon(const FingerprintRecord* r, size_t n, const FingerprintRecord& q, uint16_t* diff, uint16_t* common, int32_t* dot){
+    const uint8x16_t qb0 = vld1q_u8((const uint8_t*)q.bits), qb1 = vld1q_u8((const uint8_t*)q.bits+16);
+    const uint8x16_t qm0 = vld1q_u8((const uint8_t*)q.mask), qm1 = vld1q_u8((const uint8_t*)q.mask+16);
+    for(size_t i=0;i<n;++i){
+        uint8x16_t m0 = vandq_u8(vld1q_u8((const uint8_t*)r[i].mask), qm0), m1 = vandq_u8(vld1q_u8((const uint8_t*)r[i].mask+16), qm1);
+        uint8x16_t x0 = vandq_u8(veorq_u8(vld1q_u8((const uint8_t*)r[i].bits), qb0), m0), x1 = vandq_u8(veorq_u8(vld1q_u8((const uint8_t*)r[i].bits+16), qb1), m1);
+        diff[i] = (uint16_t)(vaddlvq_u8(vcntq_u8(x0)) + vaddlvq_u8(vcntq_u8(x1)));
+        common[i] = (uint16_t)(vaddlvq_u8(vcntq_u8(m0)) + vaddlvq_u8(vcntq_u8(m1)));
+        int32x4_t s = vdupq_n_s32(0);
+        for(int b=0;b<Fingerprint::kBands;b+=16){
+            int8x16_t p = vld1q_s8(r[i].profile+b), qq = vld1q_s8(q.profile+b);
+            s = vpadalq_s16(s, vmull_s8(vget_low_s8(p), vget_low_s8(qq))); s = vpadalq_s16(s, vmull_high_s8(p, qq));
+        }
+        dot[i] = vaddvq_s32(s);
+    }
+}
+#endif
+
+FingerprintScanFn select_fingerprint_scan(bool simd){
+#if defined(__x86_64__) || defined(__i386__)
+    if(simd && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) return fingerprint_scan_avx2;
+#endif
+#if defined(__aarch64__)
+    if(simd) return fingerprint_scan_neon;
+#endif
+    (void)simd; return fingerprint_scan_scalar;
+}
+
+// In-memory convenience wrapper over SpectralAccumulator.
+SpectralOutputs compute_spectrum_and_spectrogram(ChannelView x, int sr, int Nfft, int hop, const std::string&, bool want_spectrogram, ThreadPool* pool){
+    SpectralAccumulator acc(sr, Nfft, hop, want_spectrogram, pool);
+    acc.push(x.data, x.size());
+    return acc.finish();
+}
+
+// ----------------- Metrics & classification -----------------
+static double band_avg(const SpectralOutputs& so, double f0, double f1){ size_t i0 = std::lower_bound(so.freq.begin(), so.freq.end(), f0) - so.freq.begin(); size_t i1 = std::lower_bound(so.freq.begin(), so.freq.end(), f1) - so.freq.begin(); i1 = std::min(i1, so.freq.size()); if(i0>=i1) return -120.0; double s=0; size_t n=0; for(size_t i=i0;i<i1;++i){ s+=so.avg_mag_db[i]; ++n; } return (n? s/n : -120.0); }
+
+Metrics dsdinspect::analyze_metrics(const SpectralOutputs& so, double band_scale){ Metrics m; double min_db=0, min_f=0; for(size_t i=1;i<so.freq.size();++i){ double f=so.freq[i]; if(f<15000) continue; size_t j = i + (size_t)(1000.0 * so.freq.size()/so.freq.back()); if(j>=so.freq.size()) break; double drop = so.avg_mag_db[j]-so.avg_mag_db[i]; if(drop<min_db){ min_db=drop; min_f=f; } } m.max_drop_db=min_db; m.max_drop_hz=min_f; if(min_db<-18.0){ m.cutoff_hz=min_f; m.cutoff_drop_db=min_db; } m.noise_band_scale=band_scale; m.noise_floor_30_50=band_avg(so,30e3*band_scale,50e3*band_scale); m.noise_floor_50_80=band_avg(so,50e3*band_scale,80e3*band_scale); m.noise_rise_db=m.noise_floor_50_80-m.noise_floor_30_50; return m; }
+
+void compute_dynamic_metrics(ChannelView x, int sr, Metrics& m){ DynamicAccumulator acc(sr); acc.push(x.data, x.size()); acc.finish(m); }
+
+double classify_margin(const Metrics& m, const Metrics& spread){
+    double r = 1e9;
+    auto clear = [&](double x, double sx, double t, double tol){ r = std::min(r, (std::fabs(x-t) - sx) / tol); };
+    // A drop just short of -18 dB becomes a cutoff as it deepens, so it counts whether or not it passed.
+    clear(m.max_drop_db, spread.max_drop_db, -18.0, 3.0);
+    if (m.cutoff_hz>0 || std::fabs(m.max_drop_db+18.0) - spread.max_drop_db < 2*3.0)
+        for (double t : {21000.0, 23500.0, 26500.0}) clear(m.max_drop_hz, spread.max_drop_hz, t, 500.0);
+    if (!(m.cutoff_hz>21000 && m.cutoff_hz<26500)){
+        clear(m.noise_rise_db, spread.noise_rise_db, 6.0, 1.0);
+        if (m.noise_rise_db<=6.0){
+            clear(m.noise_floor_30_50, spread.noise_floor_30_50, -60.0, 2.0);
+            clear(m.noise_rise_db, spread.noise_rise_db, -3.0, 1.0);
+            clear(m.noise_rise_db, spread.noise_rise_db, 3.0, 1.0);
+        }
+    }
+    clear(m.dr_like_db, spread.dr_like_db, 7.5, 0.5);
+    clear(m.crest_median_db, spread.crest_median_db, 7.0, 0.5);
+    return r;
+}
+
+std::string dsdinspect::classify(const Metrics& m){ 
+	std::string cls;
+	
+	if (m.cutoff_hz>21000 && m.cutoff_hz<23500) cls = "Likely 44.1 kHz PCM source (brickwall ~22 kHz)";
+	else if (m.cutoff_hz>=23500 && m.cutoff_hz<26500) cls = "Likely 48 kHz PCM source (brickwall ~24 kHz)";
+	else {
+		if (m.noise_rise_db>6.0) cls = "Likely native DSD (rising ultrasonic noise " + std::to_string((int)std::lround(30*m.noise_band_scale)) + "-" + std::to_string((int)std::lround(80*m.noise_band_scale)) + " kHz)";
+		else if (m.noise_floor_30_50>-60 && m.noise_rise_db>=-3 && m.noise_rise_db<=3)
+			cls = "Likely Hi-Res PCM -> DSD (extended HF but flat ultrasonic noise)";
+		else cls = "Inconclusive - could be carefully filtered hi-res or processed";
+	}
+	if (m.dr_like_db<=7.5 || m.crest_median_db<=7.0)
+		cls += "; Note: probable heavy dynamic compression (loudness-war).";
+
+	
+	return cls; 
+}
@@ -0,0 +1,1304 @@
+// Internals of libdsdinspect shared by the library, dsd_inspector and
+// dsd_bench: profiling, the decode paths, the STFT and the metrics. Unlike
+// dsdinspect.h this header is not a stable API; it pulls in FFTW and POSIX
+// headers but never FFmpeg.
+#pragma once
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <map>
+#include <deque>
+#include <memory>
+#include <chrono>
+#include <ostream>
+#include <fstream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <fftw3.h>
+
+#include "dsdinspect.h"
+
+using dsdinspect::StreamInfo;
+using dsdinspect::SpectralOutputs;
+using dsdinspect::Metrics;
+using dsdinspect::DynamicsSummary;
+using dsdinspect::ClipRun;
+using dsdinspect::ClipStats;
+using dsdinspect::Fingerprint;
+using dsdinspect::analyze_metrics;
+using dsdinspect::classify;
+
+// ----------------- Profiling (--profile) -----------------
+// StageTimer records wall and CPU time per named stage with exclusive
+// accounting: time spent in a nested timer (png inside render, the analysis
+// sink inside decode) is charged to the inner stage only. Timers are no-ops
+// unless the calling thread has a Profile bound by ProfileScope. CPU time is
+// the process clock when the profile owns the process (single-file mode, so
+// STFT workers are included) and the thread clock otherwise (tree mode).
+// Allocation counts come from dsd_inspector's replaced global operator new,
+// per thread, so they cover C++ containers but not FFmpeg/FFTW/zlib mallocs
+// (and stay zero in programs that do not replace it).
+extern thread_local uint64_t t_allocs, t_alloc_bytes;
+
+struct StageStats { double wall=0, cpu=0; uint64_t calls=0, allocs=0, alloc_bytes=0; };
+
+struct Profile {
+    bool process_cpu = false;
+    std::map<std::string, StageStats> stages;   // exclusive times
+    double wall=0, cpu=0, audio_s=0;
+    uint64_t bytes_read=0, samples_in=0, samples_out=0, fft_frames=0, allocs=0, alloc_bytes=0, files=0;
+    long peak_rss_kb=0;
+    void merge(const Profile& o){
+        for(const auto& kv : o.stages){ StageStats& s=stages[kv.first]; s.wall+=kv.second.wall; s.cpu+=kv.second.cpu; s.calls+=kv.second.calls; s.allocs+=kv.second.allocs; s.alloc_bytes+=kv.second.alloc_bytes; }
+        wall+=o.wall; cpu+=o.cpu; audio_s+=o.audio_s; bytes_read+=o.bytes_read; samples_in+=o.samples_in; samples_out+=o.samples_out;
+        fft_frames+=o.fft_frames; allocs+=o.allocs; alloc_bytes+=o.alloc_bytes; files+=o.files; peak_rss_kb=std::max(peak_rss_kb, o.peak_rss_kb);
+    }
+};
+
+extern thread_local Profile* t_profile;
+
+double wall_now();
+double cpu_now(bool process);
+long peak_rss_kb();
+
+class StageTimer {
+public:
+    explicit StageTimer(const char* name) : prof_(t_profile) {
+        if(!prof_) return;
+        name_ = name; parent_ = t_stage; t_stage = this;
+        wall0_ = wall_now(); cpu0_ = cpu_now(prof_->process_cpu); a0_ = t_allocs; b0_ = t_alloc_bytes;
+    }
+    ~StageTimer(){
+        if(!prof_) return;
+        double w = wall_now()-wall0_, c = cpu_now(prof_->process_cpu)-cpu0_; uint64_t a = t_allocs-a0_, b = t_alloc_bytes-b0_;
+        StageStats& s = prof_->stages[name_];
+        s.wall += w-cw_; s.cpu += c-cc_; s.allocs += a-ca_; s.alloc_bytes += b-cb_; ++s.calls;
+        if(parent_){ parent_->cw_+=w; parent_->cc_+=c; parent_->ca_+=a; parent_->cb_+=b; }
+        t_stage = parent_;
+    }
+    StageTimer(const StageTimer&) = delete;
+    StageTimer& operator=(const StageTimer&) = delete;
+private:
+    static thread_local StageTimer* t_stage;
+    Profile* prof_; const char* name_ = nullptr; StageTimer* parent_ = nullptr;
+    double wall0_=0, cpu0_=0, cw_=0, cc_=0; uint64_t a0_=0, b0_=0, ca_=0, cb_=0;
+};
+
+// Binds prof to the current thread and records its totals on destruction.
+class ProfileScope {
+public:
+    explicit ProfileScope(Profile* p) : prof_(p), prev_(t_profile) {
+        if(!prof_) return;
+        t_profile = prof_; wall0_ = wall_now(); cpu0_ = cpu_now(prof_->process_cpu); a0_ = t_allocs; b0_ = t_alloc_bytes;
+    }
+    ~ProfileScope(){
+        if(!prof_) return;
+        prof_->wall += wall_now()-wall0_; prof_->cpu += cpu_now(prof_->process_cpu)-cpu0_;
+        prof_->allocs += t_allocs-a0_; prof_->alloc_bytes += t_alloc_bytes-b0_; prof_->peak_rss_kb = peak_rss_kb(); ++prof_->files;
+        t_profile = prev_;
+    }
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+private:
+    Profile* prof_; Profile* prev_; double wall0_=0, cpu0_=0; uint64_t a0_=0, b0_=0;
+};
+
+std::string json_escape(const std::string& s);
+void print_profile(std::ostream& o, const Profile& p);
+void write_profile_json(std::ostream& o, const Profile& p, const std::string& indent="");
+
+// ----------------- Options -----------------
+// Everything dsd_inspector accepts on the command line; the analysis part is
+// what dsdinspect::AnalyzerOptions exposes.
+struct Options {
+    std::string input;
+    std::string outdir = "./out";
+    int target_sr = 176400;   // resample to 176.4 kHz
+    int fft_size  = 4096;
+    int hop_size  = 2048;
+    bool adaptive_sr = false; // --sr auto: the three above are for DSD64 and scale with the DSD rate
+    int seconds   = 180;      // analyze first N seconds (0 = whole file)
+    int sample_windows = 0;   // --sample K:D: K windows of D seconds spread over the file
+    double sample_seconds = 0;
+    int threads   = 0;        // STFT and PNG worker threads (0 = all cores)
+    int png_level = 1;        // zlib level for the PNGs (1 fastest .. 9 smallest)
+    bool native_reader = true; // parse DSF/DFF ourselves (FFmpeg demuxer otherwise)
+    bool native_decimator = true; // DSD->PCM with DsdDecimator (libavcodec dsd + swr otherwise)
+    bool simd = true;         // AVX2/NEON kernels when the CPU has them
+    bool fft_double = false;  // double-precision STFT (reference for --check-fft)
+    int spec_width = 0;       // spectrogram columns (0 = one per FFT frame)
+    bool spec_mean = false;   // merge frames by mean power instead of max-hold
+    bool spec_logf = false;   // log-frequency spectrogram rows
+    bool profile = false;     // per-stage timing table on stderr + profile.json
+    bool pretty = true;       // also render spectrogram_pretty.png / spectrum_overlay.png
+    bool album = false;       // --album: input is a folder; analyze every track and merge
+    double settle_s = 0;      // --early-exit S: stop decoding once the verdict has been settled for S seconds (0 = off)
+    double check_s = 5;       // --early-exit-check S: how often the running spectrum is re-classified
+    bool pipeline = true;     // decode on its own thread, ahead of the analysis (--no-pipeline: inline)
+};
+
+// ----------------- Decode helpers -----------------
+// Decoding is streamed: each converted chunk is handed to a sink as planar
+// L/R plus the mono downmix, then the scratch buffers are reused, so memory
+// does not grow with track length or --sec.
+// mono = (L+R)/sqrt(2) is what swresample's default stereo->mono rematrix
+// produces for float output, so the mono analysis is unchanged.
+struct AudioBlock {
+    const float* left = nullptr;
+    const float* right = nullptr;
+    const float* mono = nullptr;
+    size_t n = 0;
+    double t = 0;                // source time of the first sample (s)
+    bool discontinuity = false;  // first block after a seek (--sample)
+    mutable bool stop = false;   // set by the sink to end decoding after this block
+};
+
+// Non-owning view of one channel plane (no copies for per-channel analysis).
+struct ChannelView {
+    const float* data = nullptr;
+    size_t n = 0;
+    ChannelView(){}
+    ChannelView(const float* d, size_t len):data(d),n(len){}
+    ChannelView(const std::vector<float>& v):data(v.data()),n(v.size()){}
+    size_t size() const { return n; }
+    float operator[](size_t i) const { return data[i]; }
+};
+
+// ----------------- Native DSF / DSDIFF reader -----------------
+// Read-only mapping of a whole file; pages already analyzed are dropped so RSS
+// stays flat on long files.
+class MappedFile {
+public:
+    MappedFile(){}
+    ~MappedFile(){ if(base_) munmap((void*)base_, size_); if(fd_>=0) ::close(fd_); }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const std::string& path){
+        fd_ = ::open(path.c_str(), O_RDONLY);
+        if(fd_<0) return false;
+        struct stat st; if(fstat(fd_, &st)!=0 || st.st_size<=0) return false;
+        size_ = (size_t)st.st_size;
+        void* p = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+        if(p==MAP_FAILED) return false;
+        base_ = (const uint8_t*)p;
+        posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+        madvise(p, size_, MADV_SEQUENTIAL);
+        return true;
+    }
+    const uint8_t* data() const { return base_; }
+    size_t size() const { return size_; }
+    // Ask for [off, off+len) ahead of use (sampled reads jump around the file).
+    void prefetch(size_t off, size_t len){
+        size_t pg = (size_t)sysconf(_SC_PAGESIZE);
+        if(off >= size_) return;
+        size_t b = off / pg * pg; len = std::min(len + (off-b), size_-b);
+        madvise((void*)(base_+b), len, MADV_WILLNEED);
+    }
+    // Drop [0,upto) from the page cache mapping once it has been consumed.
+    void release_until(size_t upto){
+        size_t pg = (size_t)sysconf(_SC_PAGESIZE);
+        size_t end = std::min(upto, size_) / pg * pg;
+        if(end > released_){ madvise((void*)(base_+released_), end-released_, MADV_DONTNEED); released_ = end; }
+    }
+
+private:
+    int fd_ = -1;
+    const uint8_t* base_ = nullptr;
+    size_t size_ = 0, released_ = 0;
+};
+
+// Raw DSD payload of a DSF or uncompressed DSDIFF file, described straight
+// from the header. DSF stores per-channel blocks of block_size bytes
+// (planar within a block group); DFF interleaves one byte per channel.
+struct DsdFile {
+    MappedFile map;
+    bool dsf = false;            // false: DSDIFF
+    bool lsb_first = true;       // bit order within each byte
+    int channels = 0;
+    int dsd_rate = 0;            // 1-bit samples per second per channel
+    uint64_t samples = 0;        // 1-bit samples per channel
+    size_t block_size = 0;       // DSF bytes per channel per block
+    size_t data_off = 0, data_bytes = 0;
+};
+
+inline uint32_t rd_le32(const uint8_t* p){ return (uint32_t)p[0] | (uint32_t)p[1]<<8 | (uint32_t)p[2]<<16 | (uint32_t)p[3]<<24; }
+inline uint64_t rd_le64(const uint8_t* p){ return (uint64_t)rd_le32(p) | (uint64_t)rd_le32(p+4)<<32; }
+
+// Little-endian fields on a binary stream (report caches, spectra.bin, test inputs).
+class BinWriter {
+public:
+    explicit BinWriter(std::ofstream& f):f_(f){}
+    void u16(uint16_t v){ uint8_t b[2]={(uint8_t)v,(uint8_t)(v>>8)}; f_.write((const char*)b,2); }
+    void u32(uint32_t v){ uint8_t b[4]; for(int i=0;i<4;++i) b[i]=(uint8_t)(v>>(8*i)); f_.write((const char*)b,4); }
+    void u64(uint64_t v){ uint8_t b[8]; for(int i=0;i<8;++i) b[i]=(uint8_t)(v>>(8*i)); f_.write((const char*)b,8); }
+    void f64(double v){ uint64_t u; std::memcpy(&u,&v,8); u64(u); }
+    void f32(float v){ uint32_t u; std::memcpy(&u,&v,4); u32(u); }
+    void str(const std::string& s){ u16((uint16_t)std::min<size_t>(s.size(),65535)); f_.write(s.data(), std::min<size_t>(s.size(),65535)); }
+private:
+    std::ofstream& f_;
+};
+
+class BinReader {
+public:
+    explicit BinReader(std::ifstream& f):f_(f){}
+    bool ok() const { return (bool)f_; }
+    uint16_t u16(){ uint8_t b[2]={0,0}; f_.read((char*)b,2); return (uint16_t)(b[0] | b[1]<<8); }
+    uint32_t u32(){ uint8_t b[4]={0}; f_.read((char*)b,4); return rd_le32(b); }
+    uint64_t u64(){ uint8_t b[8]={0}; f_.read((char*)b,8); return rd_le64(b); }
+    double f64(){ uint64_t u=u64(); double v; std::memcpy(&v,&u,8); return v; }
+    float f32(){ uint32_t u=u32(); float v; std::memcpy(&v,&u,4); return v; }
+    std::string str(){ uint16_t n=u16(); std::string s(n,'\0'); f_.read(&s[0], n); return s; }
+private:
+    std::ifstream& f_;
+};
+
+// false: not a DSF/DFF we handle (caller falls back to FFmpeg).
+bool open_dsd_file(const std::string& path, DsdFile& d);
+
+// ----------------- Native DSD decimator -----------------
+// DSD -> PCM without libavcodec/swresample: a byte-wise lookup-table FIR that
+// decimates the 1-bit stream to ~352.8/384 kHz, then polyphase half-band
+// stages down to the target rate. Filters are Kaiser-windowed sincs designed
+// at construction for the actual rates: the final band (0.45*target) is kept
+// flat and everything that would alias into it is attenuated by >=120 dB,
+// so the ultrasonic noise floors in analyze_metrics see the real modulator
+// noise rather than resampler roll-off.
+
+using DotFn = float (*)(const float*, const float*, size_t);
+
+// Picks the dot-product kernel; lengths passed to it are multiples of 8.
+DotFn select_dot(bool simd, std::string& name);
+
+// One polyphase half-band stage r -> r/2 (length 4K+3 so the centre tap sits
+// on the odd phase), flat over [0,fp] and >= atten_db down wherever it would
+// alias into that band.
+struct HalfbandStage {
+    std::vector<float> grev;        // even-phase taps, reversed, zero-padded in front
+    float hc = 0.5f;                // centre tap (odd phase)
+    size_t G = 0, K = 0;
+    std::vector<float> E, O;        // even/odd input phases incl. history
+    bool odd = false;               // parity of the next input sample
+    size_t next = 0;                // next output index into E/O
+
+    static HalfbandStage design(int r, double fp, double atten_db);
+
+    // History filled with v (a constant input then comes out unchanged).
+    void reset(float v = 0.0f){ E.assign(G-1, v); O.assign(K+1, v); odd = false; next = 0; }
+
+    // y[n] = sum_i g[i]*xe[n-i] + hc*xo[n-K-1]; with the history offsets above
+    // that is dot(grev, &E[n]) + hc*O[n].
+    void run(const std::vector<float>& x, std::vector<float>& y, DotFn dot){
+        for(float v : x){ (odd ? O : E).push_back(v); odd = !odd; }
+        while(next + G <= E.size() && next < O.size()){
+            y.push_back(dot(grev.data(), &E[next], G) + hc*O[next]);
+            ++next;
+        }
+        E.erase(E.begin(), E.begin()+next);
+        O.erase(O.begin(), O.begin()+next);
+        next = 0;
+    }
+};
+
+class DsdDecimator {
+public:
+    // Rates reachable as dsd_rate / (8 * 2^k). The first stage lands at or
+    // below 384 kHz, but never below twice target_sr: the 1-bit FIR is short
+    // when its transition band is wide, and a half-band stage takes the last
+    // octave (or directly on target_sr when that is dsd_rate/8).
+    static bool plan(int dsd_rate, int target_sr, int& stage1_rate, int& halvings){
+        if(dsd_rate<=0 || target_sr<=0 || dsd_rate%8) return false;
+        int r = dsd_rate/8;
+        while(r > 384000 && r%2==0 && r/2 >= 2*(int64_t)target_sr) r/=2;
+        stage1_rate = r; halvings = 0;
+        while(r > target_sr){ if(r%2) return false; r/=2; ++halvings; }
+        return r==target_sr;
+    }
+
+    DsdDecimator(int dsd_rate, int target_sr, bool lsb_first, int channels, bool simd);
+
+    const std::string& kernel() const { return kernel_; }
+
+    // Back to the idle state, e.g. after a seek: all filter history is cleared.
+    void reset(){
+        for(auto& c : chans_){
+            c.bytes.assign(T_-1, 0x69);                            // DSD idle pattern (zero mean)
+            c.hb = halfbands_;
+            for(auto& hb : c.hb) hb.reset();
+        }
+    }
+
+    // Appends the PCM produced by n bytes of channel ch (byte i at src[i*stride]).
+    void process(int ch, const uint8_t* src, size_t n, size_t stride, std::vector<float>& out){
+        Chan& c = chans_[ch];
+        size_t old = c.bytes.size(); c.bytes.resize(old+n);
+        for(size_t i=0;i<n;++i) c.bytes[old+i] = src[i*stride];
+        // stage 1: each output sums T_ table lookups and consumes m_ bytes
+        c.s1.clear();
+        size_t p=0;
+        for(; p+T_ <= c.bytes.size(); p+=m_){
+            const uint8_t* q = &c.bytes[p]; float acc=0;
+            for(size_t t=0;t<T_;++t) acc += lut_[t*256+q[t]];
+            c.s1.push_back(acc);
+        }
+        c.bytes.erase(c.bytes.begin(), c.bytes.begin()+std::min(p, c.bytes.size()));
+        if(c.hb.empty()){ out.insert(out.end(), c.s1.begin(), c.s1.end()); return; }
+        std::vector<float>* cur = &c.s1;
+        for(size_t s=0;s<c.hb.size();++s){
+            std::vector<float>& dst = (s+1==c.hb.size()) ? out : c.tmp[s&1];
+            if(&dst!=&out) dst.clear();
+            c.hb[s].run(*cur, dst, dot_);
+            cur = &dst;
+        }
+    }
+
+private:
+    struct Chan {
+        std::vector<uint8_t> bytes;     // stage-1 history + pending input
+        std::vector<float> s1, tmp[2];
+        std::vector<HalfbandStage> hb;
+    };
+
+    DotFn dot_ = nullptr; std::string kernel_;
+    size_t m_ = 1, T_ = 1;              // stage-1 bytes per output / bytes per filter
+    std::vector<float> lut_;            // T_ tables of 256 partial sums
+    std::vector<HalfbandStage> halfbands_;
+    std::vector<Chan> chans_;
+};
+
+// Stereo PCM down by a power of two with the half-band stages above, for the
+// audio-band metrics when the spectra are taken at a multiple of their rate.
+// After a reset the history is filled with each channel's first sample, so a
+// seek does not start with a step the interpolating peak meter would ring on.
+class PcmDecimator {
+public:
+    PcmDecimator(int in_rate, int factor, bool simd){
+        std::string name; dot_ = select_dot(simd, name);
+        const double fp = 0.45*in_rate/factor;
+        out_rate_ = in_rate/factor;
+        for(int r=in_rate; r>out_rate_; r/=2){
+            chans_[0].hb.push_back(HalfbandStage::design(r, fp, 120.0));
+            delay_s_ += (2.0*chans_[0].hb.back().K + 1) / r;     // centre tap of a 4K+3 tap half-band
+        }
+        chans_[1].hb = chans_[0].hb;
+    }
+
+    void reset(){ fresh_ = true; }
+
+    // Filters n more samples of l and r, the first at time t; left()/right()/mono()
+    // then hold the returned number of outputs, the first of them at time t().
+    size_t push(const float* l, const float* r, size_t n, double t = 0.0){
+        if(fresh_){ t0_ = t; emitted_ = 0; }
+        const float* in[2] = { l, r };
+        for(int ch=0; ch<2; ++ch){
+            Chan& c = chans_[ch];
+            if(fresh_ && n) for(auto& hb : c.hb) hb.reset(in[ch][0]);
+            c.in.assign(in[ch], in[ch]+n);
+            std::vector<float>* cur = &c.in;
+            for(size_t s=0;s<c.hb.size();++s){
+                std::vector<float>& dst = c.tmp[s&1];
+                dst.clear(); c.hb[s].run(*cur, dst, dot_);
+                cur = &dst;
+            }
+            c.out = cur;
+        }
+        if(n) fresh_ = false;
+        size_t m = std::min(chans_[0].out->size(), chans_[1].out->size());
+        mono_.resize(m);
+        for(size_t i=0;i<m;++i) mono_[i] = (float)(((*chans_[0].out)[i] + (*chans_[1].out)[i]) * M_SQRT1_2);
+        t_ = t0_ + (double)emitted_/out_rate_ - delay_s_;
+        emitted_ += m;
+        return m;
+    }
+    // Input time of the first output of the last push(): outputs since reset() less the group delay.
+    double t() const { return t_; }
+    const float* left() const { return chans_[0].out->data(); }
+    const float* right() const { return chans_[1].out->data(); }
+    const float* mono() const { return mono_.data(); }
+
+private:
+    struct Chan {
+        std::vector<HalfbandStage> hb;
+        std::vector<float> in, tmp[2];
+        const std::vector<float>* out = nullptr;
+    };
+    DotFn dot_ = nullptr;
+    Chan chans_[2];
+    std::vector<float> mono_;
+    bool fresh_ = true;
+    int out_rate_ = 0;
+    double delay_s_ = 0, t0_ = 0, t_ = 0;
+    uint64_t emitted_ = 0;
+};
+
+// ----------------- Decode paths -----------------
+// DSF/DFF go through the native reader; everything else (FLAC, WAV, DST
+// DFF, ...) through the FFmpeg demuxer. opt.input is the file; every
+// converted chunk goes to sink (see AudioBlock).
+StreamInfo decode_stream(const Options& opt, const std::function<void(const AudioBlock&)>& sink);
+// The same for a caller that already ran open_dsd_file() on opt.input: d is
+// the opened file, or nullptr when it is not one (FFmpeg decodes it).
+StreamInfo decode_stream(const Options& opt, DsdFile* d, const std::function<void(const AudioBlock&)>& sink);
+
+// decode_stream() on a thread of its own: the blocks are regrouped into
+// batches of PIPELINE_BATCH samples and handed through a bounded SpscQueue
+// (depth batches) to the calling thread, which runs `analyze` on each, so
+// decoding the next batch overlaps the analysis of this one. analyze
+// returning true stops the decoder, as AudioBlock::stop does. An exception
+// on either side ends both and is rethrown here. With a Profile bound, the
+// decoder's stages are merged into it (thread CPU time); time a side spends
+// waiting shows up as queue-full (decoder ahead) or queue-empty (analysis
+// starved).
+static const size_t PIPELINE_BATCH = 16384;
+StreamInfo decode_pipelined(const Options& opt, const std::function<bool(const AudioBlock&)>& analyze, size_t depth=4);
+StreamInfo decode_pipelined(const Options& opt, DsdFile* d, const std::function<bool(const AudioBlock&)>& analyze, size_t depth=4);
+
+// ----------------- Thread pool -----------------
+// Fixed set of workers for data-parallel loops. parallel_for() splits [0,count)
+// into size() contiguous ranges (the caller runs range 0) and returns when all
+// are done, so the work split depends only on count and size().
+class ThreadPool {
+public:
+    explicit ThreadPool(int n){
+        if(n<=0) n = (int)std::max(1u, std::thread::hardware_concurrency());
+        for(int t=1;t<n;++t) workers_.emplace_back([this,t]{ worker(t); });
+    }
+    ~ThreadPool(){
+        { std::lock_guard<std::mutex> lk(mu_); stop_=true; }
+        cv_.notify_all();
+        for(auto& th : workers_) th.join();
+    }
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    int size() const { return (int)workers_.size() + 1; }
+
+    void parallel_for(size_t count, const std::function<void(size_t,size_t,int)>& fn){
+        if(workers_.empty() || count<=1){ if(count) fn(0,count,0); return; }
+        {
+            std::lock_guard<std::mutex> lk(mu_);
+            job_=&fn; count_=count; pending_=(int)workers_.size(); ++gen_;
+        }
+        cv_.notify_all();
+        size_t b,e; range(0,b,e); if(b<e) fn(b,e,0);
+        std::unique_lock<std::mutex> lk(mu_);
+        done_cv_.wait(lk, [&]{ return pending_==0; });
+        job_=nullptr;
+    }
+
+private:
+    void range(int t, size_t& b, size_t& e) const { size_t n=(size_t)size(); b=count_*t/n; e=count_*(t+1)/n; }
+    void worker(int t){
+        uint64_t seen=0;
+        for(;;){
+            const std::function<void(size_t,size_t,int)>* job;
+            {
+                std::unique_lock<std::mutex> lk(mu_);
+                cv_.wait(lk, [&]{ return stop_ || gen_!=seen; });
+                if(stop_) return;
+                seen=gen_; job=job_;
+            }
+            size_t b,e; range(t,b,e); if(b<e) (*job)(b,e,t);
+            { std::lock_guard<std::mutex> lk(mu_); if(--pending_==0) done_cv_.notify_one(); }
+        }
+    }
+
+    std::vector<std::thread> workers_;
+    std::mutex mu_; std::condition_variable cv_, done_cv_;
+    const std::function<void(size_t,size_t,int)>* job_=nullptr;
+    size_t count_=0; uint64_t gen_=0; int pending_=0; bool stop_=false;
+};
+
+// ----------------- Bounded SPSC queue -----------------
+// Ring of capacity slots between exactly one producer and one consumer. The
+// producer fills back() in place and publishes it with push(); the consumer
+// reads front() and returns the slot with pop(), so slots and the buffers in
+// them are reused without allocating. The indices are atomics; only a side
+// that finds the ring full (or empty) parks on the condition variable, and
+// the other side takes the mutex only when someone is parked.
+template<class T> class SpscQueue {
+public:
+    explicit SpscQueue(size_t capacity) : slots_(capacity+1) {}
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    // Producer: the slot to fill next, waiting while the ring is full;
+    // nullptr once the queue is closed.
+    T* back(){
+        const size_t t = tail_.load(std::memory_order_relaxed), n = next(t);
+        if(n == head_.load()) park([&]{ return n != head_.load() || closed_.load(); });
+        return closed_.load() ? nullptr : &slots_[t];
+    }
+    void push(){ tail_.store(next(tail_.load(std::memory_order_relaxed))); wake(); }
+
+    // Consumer: the oldest published slot, waiting while the ring is empty;
+    // nullptr once the queue is closed and drained.
+    T* front(){
+        const size_t h = head_.load(std::memory_order_relaxed);
+        if(h == tail_.load()) park([&]{ return h != tail_.load() || closed_.load(); });
+        return h != tail_.load() ? &slots_[h] : nullptr;
+    }
+    void pop(){ head_.store(next(head_.load(std::memory_order_relaxed))); wake(); }
+
+    // End of input (producer) or of interest (consumer); wakes the other side.
+    void close(){ closed_.store(true); std::lock_guard<std::mutex> lk(mu_); cv_.notify_all(); }
+    bool closed() const { return closed_.load(); }
+
+private:
+    size_t next(size_t i) const { return i+1 == slots_.size() ? 0 : i+1; }
+    // Sequentially consistent indices and parked_: a waker either sees the
+    // parked count or the parker's predicate sees the new index.
+    template<class Ready> void park(Ready ready){
+        std::unique_lock<std::mutex> lk(mu_);
+        parked_.fetch_add(1); cv_.wait(lk, ready); parked_.fetch_sub(1);
+    }
+    void wake(){ if(parked_.load()){ { std::lock_guard<std::mutex> lk(mu_); } cv_.notify_all(); } }
+
+    std::vector<T> slots_;              // one slot stays free to tell full from empty
+    std::atomic<size_t> head_{0}, tail_{0};
+    std::atomic<int> parked_{0};
+    std::atomic<bool> closed_{false};
+    std::mutex mu_; std::condition_variable cv_;
+};
+
+// FFTW's planner is not thread-safe; plan creation/destruction goes through this.
+std::mutex& fftw_planner_mutex();
+
+// ----------------- Spectral analysis -----------------
+// SpectralOutputs is public (dsdinspect.h).
+
+// Position of f on the 20 Hz .. Nyquist log axis, 0..1 (the pretty renderers' frequency scale).
+inline double logf_pos(double f, int sr){ return std::log10(std::max(20.0, f)/20.0) / std::log10((sr*0.5)/20.0); }
+
+// Spectrogram image layout. width 0 keeps one column per FFT frame; otherwise
+// frames are merged into at most `width` columns (max-hold dB or mean power),
+// so memory and PNG size no longer grow with duration.
+struct SpectrogramLayout {
+    int width = 0;
+    bool mean = false;   // mean power per column/row instead of max-hold
+    bool logf = false;   // log-frequency rows instead of linear
+};
+inline SpectrogramLayout spectrogram_layout(const Options& o){ SpectrogramLayout l; l.width = o.spec_width; l.mean = o.spec_mean; l.logf = o.spec_logf; return l; }
+
+void make_hann(std::vector<double>& w);
+
+// Float STFT inner loops. window() is the Hann multiply in front of the FFT;
+// power_db() turns interleaved r2c output into 10*log10(|X|^2*scale) clamped
+// to [-120, 0] dB in a single pass, with log2 from the exponent bits plus an
+// atanh series on the mantissa (error well below 1e-4 dB), and widens mn/mx
+// to the frame's range. log10(x) = log2(x)*log10(2).
+using WindowFn  = void (*)(const float* x, const float* w, float* out, int n);
+using PowerDbFn = void (*)(const float* cplx, int nbins, float scale, float* db, float& mn, float& mx);
+
+struct SpectralKernels { WindowFn window = nullptr; PowerDbFn power_db = nullptr; const char* name = "scalar"; };
+
+SpectralKernels select_spectral_kernels(bool simd);
+
+// Incremental STFT: samples are appended to a linear buffer and, once a batch
+// of frames is complete, the frames are windowed and transformed in parallel
+// on the pool. Each thread owns its input/output arrays and runs the shared
+// plan through fftwf_execute_dft_r2c(); each frame writes its own dB row and
+// spectrogram column. The average is then reduced bin-parallel in frame order,
+// so results are bit-identical for any thread count.
+// The default path is single precision with the SpectralKernels above;
+// fft_double selects the original double-precision fftw path (std::log10 per
+// bin), kept as the reference for --check-fft.
+// With a fixed layout width, each frame's rows go to a per-batch matrix and
+// are folded in frame order into the columns; when all columns are full,
+// neighbouring pairs are merged and each column covers twice as many frames.
+// In stereo mode push(l, r, n) buffers L/R interleaved and each frame is one
+// complex FFT of l + i*r (two-for-one): the L and R spectra are separated by
+// conjugate symmetry and the mono spectrum is (L+R)/sqrt(2), since the mono
+// downmix is (l+r)/sqrt(2). One transform thus yields the mono average and
+// spectrogram plus the L/R averages, which finish(&left, &right) returns.
+class SpectralAccumulator {
+public:
+    static const int IMG_H = 512;
+
+    SpectralAccumulator(int sr, int Nfft, int hop, bool want_spectrogram=true, ThreadPool* pool=nullptr, bool fft_double=false, bool simd=true,
+                        const SpectrogramLayout& layout=SpectrogramLayout(), bool stereo=false)
+        : sr_(sr), N_(Nfft), hop_(std::max(1,hop)), H_(Nfft/2+1), ch_(stereo ? 2 : 1), nout_(stereo ? 3 : 1), want_spec_(want_spectrogram), double_(fft_double), pool_(pool),
+          kern_(select_spectral_kernels(simd)), lay_(layout), window_(Nfft), avg_((size_t)nout_*H_, 0.0)
+    {
+        make_hann(window_);
+        int T = pool_ ? pool_->size() : 1;
+        batch_ = (size_t)std::clamp(8*T, 16, 512);
+        buf_.reserve(((batch_-1)*hop_ + N_)*ch_);
+        batch_db_.resize(batch_*nout_*H_);
+        if (want_spec_) setup_rows(T);
+        std::lock_guard<std::mutex> lk(fftw_planner_mutex());
+        // stereo: N complex in and out per thread (r2c needs N real in, H complex out)
+        const size_t nin = (size_t)N_*ch_, nfreq = stereo ? (size_t)N_ : (size_t)H_;
+        if(double_){
+            for(int t=0;t<T;++t){
+                dbufs_in_.push_back((double*)fftw_malloc(sizeof(double)*nin));
+                dbufs_out_.push_back((fftw_complex*)fftw_malloc(sizeof(fftw_complex)*nfreq));
+            }
+            if(stereo) dplan_ = fftw_plan_dft_1d(N_, (fftw_complex*)dbufs_in_[0], dbufs_out_[0], FFTW_FORWARD, FFTW_ESTIMATE);
+            else dplan_ = fftw_plan_dft_r2c_1d(N_, dbufs_in_[0], dbufs_out_[0], FFTW_ESTIMATE);
+            if(stereo) dsep_.assign(T, std::vector<double>((size_t)6*H_));
+        } else {
+            windowf_.resize(nin);
+            for(size_t n=0;n<nin;++n) windowf_[n] = (float)window_[n/ch_];   // interleaved (w0,w0,w1,w1,..) in stereo
+            for(int t=0;t<T;++t){
+                bufs_in_.push_back((float*)fftwf_malloc(sizeof(float)*nin));
+                bufs_out_.push_back((fftwf_complex*)fftwf_malloc(sizeof(fftwf_complex)*nfreq));
+            }
+            if(stereo) plan_ = fftwf_plan_dft_1d(N_, (fftwf_complex*)bufs_in_[0], bufs_out_[0], FFTW_FORWARD, FFTW_ESTIMATE);
+            else plan_ = fftwf_plan_dft_r2c_1d(N_, bufs_in_[0], bufs_out_[0], FFTW_ESTIMATE);
+            if(stereo) sep_.assign(T, std::vector<float>((size_t)6*H_));
+        }
+    }
+    ~SpectralAccumulator(){
+        { std::lock_guard<std::mutex> lk(fftw_planner_mutex()); if(double_) fftw_destroy_plan(dplan_); else fftwf_destroy_plan(plan_); }
+        for(auto* p : dbufs_in_) fftw_free(p);
+        for(auto* p : dbufs_out_) fftw_free(p);
+        for(auto* p : bufs_in_) fftwf_free(p);
+        for(auto* p : bufs_out_) fftwf_free(p);
+    }
+    SpectralAccumulator(const SpectralAccumulator&) = delete;
+    SpectralAccumulator& operator=(const SpectralAccumulator&) = delete;
+
+    void push(const float* x, size_t n){
+        const size_t span = (batch_-1)*hop_ + N_;   // samples covering one full batch
+        while (n > 0){
+            if (skip_ > 0){ size_t k = std::min(skip_, n); x += k; n -= k; skip_ -= k; continue; }
+            size_t m = std::min(n, span - buf_.size());
+            buf_.insert(buf_.end(), x, x+m);
+            x += m; n -= m;
+            if (buf_.size() == span) run_batch(batch_);
+        }
+    }
+
+    // Stereo mode: planar L/R in, interleaved into the frame buffer.
+    void push(const float* l, const float* r, size_t n){
+        const size_t span = (batch_-1)*hop_ + N_;
+        while (n > 0){
+            if (skip_ > 0){ size_t k = std::min(skip_, n); l += k; r += k; n -= k; skip_ -= k; continue; }
+            size_t m = std::min(n, span - pending()), old = buf_.size();
+            buf_.resize(old + 2*m);
+            float* d = &buf_[old];
+            for(size_t i=0;i<m;++i){ d[2*i] = l[i]; d[2*i+1] = r[i]; }
+            l += m; r += m; n -= m;
+            if (pending() == span) run_batch(batch_);
+        }
+    }
+
+    // Input discontinuity (next --sample window): completes the pending frames
+    // and drops the partial one, so no frame straddles a seek.
+    void gap(){
+        size_t ready = (pending() >= (size_t)N_) ? (pending()-N_)/hop_ + 1 : 0;
+        if (ready > 0) run_batch(ready);
+        buf_.clear(); skip_ = 0;
+    }
+
+    size_t frames() const { return frames_; }
+
+    // Called with every frame's mono dB row (H bins), in frame order, after
+    // the frame's batch has been transformed.
+    void set_frame_sink(std::function<void(const float* db)> sink){ frame_sink_ = std::move(sink); }
+
+    // Mono average over the frames completed so far (no spectrogram); the
+    // pending partial batch is not included.
+    SpectralOutputs average() const {
+        SpectralOutputs out;
+        out.avg_mag_db.assign(avg_.begin(), avg_.begin() + H_);
+        if(frames_>0){ for(double& v : out.avg_mag_db) v /= (double)frames_; }
+        out.freq.resize(H_); for(int k=0;k<H_;++k) out.freq[k] = (double)k * sr_ / (double)N_;
+        out.frames = frames_;
+        return out;
+    }
+
+    const char* kernel() const { return double_ ? "double" : kern_.name; }
+
+    // Back to the empty state for the next input. Plans, per-thread buffers
+    // and the layout are kept, so one accumulator serves many files.
+    void reset(){
+        buf_.clear(); cols_.clear(); std::fill(avg_.begin(), avg_.end(), 0.0);
+        skip_ = 0; frames_ = 0; ncols_ = 0; per_col_ = 1; fill_ = 1;
+    }
+
+    // Mono average (+ spectrogram); in stereo mode left/right receive the L/R averages.
+    SpectralOutputs finish(SpectralOutputs* left=nullptr, SpectralOutputs* right=nullptr){
+        size_t ready = (pending() >= (size_t)N_) ? (pending()-N_)/hop_ + 1 : 0;
+        if (ready > 0) run_batch(ready);
+        SpectralOutputs out;
+        auto fill = [&](SpectralOutputs& o, int c){
+            o.avg_mag_db.assign(avg_.begin() + (size_t)c*H_, avg_.begin() + (size_t)(c+1)*H_);
+            if(frames_>0){ for(int k=0;k<H_;++k) o.avg_mag_db[k]/= (double)frames_; }
+            o.freq.resize(H_); for(int k=0;k<H_;++k) o.freq[k] = (double)k * sr_ / (double)N_;
+            o.frames = frames_;
+        };
+        fill(out, 0);
+        if(nout_ == 3){ if(left) fill(*left, 1); if(right) fill(*right, 2); }
+        if (want_spec_ && lay_.width > 0) finish_columns();
+        if (want_spec_){
+            // columns were appended frame by frame; transpose to the row-major image
+            size_t W = cols_.size()/IMG_H;
+            out.spectrogram_png.assign(W*IMG_H, 0);
+            for(size_t f=0; f<W; ++f){ const unsigned char* col = &cols_[f*IMG_H]; for(int y=0;y<IMG_H;++y) out.spectrogram_png[(size_t)(IMG_H-1-y)*W + f] = col[y]; }
+            out.spec_w = (int)W; out.spec_h = IMG_H; out.spec_logf = lay_.logf;
+        }
+        return out;
+    }
+
+private:
+    void run_batch(size_t nf){
+        size_t col0 = cols_.size();
+        if (want_spec_ && lay_.width == 0) cols_.resize(col0 + nf*IMG_H);
+        auto frames_fn = [&](size_t b, size_t e, int t){ for(size_t i=b;i<e;++i) process_frame(i, t, col0); };
+        const size_t row = (size_t)nout_*H_;           // dB values per frame (mono, then L and R)
+        auto reduce_fn = [&](size_t b, size_t e, int){ for(size_t k=b;k<e;++k){ double s=avg_[k]; for(size_t i=0;i<nf;++i) s += batch_db_[i*row+k]; avg_[k]=s; } };
+        if (pool_){ pool_->parallel_for(nf, frames_fn); pool_->parallel_for(row, reduce_fn); }
+        else { frames_fn(0, nf, 0); reduce_fn(0, row, 0); }
+        if (want_spec_ && lay_.width > 0) fold_columns(nf);
+        if (frame_sink_) for(size_t i=0;i<nf;++i) frame_sink_(&batch_db_[i*row]);
+        frames_ += nf;
+        // drop consumed samples; with hop > fft_size the gap is skipped on input
+        size_t consumed = nf*hop_;
+        if (consumed >= pending()){ skip_ = consumed - pending(); buf_.clear(); }
+        else buf_.erase(buf_.begin(), buf_.begin()+consumed*ch_);
+    }
+
+    size_t pending() const { return buf_.size()/ch_; }   // buffered samples (per channel)
+
+    // Two-for-one split of X = FFT(l + i*r) (N complex) into the mono, L and R
+    // half spectra, H_ complex values each: L[k] = (X[k] + conj(X[N-k]))/2,
+    // R[k] = (X[k] - conj(X[N-k]))/2i, mono = (L+R)/sqrt(2).
+    template<class T> void split_stereo(const T* X, T* out) const {
+        T* M = out; T* L = out + 2*H_; T* R = out + 4*H_;
+        const T h = (T)0.5, s = (T)M_SQRT1_2;
+        for(int k=0;k<H_;++k){
+            int j = k ? N_-k : 0;
+            T a = X[2*k], b = X[2*k+1], c = X[2*j], d = X[2*j+1];
+            T lr = (a+c)*h, li = (b-d)*h, rr = (b+d)*h, ri = (c-a)*h;
+            L[2*k] = lr; L[2*k+1] = li; R[2*k] = rr; R[2*k+1] = ri;
+            M[2*k] = (lr+rr)*s; M[2*k+1] = (li+ri)*s;
+        }
+    }
+
+    void process_frame(size_t i, int t, size_t col0){
+        const float* x = &buf_[i*hop_*ch_];
+        float* frame_db = &batch_db_[i*nout_*H_];
+        float minbin = 0.0f, maxbin = -120.0f;
+        if(ch_ == 2 && double_){
+            double* in = dbufs_in_[t]; double* sp = dsep_[t].data();
+            for(int n=0;n<2*N_;++n) in[n] = (double)x[n] * window_[n/2];
+            fftw_execute_dft(dplan_, (fftw_complex*)in, dbufs_out_[t]);
+            split_stereo(&dbufs_out_[t][0][0], sp);
+            for(int c=0;c<3;++c) for(int k=0;k<H_;++k){
+                float db = (float)magdb(sp[2*((size_t)c*H_+k)], sp[2*((size_t)c*H_+k)+1]); frame_db[(size_t)c*H_+k] = db;
+                if(c==0){ minbin=std::min(minbin,db); maxbin=std::max(maxbin,db); }
+            }
+        } else if(ch_ == 2){
+            float* in = bufs_in_[t]; float* sp = sep_[t].data();
+            kern_.window(x, windowf_.data(), in, 2*N_);
+            fftwf_execute_dft(plan_, (fftwf_complex*)in, bufs_out_[t]);
+            split_stereo(&bufs_out_[t][0][0], sp);
+            const float scale = 4.0f/((float)N_*(float)N_);
+            kern_.power_db(sp, H_, scale, frame_db, minbin, maxbin);
+            float mn = 0.0f, mx = -120.0f;                      // L/R ranges are not needed
+            kern_.power_db(sp + 2*H_, H_, scale, frame_db + H_, mn, mx);
+            kern_.power_db(sp + 4*H_, H_, scale, frame_db + 2*H_, mn, mx);
+        } else if(double_){
+            double* in = dbufs_in_[t]; fftw_complex* cplx = dbufs_out_[t];
+            for(int n=0;n<N_;++n) in[n] = (double)x[n] * window_[n];
+            fftw_execute_dft_r2c(dplan_, in, cplx);
+            for(int k=0;k<H_;++k){ float db = (float)magdb(cplx[k][0], cplx[k][1]); frame_db[k]=db; minbin=std::min(minbin,db); maxbin=std::max(maxbin,db); }
+        } else {
+            float* in = bufs_in_[t]; fftwf_complex* cplx = bufs_out_[t];
+            kern_.window(x, windowf_.data(), in, N_);
+            fftwf_execute_dft_r2c(plan_, in, cplx);
+            const float scale = 4.0f/((float)N_*(float)N_);      // |X|/(N/2), squared
+            kern_.power_db(&cplx[0][0], H_, scale, frame_db, minbin, maxbin);
+        }
+        if(!want_spec_) return;
+        if(lay_.width > 0){
+            frame_rows(frame_db, &batch_rows_[i*IMG_H], lay_.mean);
+            batch_mn_[i] = minbin; batch_mx_[i] = maxbin;
+            return;
+        }
+        double span = std::max(10.0, (double)maxbin - minbin);
+        unsigned char* col = &cols_[col0 + i*IMG_H];
+        if(!lay_.logf){
+            for(int y=0;y<IMG_H;++y){ int k = (int)((double)y/IMG_H * (H_-1)); double v = (frame_db[k]-minbin)/span; col[y] = (unsigned char)std::clamp((int)(v*255.0),0,255); }
+            return;
+        }
+        float* rows = rows_tmp_[t].data();
+        frame_rows(frame_db, rows, false);
+        for(int y=0;y<IMG_H;++y){ double v = (rows[y]-minbin)/span; col[y] = (unsigned char)std::clamp((int)(v*255.0),0,255); }
+    }
+
+    // Bin range [row_k0_, row_k1_) of every image row, bottom row first:
+    // one bin per row on the linear scale, 20 Hz .. Nyquist on the log scale.
+    void setup_rows(int T){
+        row_k0_.resize(IMG_H); row_k1_.resize(IMG_H);
+        const double df = (double)sr_/N_, nyq = sr_*0.5;
+        for(int y=0;y<IMG_H;++y){
+            if(!lay_.logf){ row_k0_[y] = (int)((double)y/IMG_H * (H_-1)); row_k1_[y] = row_k0_[y]+1; continue; }
+            double f0 = 20.0*std::pow(nyq/20.0, (double)y/IMG_H), f1 = 20.0*std::pow(nyq/20.0, (double)(y+1)/IMG_H);
+            int k0 = std::min(H_-1, (int)std::lround(f0/df)), k1 = std::min(H_, (int)std::lround(f1/df));
+            row_k0_[y] = k0; row_k1_[y] = std::max(k0+1, k1);
+        }
+        if(lay_.width > 0){
+            C_ = (size_t)std::max(2, (lay_.width+1)/2*2);         // even, so columns merge in pairs
+            batch_rows_.resize(batch_*IMG_H); batch_mn_.resize(batch_); batch_mx_.resize(batch_);
+            colv_.resize(C_*IMG_H); colmn_.resize(C_); colmx_.resize(C_); colcnt_.resize(C_);
+        } else if(lay_.logf){
+            rows_tmp_.assign(T, std::vector<float>(IMG_H));
+        }
+    }
+
+    // Row values of one frame: max dB over the row's bins, or their mean power.
+    void frame_rows(const float* db, float* rows, bool power) const {
+        for(int y=0;y<IMG_H;++y){
+            int k0 = row_k0_[y], k1 = row_k1_[y];
+            if(power){ double s=0; for(int k=k0;k<k1;++k) s += std::pow(10.0, db[k]*0.1); rows[y] = (float)(s/(k1-k0)); }
+            else { float m = db[k0]; for(int k=k0+1;k<k1;++k) m = std::max(m, db[k]); rows[y] = m; }
+        }
+    }
+
+    // Appends the batch's rows, in frame order, to the fixed set of columns.
+    void fold_columns(size_t nf){
+        for(size_t i=0;i<nf;++i){
+            if(fill_ == per_col_){
+                if(ncols_ == C_) merge_pairs();
+                size_t c = ncols_++;
+                std::fill(&colv_[c*IMG_H], &colv_[c*IMG_H]+IMG_H, lay_.mean ? 0.0f : -120.0f);
+                colmn_[c] = 0.0f; colmx_[c] = -120.0f; colcnt_[c] = 0; fill_ = 0;
+            }
+            size_t c = ncols_-1;
+            float* v = &colv_[c*IMG_H]; const float* r = &batch_rows_[i*IMG_H];
+            if(lay_.mean) for(int y=0;y<IMG_H;++y) v[y] += r[y];
+            else for(int y=0;y<IMG_H;++y) v[y] = std::max(v[y], r[y]);
+            colmn_[c] = std::min(colmn_[c], batch_mn_[i]); colmx_[c] = std::max(colmx_[c], batch_mx_[i]);
+            ++colcnt_[c]; ++fill_;
+        }
+    }
+
+    void merge_pairs(){
+        for(size_t j=0;j<C_/2;++j){
+            float* d = &colv_[j*IMG_H]; const float* a = &colv_[2*j*IMG_H]; const float* b = &colv_[(2*j+1)*IMG_H];
+            for(int y=0;y<IMG_H;++y) d[y] = lay_.mean ? a[y]+b[y] : std::max(a[y], b[y]);
+            colmn_[j] = std::min(colmn_[2*j], colmn_[2*j+1]); colmx_[j] = std::max(colmx_[2*j], colmx_[2*j+1]);
+            colcnt_[j] = colcnt_[2*j] + colcnt_[2*j+1];
+        }
+        ncols_ = C_/2; per_col_ *= 2; fill_ = per_col_;
+    }
+
+    // Normalizes each column like a frame (its own min..max span) and
+    // stretches to C_ columns once merging started, so the width is fixed.
+    void finish_columns(){
+        size_t W = (per_col_ > 1) ? C_ : ncols_;
+        cols_.assign(W*IMG_H, 0);
+        for(size_t x=0;x<W;++x){
+            size_t c = (W==ncols_) ? x : x*ncols_/W;
+            const float* v = &colv_[c*IMG_H]; unsigned char* col = &cols_[x*IMG_H];
+            double mn = colmn_[c], span = std::max(10.0, (double)colmx_[c] - mn);
+            for(int y=0;y<IMG_H;++y){
+                double db = lay_.mean ? std::max(-120.0, 10.0*std::log10(v[y]/colcnt_[c] + 1e-30)) : v[y];
+                col[y] = (unsigned char)std::clamp((int)((db-mn)/span*255.0),0,255);
+            }
+        }
+    }
+    double magdb(double re, double im) const { double m = std::sqrt(re*re+im*im) / (N_/2.0); double db = 20.0*std::log10(m + 1e-12); return std::clamp(db, -120.0, 0.0); }
+
+    int sr_, N_; size_t hop_; int H_;
+    int ch_, nout_;                     // buffered channels (2 in stereo mode), spectra per frame (mono or mono+L+R)
+    bool want_spec_, double_;
+    ThreadPool* pool_;
+    SpectralKernels kern_;
+    SpectrogramLayout lay_;
+    std::vector<int> row_k0_, row_k1_;
+    std::vector<std::vector<float>> rows_tmp_;  // per-thread rows (log-f, one column per frame)
+    std::vector<float> batch_rows_, batch_mn_, batch_mx_;   // fixed width: rows/min/max per frame of the batch
+    std::vector<float> colv_, colmn_, colmx_;   // fixed width: C_ columns of IMG_H rows (dB or power sums)
+    std::vector<uint32_t> colcnt_;
+    size_t C_ = 0, ncols_ = 0, per_col_ = 1, fill_ = 1;
+    size_t batch_ = 0;                  // frames per parallel batch
+    std::vector<double> window_;
+    std::vector<float> windowf_;
+    std::vector<float> buf_;            // samples from the first pending frame on (L/R interleaved in stereo mode)
+    std::vector<double> avg_;
+    std::vector<float> batch_db_;       // nout_ dB rows per frame of the batch
+    std::function<void(const float*)> frame_sink_;
+    std::vector<unsigned char> cols_;   // IMG_H bytes per frame, bottom row first
+    size_t skip_ = 0, frames_ = 0;
+    std::vector<float*> bufs_in_;       // per-thread FFT input/output (float path)
+    std::vector<fftwf_complex*> bufs_out_;
+    std::vector<std::vector<float>> sep_;        // stereo: per-thread mono/L/R half spectra
+    fftwf_plan plan_ = nullptr;
+    std::vector<double*> dbufs_in_;     // same for the double path
+    std::vector<fftw_complex*> dbufs_out_;
+    std::vector<std::vector<double>> dsep_;
+    fftw_plan dplan_ = nullptr;
+};
+
+// In-memory convenience wrapper over SpectralAccumulator.
+SpectralOutputs compute_spectrum_and_spectrogram(ChannelView x, int sr, int Nfft, int hop, const std::string&, bool want_spectrogram=true, ThreadPool* pool=nullptr);
+
+// ----------------- Fingerprints -----------------
+// Builds a Fingerprint (dsdinspect.h) from the STFT's mono frames
+// (SpectralAccumulator::set_frame_sink) and the final average spectrum.
+// Frames are reduced to 9 band means as they arrive; the music starts at the
+// first frame with a band above -70 dB, and each 1 s segment keeps one value
+// per band, so memory is fixed. An input discontinuity ends the time part:
+// segments after a seek would not line up with another copy's.
+class FingerprintAccumulator {
+public:
+    static constexpr int kBands = 9, kSegs = 33;    // (kSegs-1)*(kBands-1) = 256 bits
+
+    FingerprintAccumulator(int sr, int Nfft, int hop) : sr_(sr), N_(Nfft), seg_frames_(std::max(1, (int)std::lround((double)sr/std::max(1,hop)))) {
+        for(int b=0;b<kBands;++b){
+            double f0 = 150.0*std::pow(8000.0/150.0, (double)b/kBands), f1 = 150.0*std::pow(8000.0/150.0, (double)(b+1)/kBands);
+            int k0 = (int)std::ceil(f0*N_/sr_), k1 = std::max(k0+1, (int)std::ceil(f1*N_/sr_));
+            k0_[b] = std::min(k0, N_/2); k1_[b] = std::min(k1, N_/2+1);
+        }
+    }
+
+    void frame(const float* db){
+        if(!timed_ || seg_ == kSegs) return;
+        float e[kBands], top = -120.0f;
+        for(int b=0;b<kBands;++b){ float s=0; for(int k=k0_[b];k<k1_[b];++k) s += db[k]; e[b] = k1_[b]>k0_[b] ? s/(k1_[b]-k0_[b]) : -120.0f; top = std::max(top, e[b]); }
+        if(!started_ && top < -70.0f) return;
+        started_ = true;
+        for(int b=0;b<kBands;++b) acc_[b] += e[b];
+        if(++in_seg_ == seg_frames_){ for(int b=0;b<kBands;++b){ E_[seg_][b] = (float)(acc_[b]/in_seg_); acc_[b] = 0; } in_seg_ = 0; ++seg_; }
+    }
+
+    void gap(){ timed_ = false; }
+
+    void reset(){ timed_ = true; started_ = false; seg_ = 0; in_seg_ = 0; std::fill(acc_, acc_+kBands, 0.0); }
+
+    void finish(const SpectralOutputs& avg, Fingerprint& fp) const {
+        fp = Fingerprint();
+        for(int t=1;t<seg_;++t) for(int b=0;b+1<kBands;++b){
+            int i = (t-1)*(kBands-1) + b;
+            float d = (E_[t][b]-E_[t][b+1]) - (E_[t-1][b]-E_[t-1][b+1]);
+            fp.mask[i/64] |= 1ull << (i%64);
+            if(d > 0) fp.bits[i/64] |= 1ull << (i%64);
+        }
+        if(avg.frames == 0 || avg.avg_mag_db.empty()) return;
+        double v[Fingerprint::kBands], mean = 0;
+        for(int b=0;b<Fingerprint::kBands;++b){
+            double f0 = 20.0*std::pow(88200.0/20.0, (double)b/Fingerprint::kBands), f1 = 20.0*std::pow(88200.0/20.0, (double)(b+1)/Fingerprint::kBands);
+            double s = 0; int n = 0;
+            for(size_t k=0;k<avg.freq.size();++k) if(avg.freq[k] >= f0 && avg.freq[k] < f1){ s += avg.avg_mag_db[k]; ++n; }
+            if(!n){ size_t k = std::min(avg.freq.size()-1, (size_t)std::lround(0.5*(f0+f1)*N_/sr_)); s = (0.5*(f0+f1) <= 0.5*sr_) ? avg.avg_mag_db[k] : -120.0; n = 1; }   // bands narrower than a bin
+            v[b] = s/n; mean += v[b];
+        }
+        mean /= Fingerprint::kBands;
+        for(int b=0;b<Fingerprint::kBands;++b) fp.profile[b] = (int8_t)std::clamp(std::lround((v[b]-mean)*2), -127L, 127L);
+        fp.valid = true;
+    }
+
+private:
+    int sr_, N_, seg_frames_;
+    int k0_[kBands], k1_[kBands];       // bin range of each band
+    bool timed_ = true, started_ = false;
+    int seg_ = 0, in_seg_ = 0;
+    double acc_[kBands] = {};
+    float E_[kSegs][kBands];            // band means per completed segment (dB)
+};
+
+// One index entry: the fingerprint plus what a query prints, at a fixed
+// size so the index can be scanned straight from the mapping.
+struct FingerprintRecord {
+    uint64_t bits[Fingerprint::kWords], mask[Fingerprint::kWords];
+    int8_t profile[Fingerprint::kBands];
+    float norm;                         // |profile|
+    float duration_s;
+    uint32_t path_off, path_len;        // in the index's string table
+};
+static_assert(sizeof(FingerprintRecord) == 144, "index layout");
+
+FingerprintRecord fingerprint_record(const Fingerprint& fp, double duration_s);
+
+// For each of n records: the differing measured bits against q, the bits
+// measured in both, and the profile dot product.
+using FingerprintScanFn = void (*)(const FingerprintRecord* r, size_t n, const FingerprintRecord& q, uint16_t* diff, uint16_t* common, int32_t* dot);
+FingerprintScanFn select_fingerprint_scan(bool simd);
+
+// ----------------- Metrics & classification -----------------
+// Metrics, analyze_metrics() and classify() are public (dsdinspect.h).
+
+// Distance of m from the thresholds classify() compared it against, in units
+// of a per-metric tolerance (cutoff 500 Hz, noise rise 1 dB, 30-50 kHz floor
+// 2 dB, crest/DR 0.5 dB). Each distance is first reduced by the metric's
+// recent drift in spread, so >= 1 means neither noise nor a one-tolerance
+// move can flip the verdict. Thresholds on a branch not taken are ignored.
+double classify_margin(const Metrics& m, const Metrics& spread);
+
+// Peak |x| and sum of x^2 (in double) over n samples, folded into peak/sum2.
+using PeakSumFn = void (*)(const float* x, size_t n, float& peak, double& sum2);
+PeakSumFn select_peak_sumsq(bool simd);
+
+// Block statistics for crest (3 s blocks) and DR (1 s blocks), fed while
+// decoding: the mono downmix and, in stereo mode, L and R. Input is cut at
+// the next block boundary of either size, so one peak/sum-of-squares kernel
+// pass per channel serves both block sizes. Only one value per completed
+// block and channel is stored, and the percentiles are picked with
+// nth_element. A trailing partial block counts when it holds at least 1000
+// samples, as before. Every block also goes into the channel's
+// DynamicsSummary, which album mode merges across tracks.
+class DynamicAccumulator {
+public:
+    explicit DynamicAccumulator(int sr, bool stereo=false, bool simd=true)
+        : W_(std::max(1,3*sr)), B_((size_t)std::max(1,sr)), kern_(select_peak_sumsq(simd)), ch_(stereo ? 3 : 1) {}
+
+    void push(const float* x, size_t n){ const float* c[3] = { x, x, x }; feed(c, n); }
+    // Stereo mode: mono, L and R planes of n samples each.
+    void push(const float* mono, const float* l, const float* r, size_t n){ const float* c[3] = { mono, l, r }; feed(c, n); }
+
+    // Closes the partial blocks at an input discontinuity; like finish(), a
+    // partial block counts when it has at least 1000 samples.
+    void gap(){
+        if(c_n_>=1000) flush_crest(); else { for(auto& c : ch_) { c.c_peak=0; c.c_sum2=0; } c_n_=0; }
+        if(d_n_>=1000) flush_dr(); else { for(auto& c : ch_) { c.d_peak=0; c.d_sum2=0; } d_n_=0; }
+    }
+
+    void reset(){ c_n_=0; d_n_=0; for(auto& c : ch_) c = Chan(); }
+
+    // 0 = mono, 1/2 = L/R (stereo mode). Complete after finish().
+    const DynamicsSummary& summary(int c=0) const { return ch_[c].summary; }
+
+    // Mono into crest_median_db/dr_like_db; in stereo mode also the _l/_r fields.
+    void finish(Metrics& m){
+        gap();
+        ch_[0].finish(m.crest_median_db, m.dr_like_db);
+        if(ch_.size()==3){ ch_[1].finish(m.crest_median_l_db, m.dr_like_l_db); ch_[2].finish(m.crest_median_r_db, m.dr_like_r_db); }
+    }
+
+private:
+    struct Chan {
+        double c_peak=0, c_sum2=0, d_peak=0, d_sum2=0;
+        std::vector<double> crest_db, peaks, rmses;
+        DynamicsSummary summary;
+        static double rank(std::vector<double>& v, size_t i){ std::nth_element(v.begin(), v.begin()+i, v.end()); return v[i]; }
+        void finish(double& crest, double& dr){
+            if(!crest_db.empty()) crest = rank(crest_db, crest_db.size()/2);
+            auto perc=[&](std::vector<double>& v,double p){ if(v.empty()) return -120.0; return rank(v, (size_t)std::clamp(p*(v.size()-1),0.0,(double)(v.size()-1))); };
+            double p95=perc(peaks,0.95), p50=perc(rmses,0.50); dr=p95-p50;
+        }
+    };
+
+    void feed(const float* const* x, size_t n){
+        for(size_t off=0; off<n; ){
+            size_t k = std::min({n-off, W_-c_n_, B_-d_n_});
+            for(size_t c=0;c<ch_.size();++c){
+                float pk=0; double s2=0; kern_(x[c]+off, k, pk, s2);
+                Chan& h = ch_[c];
+                h.c_peak = std::max(h.c_peak, (double)pk); h.c_sum2 += s2;
+                h.d_peak = std::max(h.d_peak, (double)pk); h.d_sum2 += s2;
+            }
+            c_n_ += k; d_n_ += k; off += k;
+            if(c_n_==W_) flush_crest();
+            if(d_n_==B_) flush_dr();
+        }
+    }
+    void flush_crest(){
+        for(auto& c : ch_){ double rms=std::sqrt(c.c_sum2/c_n_); if(rms>0 && c.c_peak>0){ c.crest_db.push_back(20*std::log10(c.c_peak/rms)); c.summary.add_crest(c.crest_db.back()); } c.c_peak=0; c.c_sum2=0; }
+        c_n_=0;
+    }
+    void flush_dr(){
+        for(auto& c : ch_){ c.peaks.push_back(20*std::log10(c.d_peak+1e-12)); double rms=std::sqrt(c.d_sum2/d_n_); c.rmses.push_back(20*std::log10(rms+1e-12)); c.summary.add_level(c.peaks.back(), c.rmses.back()); c.d_peak=0; c.d_sum2=0; }
+        d_n_=0;
+    }
+
+    size_t W_, B_;
+    PeakSumFn kern_;
+    size_t c_n_=0, d_n_=0;              // samples in the open crest / DR block (shared by all channels)
+    std::vector<Chan> ch_;
+};
+
+void compute_dynamic_metrics(ChannelView x, int sr, Metrics& m);
+
+// Max |y| over the 4n points of the ITU-R BS.1770-4 4x interpolator (12 taps
+// per phase) for inputs x[0..n); x[-11..-1] must be readable history.
+using Interp4PeakFn = float (*)(const float* x, size_t n);
+Interp4PeakFn select_interp4_peak(bool simd);
+extern const float kInterp4[4][12];
+
+// Peak |x[i]| over [0,n) and the largest step |x[i]-x[i-1]| for 0<i<n, folded
+// into peak/step.
+using PeakStepFn = void (*)(const float* x, size_t n, float& peak, float& step);
+PeakStepFn select_peak_step(bool simd);
+
+// True peak and 0 dBTP clip runs of L and R, fed the same blocks as
+// DynamicAccumulator. Input is taken in sub-blocks of 1024 samples. Writing
+// an interpolated point as sum h_k x_k = x_c sum h_k + sum h_k (x_k - x_c),
+// with x_c the sample under the phase's main tap, bounds it by
+// |sum h| P + sum |h_k| |k-c| D, where P is the sample peak and D the largest
+// step between neighbouring samples in its 12-tap window. At 176.4 kHz D is a
+// small fraction of P, so the bound is about 1 dB above the sample peak. A
+// sub-block (with its 11-sample history) whose bound is below both the
+// running true peak and the clip level cannot change either and is not
+// interpolated; only the louder passages pay for the 4x FIR. Sub-blocks that
+// reach 0 dBTP are re-interpolated point by point to find where runs start
+// and end.
+class TruePeakDetector {
+public:
+    static constexpr size_t kSub = 1024, kHist = 11;
+
+    explicit TruePeakDetector(int sr, bool simd=true)
+        : sr_(sr), step_(select_peak_step(simd)), interp_(select_interp4_peak(simd)), buf_(kHist+kSub)
+    {
+        for(int p=0;p<4;++p){
+            double sum=0, best=1e9;
+            for(float h : kInterp4[p]) sum += h;
+            for(int c=0;c<12;++c){ double d=0; for(int k=0;k<12;++k) d += std::fabs(kInterp4[p][k])*std::abs(k-c); best = std::min(best, d); }
+            gain_[p] = (float)std::fabs(sum) * 1.0001f; slope_[p] = (float)best * 1.0001f;   // margin for float rounding
+        }
+    }
+
+    void push(const float* l, const float* r, size_t n, double t){
+        for(size_t off=0; off<n; off+=kSub){
+            size_t m = std::min(kSub, n-off); double ts = t + (double)off/sr_;
+            feed(ch_[0], 0, l+off, m, ts); feed(ch_[1], 1, r+off, m, ts);
+        }
+    }
+
+    // Input discontinuity: open runs end, and the next 11 samples only refill
+    // the history, so the jump from the old history does not ring.
+    void gap(){ for(int c=0;c<2;++c){ close(ch_[c], c); ch_[c].need = kHist; } }
+
+    void reset(){ for(auto& c : ch_) c = Chan(); tp_ = 0; sp_ = 0; clips_ = ClipStats(); skipped_ = 0; scanned_ = 0; }
+
+    void finish(Metrics& m, ClipStats& clips){
+        gap();
+        m.true_peak_dbtp = 20*std::log10(std::max(tp_, 1e-6f)); m.sample_peak_dbfs = 20*std::log10(std::max(sp_, 1e-6f));
+        clips = clips_;
+    }
+
+    uint64_t skipped() const { return skipped_; }   // sub-blocks (per channel) ruled out by the bound
+    uint64_t scanned() const { return scanned_; }
+
+private:
+    struct Chan {
+        float hist[kHist] = {};
+        size_t need = kHist;            // samples still to go into hist before interpolating
+        bool open = false; double run_t = 0; uint32_t run_pts = 0, below = 0; float run_pk = 0;
+    };
+
+    void feed(Chan& h, int c, const float* x, size_t m, double t){
+        float pk = 0, st = 0; step_(x, m, pk, st);
+        sp_ = std::max(sp_, pk);
+        if(h.need){
+            size_t k = std::min(m, h.need); slide(h, x, k); h.need -= k;
+            x += k; m -= k; t += (double)k/sr_;
+            if(!m) return;
+        }
+        float P = pk, D = std::max(st, std::fabs(x[0]-h.hist[kHist-1]));
+        for(size_t k=0;k<kHist;++k){ P = std::max(P, std::fabs(h.hist[k])); if(k) D = std::max(D, std::fabs(h.hist[k]-h.hist[k-1])); }
+        float bound = 0; for(int p=0;p<4;++p) bound = std::max(bound, gain_[p]*P + slope_[p]*D);
+        if(bound < std::min(tp_, (float)ClipStats::kLevel)){
+            ++skipped_; close(h, c); slide(h, x, m);
+            return;
+        }
+        ++scanned_;
+        float* b = buf_.data();
+        std::copy(h.hist, h.hist+kHist, b); std::copy(x, x+m, b+kHist);
+        float tp = interp_(b+kHist, m);
+        tp_ = std::max(tp_, tp);
+        if(tp >= ClipStats::kLevel) runs(h, c, b+kHist, m, t); else close(h, c);
+        std::copy(b+m, b+m+kHist, h.hist);
+    }
+
+    // Appends x[0..m) to the history.
+    static void slide(Chan& h, const float* x, size_t m){
+        if(m >= kHist) std::copy(x+m-kHist, x+m, h.hist);
+        else { std::copy(h.hist+m, h.hist+kHist, h.hist); std::copy(x, x+m, h.hist+kHist-m); }
+    }
+
+    // Point (i, p) is centred near input i-5-p/4 (the taps' group delay). A
+    // flat clipped top ripples around 0 dBTP after interpolation, so dips of
+    // up to two input samples do not end a run.
+    void runs(Chan& h, int c, const float* x, size_t m, double t){
+        for(size_t i=0;i<m;++i) for(int p=0;p<4;++p){
+            float y=0; for(int k=0;k<12;++k) y += kInterp4[p][k]*x[(ptrdiff_t)i-11+k];
+            y = std::fabs(y);
+            if(y >= ClipStats::kLevel){
+                if(!h.open){ h.open = true; h.run_t = t + ((double)i - 5 - 0.25*p)/sr_; h.run_pts = 0; h.below = 0; h.run_pk = 0; }
+                h.run_pts += h.below + 1; h.below = 0; h.run_pk = std::max(h.run_pk, y);
+            } else if(h.open && ++h.below >= 8) close(h, c);
+        }
+    }
+
+    void close(Chan& h, int c){
+        if(!h.open) return;
+        ClipRun r; r.t_s = std::max(0.0, h.run_t); r.samples = (h.run_pts+3)/4; r.channel = c; r.peak_dbtp = 20*std::log10(h.run_pk);
+        clips_.add(r); h.open = false;
+    }
+
+    int sr_;
+    PeakStepFn step_;
+    Interp4PeakFn interp_;
+    float gain_[4], slope_[4];          // per phase: |sum h| and min over c of sum |h_k| |k-c|
+    std::vector<float> buf_;            // history + one sub-block
+    Chan ch_[2];
+    float tp_ = 0, sp_ = 0;             // running true / sample peak over both channels
+    ClipStats clips_;
+    uint64_t skipped_ = 0, scanned_ = 0;
+};
+
+// Progressive classification (--early-exit): every check_s seconds of input
+// the running average spectrum and the block statistics so far are turned
+// into Metrics and classified. The decoder is stopped once the verdict has
+// been unchanged for settle_s seconds and classify_margin(), with each
+// metric's spread over that span as its drift, is at least 1.
+class ProgressiveClassifier {
+public:
+    ProgressiveClassifier(double settle_s, double check_s, int sr, double band_scale = 1.0)
+        : settle_(settle_s), sr_(sr), band_scale_(band_scale), step_((uint64_t)std::max(1.0, check_s*sr)), next_(step_) {}
+
+    bool due(uint64_t samples) const { return samples >= next_; }
+
+    // True when decoding can stop after `samples` analyzed samples.
+    bool check(const SpectralAccumulator& spec, const DynamicAccumulator& dyn, uint64_t samples){
+        next_ = samples + step_;
+        if(spec.frames()==0 || dyn.summary().crest.empty()) return false;   // no full crest block yet
+        Point p; p.t = (double)samples/sr_;
+        p.m = analyze_metrics(spec.average(), band_scale_); dyn.summary().finish(p.m); p.cls = classify(p.m);
+        ++checks_;
+        if(!span_.empty() && span_.back().cls != p.cls) span_.clear();      // verdict changed: start over
+        span_.push_back(p);
+        while(span_.size() > 1 && p.t - span_[1].t >= settle_) span_.pop_front();
+        if(p.t - span_.front().t < settle_) return false;
+        Metrics lo = p.m, hi = p.m, spread;
+        for(const Point& q : span_) for(size_t i=0;i<kFields;++i){ lo.*kField[i] = std::min(lo.*kField[i], q.m.*kField[i]); hi.*kField[i] = std::max(hi.*kField[i], q.m.*kField[i]); }
+        for(size_t i=0;i<kFields;++i) spread.*kField[i] = hi.*kField[i] - lo.*kField[i];
+        margin_ = classify_margin(p.m, spread);
+        if(margin_ < 1.0) return false;
+        stopped_at_ = p.t;
+        return true;
+    }
+
+    int checks() const { return checks_; }
+    double stopped_at_s() const { return stopped_at_; }   // 0 = never settled
+    double margin() const { return margin_; }
+
+private:
+    struct Point { double t = 0; Metrics m; std::string cls; };
+    static constexpr size_t kFields = 9;
+    static constexpr double Metrics::* kField[kFields] = { &Metrics::cutoff_hz, &Metrics::cutoff_drop_db, &Metrics::max_drop_db, &Metrics::max_drop_hz, &Metrics::noise_floor_30_50,
+                                                           &Metrics::noise_floor_50_80, &Metrics::noise_rise_db, &Metrics::crest_median_db, &Metrics::dr_like_db };
+    double settle_; int sr_; double band_scale_; uint64_t step_, next_;
+    std::deque<Point> span_;            // checks since the verdict last changed, trimmed to settle_
+    int checks_ = 0;
+    double stopped_at_ = 0, margin_ = 0;
+};
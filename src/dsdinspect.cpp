@@ -0,0 +1,210 @@
+// libdsdinspect public API (dsdinspect.h) over the internals in core.h.
+#include "dsdinspect.h"
+#include "core.h"
+
+#include <cmath>
+#include <optional>
+
+namespace dsdinspect {
+
+const char* version(){ return "1.6"; }
+
+bool operator==(const AnalyzerOptions& a, const AnalyzerOptions& b){
+    return a.target_sr==b.target_sr && a.fft_size==b.fft_size && a.hop_size==b.hop_size && a.adaptive_rate==b.adaptive_rate && a.seconds==b.seconds
+        && a.sample_windows==b.sample_windows && a.sample_seconds==b.sample_seconds && a.threads==b.threads
+        && a.native_reader==b.native_reader && a.native_decimator==b.native_decimator && a.simd==b.simd && a.fft_double==b.fft_double
+        && a.spectrogram==b.spectrogram && a.stereo_spectra==b.stereo_spectra
+        && a.spec_width==b.spec_width && a.spec_mean==b.spec_mean && a.spec_logf==b.spec_logf
+        && a.settle_s==b.settle_s && a.check_s==b.check_s && a.pipeline==b.pipeline;
+}
+
+// The STFT pool and accumulators are built on first use and reset between
+// files, so FFTW planning, fftw_malloc'd buffers and thread start-up happen
+// once per Analyzer rather than once per file. With adaptive_rate the
+// spectral side is rebuilt when a file's DSD rate differs from the last one.
+struct Analyzer::Impl {
+    AnalyzerOptions opt;
+    std::mutex mu;
+    std::unique_ptr<ThreadPool> pool;
+    int mult = 0;                               // rate multiple accM and fpa are built for
+    std::optional<SpectralAccumulator> accM;   // stereo mode when stereo_spectra (mono + L/R from one FFT)
+    std::optional<DynamicAccumulator> dyn;
+    std::optional<TruePeakDetector> tp;
+    std::optional<FingerprintAccumulator> fpa;  // fed the mono frames by accM
+    std::optional<PcmDecimator> lo;             // mult > 1: the PCM at target_sr for dyn and tp
+
+    // DSDn / DSD64 when adaptive_rate is set and the native reader took the file (d); 1 otherwise.
+    int rate_multiple(const DsdFile* d) const {
+        if(!opt.adaptive_rate || !d) return 1;
+        int m = 1; while((int64_t)d->dsd_rate >= (int64_t)2822400*2*m) m *= 2;
+        return m;
+    }
+
+    void setup(int m){
+        if(!pool){
+            pool.reset(new ThreadPool(opt.threads));
+            dyn.emplace(opt.target_sr, true, opt.simd);
+            tp.emplace(opt.target_sr, opt.simd);
+        }
+        if(m == mult) return;
+        mult = m;
+        SpectrogramLayout lay; lay.width = opt.spec_width; lay.mean = opt.spec_mean; lay.logf = opt.spec_logf;
+        accM.emplace(opt.target_sr*m, opt.fft_size*m, opt.hop_size*m, opt.spectrogram, pool.get(), opt.fft_double, opt.simd, lay, opt.stereo_spectra);
+        fpa.emplace(opt.target_sr*m, opt.fft_size*m, opt.hop_size*m);
+        accM->set_frame_sink([this](const float* db){ fpa->frame(db); });
+        if(m > 1) lo.emplace(opt.target_sr*m, m, opt.simd); else lo.reset();
+    }
+
+    void reset(){
+        accM->reset(); dyn->reset(); tp->reset(); fpa->reset();
+        if(lo) lo->reset();
+    }
+
+    Options decode_options(const std::string& path) const {
+        Options o; o.input = path;
+        o.target_sr = opt.target_sr*mult; o.fft_size = opt.fft_size*mult; o.hop_size = opt.hop_size*mult; o.seconds = opt.seconds;
+        o.sample_windows = opt.sample_windows; o.sample_seconds = opt.sample_seconds; o.threads = opt.threads;
+        o.native_reader = opt.native_reader; o.native_decimator = opt.native_decimator; o.simd = opt.simd; o.fft_double = opt.fft_double;
+        return o;
+    }
+};
+
+Analyzer::Analyzer(const AnalyzerOptions& opt) : impl_(new Impl) {
+    if(opt.target_sr <= 0 || opt.fft_size < 2 || opt.hop_size < 1) throw std::runtime_error("dsdinspect: bad analyzer options");
+    impl_->opt = opt;
+}
+Analyzer::~Analyzer() = default;
+Analyzer::Analyzer(Analyzer&&) noexcept = default;
+Analyzer& Analyzer::operator=(Analyzer&&) noexcept = default;
+
+const AnalyzerOptions& Analyzer::options() const { return impl_->opt; }
+
+// Stage timers (decode, stft, metrics) report to the caller's Profile when
+// one is bound to this thread with ProfileScope. With opt.pipeline the file
+// is decoded by decode_pipelined() on a second thread while this one runs the
+// STFT and metrics on the previous batch.
+Result Analyzer::analyze(const std::string& path){
+    Impl& s = *impl_;
+    std::lock_guard<std::mutex> lk(s.mu);
+    DsdFile dsd;    // opened once here, for the rate and for the decoder
+    DsdFile* native = nullptr;
+    { StageTimer st("decode"); if(s.opt.native_reader && open_dsd_file(path, dsd)) native = &dsd; }
+    const int m = s.rate_multiple(native);
+    s.setup(m);
+    s.reset();
+    const bool stereo = s.opt.stereo_spectra;
+    std::optional<ProgressiveClassifier> prog;
+    if(s.opt.settle_s > 0) prog.emplace(s.opt.settle_s, s.opt.check_s, s.opt.target_sr*m, (double)m);
+    Result r;
+    // true: enough was seen (progressive mode)
+    auto feed = [&](const AudioBlock& b){
+        if(b.discontinuity){ s.accM->gap(); s.dyn->gap(); s.tp->gap(); s.fpa->gap(); if(s.lo) s.lo->reset(); }
+        { StageTimer st("stft"); if(stereo) s.accM->push(b.left, b.right, b.n); else s.accM->push(b.mono, b.n); }
+        const float *L = b.left, *R = b.right, *M = b.mono; size_t n = b.n; double t = b.t;
+        if(s.lo){ StageTimer st("resample"); n = s.lo->push(b.left, b.right, b.n, b.t); L = s.lo->left(); R = s.lo->right(); M = s.lo->mono(); t = s.lo->t(); }
+        { StageTimer st("metrics"); s.dyn->push(M, L, R, n); }
+        { StageTimer st("true-peak"); s.tp->push(L, R, n, t); }
+        r.samples += b.n;
+        if(prog && prog->due(r.samples)){ StageTimer st("metrics"); return prog->check(*s.accM, *s.dyn, r.samples); }
+        return false;
+    };
+    if(s.opt.pipeline) r.info = decode_pipelined(s.decode_options(path), native, feed);
+    else { StageTimer st("decode"); r.info = decode_stream(s.decode_options(path), native, [&](const AudioBlock& b){ b.stop = feed(b); }); }
+    if(prog && prog->stopped_at_s() > 0){ r.info.stopped_at_s = prog->stopped_at_s(); r.info.stop_margin = prog->margin(); }
+    { StageTimer st("stft"); r.mono = stereo ? s.accM->finish(&r.left, &r.right) : s.accM->finish(); s.fpa->finish(r.mono, r.fingerprint); }
+    { StageTimer st("metrics"); r.metrics = analyze_metrics(r.mono, m); s.dyn->finish(r.metrics); s.tp->finish(r.metrics, r.clips); r.classification = classify(r.metrics); }
+    r.fft_frames = s.accM->frames();
+    r.dynamics = s.dyn->summary(0); r.dynamics_left = s.dyn->summary(1); r.dynamics_right = s.dyn->summary(2);
+    return r;
+}
+
+// ----------------- Album merge -----------------
+int32_t DynamicsSummary::bin(double db){ return (int32_t)std::lround(std::clamp(db, -1000.0, 1000.0) / kStepDb); }
+
+void DynamicsSummary::merge(const DynamicsSummary& o){
+    for(const auto& kv : o.crest) crest[kv.first] += kv.second;
+    for(const auto& kv : o.peak) peak[kv.first] += kv.second;
+    for(const auto& kv : o.rms) rms[kv.first] += kv.second;
+}
+
+// Value of the rank-th smallest block (0-based), as the bin centre.
+static double at_rank(const std::map<int32_t, uint32_t>& h, uint64_t rank){
+    for(const auto& kv : h){ if(rank < kv.second) return kv.first * DynamicsSummary::kStepDb; rank -= kv.second; }
+    return h.empty() ? -120.0 : h.rbegin()->first * DynamicsSummary::kStepDb;
+}
+static uint64_t total(const std::map<int32_t, uint32_t>& h){ uint64_t n=0; for(const auto& kv : h) n += kv.second; return n; }
+
+// Same ranks as DynamicAccumulator::finish(): the middle crest block, and the
+// 95th-percentile peak minus the median RMS of the 1 s blocks.
+void DynamicsSummary::finish(double& crest_median_db, double& dr_like_db) const {
+    if(uint64_t n = total(crest)) crest_median_db = at_rank(crest, n/2);
+    auto perc = [](const std::map<int32_t, uint32_t>& h, double p){
+        uint64_t n = total(h); if(!n) return -120.0;
+        return at_rank(h, (uint64_t)std::clamp(p*(n-1), 0.0, (double)(n-1)));
+    };
+    dr_like_db = perc(peak, 0.95) - perc(rms, 0.50);
+}
+
+int ClipStats::bin(uint32_t samples){
+    int b = 0; while(b < kBins-1 && samples > (1u<<b)) ++b;
+    return b;
+}
+const char* ClipStats::bin_label(int b){
+    static const char* const labels[kBins] = { "1", "2", "3-4", "5-8", "9-16", "17-32", "33-64", ">64" };
+    return labels[std::clamp(b, 0, kBins-1)];
+}
+
+// Frame-weighted sum into acc; divided by acc.frames at the end. With
+// adaptive_rate, fft and hop scale together, so every rate has the same bin
+// width and a lower-rate spectrum is a prefix of a higher-rate one: tracks
+// are merged over the bins they share.
+static void add_spectrum(SpectralOutputs& acc, const SpectralOutputs& s){
+    if(s.frames == 0 || s.avg_mag_db.empty()) return;
+    if(acc.frames == 0){ acc.freq = s.freq; acc.avg_mag_db.assign(s.avg_mag_db.size(), 0.0); }
+    else if(acc.avg_mag_db.size() > s.avg_mag_db.size()){ acc.freq.resize(s.freq.size()); acc.avg_mag_db.resize(s.avg_mag_db.size()); }
+    for(size_t k=0;k<acc.avg_mag_db.size();++k) acc.avg_mag_db[k] += s.avg_mag_db[k] * (double)s.frames;
+    acc.frames += s.frames;
+}
+static void finish_spectrum(SpectralOutputs& acc){ if(acc.frames) for(double& v : acc.avg_mag_db) v /= (double)acc.frames; }
+
+Result merge_album(const std::vector<Result>& tracks){
+    Result a;
+    if(tracks.empty()) return a;
+    a.info = tracks[0].info; a.info.samples = 0; a.info.windows = 0; a.info.stopped_at_s = 0; a.info.stop_margin = 0;
+    double duration = 0, analyzed_s = 0;
+    bool stopped = false;
+    size_t ny = 0;      // the track with the fewest bins sets the merged Nyquist
+    for(size_t ti=1; ti<tracks.size(); ++ti){
+        const SpectralOutputs& m = tracks[ti].mono;
+        if(m.frames && !m.avg_mag_db.empty() && (!tracks[ny].mono.frames || m.avg_mag_db.size() < tracks[ny].mono.avg_mag_db.size())) ny = ti;
+    }
+    a.info.out_sr = tracks[ny].info.out_sr;
+    a.metrics.true_peak_dbtp = a.metrics.sample_peak_dbfs = -120.0;
+    for(size_t ti=0; ti<tracks.size(); ++ti){
+        const Result& t = tracks[ti];
+        a.metrics.true_peak_dbtp = std::max(a.metrics.true_peak_dbtp, t.metrics.true_peak_dbtp);
+        a.metrics.sample_peak_dbfs = std::max(a.metrics.sample_peak_dbfs, t.metrics.sample_peak_dbfs);
+        a.clips.runs += t.clips.runs; a.clips.samples += t.clips.samples;
+        for(int b=0;b<ClipStats::kBins;++b) a.clips.hist[b] += t.clips.hist[b];
+        for(ClipRun c : t.clips.first) if(a.clips.first.size() < ClipStats::kMaxRuns){ c.track = (int)ti; a.clips.first.push_back(c); }
+        if(t.info.stopped_at_s > 0){ a.info.stop_margin = stopped ? std::min(a.info.stop_margin, t.info.stop_margin) : t.info.stop_margin; stopped = true; }
+        add_spectrum(a.mono, t.mono); add_spectrum(a.left, t.left); add_spectrum(a.right, t.right);
+        a.dynamics.merge(t.dynamics); a.dynamics_left.merge(t.dynamics_left); a.dynamics_right.merge(t.dynamics_right);
+        a.samples += t.samples; a.fft_frames += t.fft_frames; a.info.windows += t.info.windows;
+        duration += t.info.duration_s();
+        if(t.info.out_sr > 0) analyzed_s += (double)t.samples / t.info.out_sr;
+    }
+    finish_spectrum(a.mono); finish_spectrum(a.left); finish_spectrum(a.right);
+    if(a.info.in_rate > 0) a.info.samples = (uint64_t)std::llround(duration * a.info.in_rate);
+    if(stopped) a.info.stopped_at_s = analyzed_s;   // seconds analyzed over all tracks
+    Metrics peaks = a.metrics;
+    a.metrics = analyze_metrics(a.mono, tracks[ny].metrics.noise_band_scale);
+    a.metrics.true_peak_dbtp = peaks.true_peak_dbtp; a.metrics.sample_peak_dbfs = peaks.sample_peak_dbfs;
+    a.dynamics.finish(a.metrics);
+    a.dynamics_left.finish(a.metrics.crest_median_l_db, a.metrics.dr_like_l_db);
+    a.dynamics_right.finish(a.metrics.crest_median_r_db, a.metrics.dr_like_r_db);
+    a.classification = classify(a.metrics);
+    return a;
+}
+
+} // namespace dsdinspect
@@ -0,0 +1,205 @@
+// libdsdinspect — DSD/PCM decode, spectral analysis, metrics and
+// classification as a library. dsd_inspector is a client of this API; the
+// types here only use the standard library, so callers need no FFmpeg or
+// FFTW headers.
+//
+//   dsdinspect::AnalyzerOptions o; o.seconds = 0;
+//   dsdinspect::Analyzer an(o);
+//   for(const std::string& path : files){
+//       dsdinspect::Result r = an.analyze(path);
+//       std::cout << path << ": " << r.classification << "\n";
+//   }
+//
+// An Analyzer keeps its FFTW plans, STFT buffers and worker threads between
+// calls, so analyzing many files through one instance skips the per-file
+// setup. Calls on one instance are serialized; use one instance per thread
+// to analyze in parallel. Errors are reported as std::runtime_error.
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace dsdinspect {
+
+// Library version; bumped when Result fields or metric definitions change.
+const char* version();
+
+// Source stream properties, filled by whichever decode path handled the file.
+struct StreamInfo {
+    std::string container;       // "dsf", "dff" or the FFmpeg demuxer's view
+    int channels = 0;
+    int in_rate = 0;             // codec sample rate (DSD: bit rate per channel)
+    uint64_t samples = 0;        // per channel at in_rate (0 = unknown)
+    int out_sr = 0;
+    std::string decimator;       // how DSD/PCM was brought to out_sr
+    int windows = 0;             // --sample windows decoded (0 = read from the start)
+    double stopped_at_s = 0;     // progressive mode: analyzed seconds when decoding stopped early (0 = ran to the limit)
+    double stop_margin = 0;      // classification margin at that point (see AnalyzerOptions::settle_s)
+    double duration_s() const { return (in_rate>0 && samples>0) ? (double)samples/in_rate : 0.0; }
+};
+
+struct SpectralOutputs{
+    std::vector<double> freq;       // Hz
+    std::vector<double> avg_mag_db; // dBFS
+    std::vector<unsigned char> spectrogram_png; // grayscale heat
+    int spec_w=0, spec_h=0;
+    bool spec_logf=false;           // rows on the log-f scale of logf_pos()
+    uint64_t frames=0;              // STFT frames averaged into avg_mag_db
+};
+
+struct Metrics { double cutoff_hz=0.0, cutoff_drop_db=0.0, noise_floor_30_50=0.0, noise_floor_50_80=0.0, noise_rise_db=0.0, crest_median_db=0.0, dr_like_db=0.0;
+                 double crest_median_l_db=0.0, crest_median_r_db=0.0, dr_like_l_db=0.0, dr_like_r_db=0.0;   // per channel; classify() uses the mono values
+                 double true_peak_dbtp=0.0, sample_peak_dbfs=0.0;     // max over L/R, 4x oversampled / at target_sr
+                 double noise_band_scale=1.0;   // the noise floors are over 30-50 and 50-80 kHz times this (AnalyzerOptions::adaptive_rate)
+                 double max_drop_db=0.0, max_drop_hz=0.0; };   // steepest 1 kHz drop above 15 kHz, cutoff or not (the cutoff is this when below -18 dB)
+
+// Runs of 4x-oversampled L or R points at or above 0 dBTP (ClipStats::kLevel).
+struct ClipRun {
+    double t_s = 0;              // source time of the first point (s)
+    uint32_t samples = 0;        // length in samples at target_sr (4 points each, rounded up)
+    int channel = 0;             // 0 = L, 1 = R
+    double peak_dbtp = 0;
+    int track = 0;               // merge_album(): index of the track
+};
+
+// Clip runs of a file: a histogram of every run's length and the positions
+// of the first kMaxRuns.
+struct ClipStats {
+    static constexpr double kLevel = 1.0;
+    static constexpr int kBins = 8;             // 1, 2, 3-4, 5-8, 9-16, 17-32, 33-64, >64 samples
+    static constexpr size_t kMaxRuns = 100;
+    uint64_t runs = 0, samples = 0;             // all runs, and their total length
+    uint64_t hist[kBins] = {};
+    std::vector<ClipRun> first;                 // in the order they ended
+
+    void add(const ClipRun& r){ ++runs; samples += r.samples; ++hist[bin(r.samples)]; if(first.size() < kMaxRuns) first.push_back(r); }
+    static int bin(uint32_t samples);
+    static const char* bin_label(int b);
+};
+
+// Mergeable form of the block statistics behind crest_median_db (3 s blocks)
+// and dr_like_db (1 s blocks): sparse histograms of the per-block values in
+// 0.01 dB bins. Summaries of several tracks add up, so album percentiles are
+// read from the counts instead of re-sorting every block; they match the
+// per-file metrics to within half a bin.
+struct DynamicsSummary {
+    static constexpr double kStepDb = 0.01;
+    std::map<int32_t, uint32_t> crest, peak, rms;   // bin (dB / kStepDb) -> blocks
+
+    void add_crest(double db){ ++crest[bin(db)]; }
+    void add_level(double peak_db, double rms_db){ ++peak[bin(peak_db)]; ++rms[bin(rms_db)]; }
+    void merge(const DynamicsSummary& o);
+    void clear(){ crest.clear(); peak.clear(); rms.clear(); }
+    // Sets crest_median_db and dr_like_db the way the per-file path does.
+    void finish(Metrics& m) const { finish(m.crest_median_db, m.dr_like_db); }
+    void finish(double& crest_median_db, double& dr_like_db) const;
+
+    static int32_t bin(double db);
+};
+
+// Compact description of a track for duplicate search. bits: the sign of
+// how the energy difference between neighbouring bands (9 log bands, 150 Hz
+// to 8 kHz) changes from one 1 s segment to the next, over the first 33 s
+// after the music starts; mask marks the bits that were measured (a short,
+// early-stopped or --sample analysis fills fewer, and sampled ones none).
+// profile: the average spectrum in 64 log bands from 20 Hz to 88.2 kHz, mean
+// removed, in 0.5 dB steps. The bits identify the recording whatever the
+// chain; the profile tells a native DSD copy from a PCM re-encode.
+struct Fingerprint {
+    static constexpr int kWords = 4, kBands = 64;
+    uint64_t bits[kWords] = {}, mask[kWords] = {};
+    int8_t profile[kBands] = {};
+    bool valid = false;          // set once the profile has been filled
+};
+
+// Analysis settings; the defaults match dsd_inspector's.
+struct AnalyzerOptions {
+    int target_sr = 176400;      // PCM rate everything is analyzed at
+    int fft_size  = 4096;
+    int hop_size  = 2048;
+    // Scale the three above with the DSD rate (they are then the DSD64
+    // values): DSDn is analyzed at target_sr*n/64 with fft_size and hop_size
+    // scaled alike, so the bin width and frame count stay the same, and the
+    // noise bands stretch by n/64 (Metrics::noise_band_scale). Dynamics and
+    // peaks are still measured at target_sr, on a half-band decimated copy.
+    // Only files read by the native DSF/DFF reader are scaled.
+    bool adaptive_rate = false;
+    int seconds   = 180;         // analyze first N seconds (0 = whole file)
+    int sample_windows = 0;      // K windows of sample_seconds spread over the file
+    double sample_seconds = 0;
+    int threads   = 0;           // STFT worker threads (0 = all cores)
+    bool native_reader = true;   // parse DSF/DFF directly (FFmpeg demuxer otherwise)
+    bool native_decimator = true; // built-in DSD->PCM (libavcodec dsd + swresample otherwise)
+    bool simd = true;            // AVX2/NEON kernels when the CPU has them
+    bool fft_double = false;     // double-precision STFT
+    bool spectrogram = true;     // fill Result::mono's spectrogram image
+    bool stereo_spectra = true;  // also compute the L/R average spectra
+    int spec_width = 0;          // spectrogram columns (0 = one per FFT frame)
+    bool spec_mean = false;      // merge frames by mean power instead of max-hold
+    bool spec_logf = false;      // log-frequency spectrogram rows
+    // Progressive mode: every check_s seconds the running spectrum is
+    // classified, and decoding stops once the verdict has been unchanged and
+    // at least one tolerance clear of every threshold it depends on (after
+    // allowing for each metric's drift) for settle_s seconds. 0 = off.
+    double settle_s = 0;
+    double check_s = 5;
+    bool pipeline = true;        // decode on a second thread, ahead of the STFT (results are identical)
+};
+
+bool operator==(const AnalyzerOptions& a, const AnalyzerOptions& b);
+inline bool operator!=(const AnalyzerOptions& a, const AnalyzerOptions& b){ return !(a == b); }
+
+struct Result {
+    StreamInfo info;
+    Metrics metrics;
+    std::string classification;
+    uint64_t samples = 0;        // analyzed samples at info.out_sr
+    uint64_t fft_frames = 0;     // STFT transforms (one per frame; L/R share it)
+    SpectralOutputs mono;        // average spectrum (+ spectrogram image)
+    SpectralOutputs left, right; // average spectra only, when stereo_spectra
+    DynamicsSummary dynamics;    // mono block statistics, for merge_album()
+    DynamicsSummary dynamics_left, dynamics_right;
+    ClipStats clips;             // 0 dBTP overs of L and R
+    Fingerprint fingerprint;
+};
+
+class Analyzer {
+public:
+    explicit Analyzer(const AnalyzerOptions& opt = AnalyzerOptions());
+    ~Analyzer();
+    Analyzer(Analyzer&&) noexcept;
+    Analyzer& operator=(Analyzer&&) noexcept;
+    Analyzer(const Analyzer&) = delete;
+    Analyzer& operator=(const Analyzer&) = delete;
+
+    const AnalyzerOptions& options() const;
+
+    // Decodes and analyzes one file (DSF, DFF or anything FFmpeg reads).
+    Result analyze(const std::string& path);
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> impl_;
+};
+
+// Derived metrics from an average spectrum (cutoff, ultrasonic noise floors);
+// band_scale stretches the noise bands for higher DSD rates.
+Metrics analyze_metrics(const SpectralOutputs& so, double band_scale = 1.0);
+
+// Verdict text for a set of metrics, as printed in report.txt.
+std::string classify(const Metrics& m);
+
+// One Result for a set of tracks analyzed with the same options: the average
+// spectra weighted by each track's frame count (exactly the average over all
+// frames), dynamics from the merged DynamicsSummary, and metrics and
+// classification of the merge. info describes the first track, with the
+// summed duration; if any track stopped early, stopped_at_s is the time
+// analyzed over all tracks and stop_margin the smallest track margin.
+// The peaks are the loudest track's and clip runs are concatenated in track
+// order. Spectrogram images and fingerprints are not merged.
+Result merge_album(const std::vector<Result>& tracks);
+
+} // namespace dsdinspect
@@ -12,671 +12,1547 @@
 #include <iostream>
 #include <optional>
 #include <complex>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <set>
+#include <deque>
+#include <map>
+#include <memory>
+#include <chrono>
+
+#include <csignal>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 extern "C" {
-#include <libavformat/avformat.h>
-#include <libavcodec/avcodec.h>
-#include <libavutil/avutil.h>
-#include <libavutil/opt.h>
-#include <libswresample/swresample.h>
+#include <libavutil/log.h>
 }
 
-#include <fftw3.h>
 #include <zlib.h>
 
-// ----------------- Tiny PNG writers (grayscale & RGB) -----------------
-static bool write_png_gray(const char* filename, int w, int h, const std::vector<unsigned char>& gray) {
-    FILE* f = fopen(filename, "wb");
-    if(!f) return false;
-    auto wr32 = [&](uint32_t v){ unsigned char b[4]={(unsigned char)(v>>24),(unsigned char)(v>>16),(unsigned char)(v>>8),(unsigned char)v}; fwrite(b,1,4,f); };
-    const unsigned char sig[8] = {137,80,78,71,13,10,26,10}; fwrite(sig,1,8,f);
-    unsigned char ihdr[13];
-    ihdr[0]= (w>>24)&255; ihdr[1]=(w>>16)&255; ihdr[2]=(w>>8)&255; ihdr[3]=w&255;
-    ihdr[4]= (h>>24)&255; ihdr[5]=(h>>16)&255; ihdr[6]=(h>>8)&255; ihdr[7]=h&255;
-    ihdr[8]=8; ihdr[9]=0; ihdr[10]=0; ihdr[11]=0; ihdr[12]=0; // grayscale
-    wr32(13); fwrite("IHDR",1,4,f); fwrite(ihdr,1,13,f);
-    { uLong c=crc32(0L,Z_NULL,0); c=crc32(c,(const Bytef*)"IHDR",4); c=crc32(c,ihdr,13); wr32((uint32_t)c); }
-    std::vector<unsigned char> raw; raw.reserve((w+1)*h);
-    for(int y=0;y<h;++y){ raw.push_back(0); raw.insert(raw.end(), gray.begin()+y*w, gray.begin()+y*w+w); }
-    uLongf cb=compressBound(raw.size()); std::vector<unsigned char> comp(cb);
-    if (compress2(comp.data(), &cb, raw.data(), raw.size(), Z_BEST_SPEED) != Z_OK) { fclose(f); return false; }
-    comp.resize(cb);
-    wr32((uint32_t)comp.size()); fwrite("IDAT",1,4,f); fwrite(comp.data(),1,comp.size(),f);
-    { uLong c=crc32(0L,Z_NULL,0); c=crc32(c,(const Bytef*)"IDAT",4); c=crc32(c,comp.data(),comp.size()); wr32((uint32_t)c); }
-    wr32(0); fwrite("IEND",1,4,f); { uLong c=crc32(0L,Z_NULL,0); c=crc32(c,(const Bytef*)"IEND",4); wr32((uint32_t)c); }
-    fclose(f); return true;
-}
-
-static bool write_png_rgb(const char* filename, int w, int h, const std::vector<unsigned char>& rgb){
-    FILE* f=fopen(filename,"wb"); if(!f) return false;
-    auto wr32=[&](uint32_t v){ unsigned char b[4]={(unsigned char)(v>>24),(unsigned char)(v>>16),(unsigned char)(v>>8),(unsigned char)v}; fwrite(b,1,4,f); };
-    const unsigned char sig[8]={137,80,78,71,13,10,26,10}; fwrite(sig,1,8,f);
-    unsigned char ihdr[13]; ihdr[0]=(w>>24)&255; ihdr[1]=(w>>16)&255; ihdr[2]=(w>>8)&255; ihdr[3]=w&255; ihdr[4]=(h>>24)&255; ihdr[5]=(h>>16)&255; ihdr[6]=(h>>8)&255; ihdr[7]=h&255; ihdr[8]=8; ihdr[9]=2; ihdr[10]=0; ihdr[11]=0; ihdr[12]=0; // RGB
-    wr32(13); fwrite("IHDR",1,4,f); fwrite(ihdr,1,13,f); { uLong c=crc32(0L,Z_NULL,0); c=crc32(c,(const Bytef*)"IHDR",4); c=crc32(c,ihdr,13); wr32((uint32_t)c);}    
-    std::vector<unsigned char> raw; raw.reserve((w*3+1)*h); for(int y=0;y<h;++y){ raw.push_back(0); raw.insert(raw.end(), rgb.begin()+y*w*3, rgb.begin()+y*w*3+w*3); }
-    uLongf cb=compressBound(raw.size()); std::vector<unsigned char> comp(cb); if(compress2(comp.data(), &cb, raw.data(), raw.size(), Z_BEST_SPEED)!=Z_OK){ fclose(f); return false;} comp.resize(cb);
-    wr32((uint32_t)comp.size()); fwrite("IDAT",1,4,f); fwrite(comp.data(),1,comp.size(),f); { uLong c=crc32(0L,Z_NULL,0); c=crc32(c,(const Bytef*)"IDAT",4); c=crc32(c,comp.data(),comp.size()); wr32((uint32_t)c);}    
-    wr32(0); fwrite("IEND",1,4,f); { uLong c=crc32(0L,Z_NULL,0); c=crc32(c,(const Bytef*)"IEND",4); wr32((uint32_t)c);} fclose(f); return true;
-}
-// ----------------------------------------------------------------------
-
-static void make_hann(std::vector<double>& w){ const size_t N=w.size(); for(size_t n=0;n<N;++n){ w[n]=0.5*(1.0-std::cos(2*M_PI*n/(N-1))); } }
-
-// ----------------- Minimal RGB drawing helpers -----------------
-struct ImageRGB {
-    int w=0,h=0; std::vector<unsigned char> px; // RGB
-    ImageRGB(){}
-    ImageRGB(int W,int H):w(W),h(H),px(W*H*3,0){}
-    void resize(int W,int H){ w=W; h=H; px.assign(W*H*3,0); }
-    void clear(unsigned char r,unsigned char g,unsigned char b){ for(int i=0;i<w*h;++i){ px[i*3+0]=r; px[i*3+1]=g; px[i*3+2]=b; } }
-    inline void set(int x,int y,unsigned char r,unsigned char g,unsigned char b){ if((unsigned)x<(unsigned)w && (unsigned)y<(unsigned)h){ int o=(y*w+x)*3; px[o]=r; px[o+1]=g; px[o+2]=b; }}
-};
+#include "core.h"
+#include "render.h"
 
-// tiny 5x7 bitmap font (ASCII 32..127)
-static const unsigned char FONT5x7[96][5]={
-{0,0,0,0,0},{0x00,0x00,0x5f,0x00,0x00},{0x00,0x07,0x00,0x07,0x00},{0x14,0x7f,0x14,0x7f,0x14},{0x24,0x2a,0x7f,0x2a,0x12},
-{0x23,0x13,0x08,0x64,0x62},
-{0x36,0x49,0x55,0x22,0x50},
-{0x00,0x05,0x03,0x00,0x00},
-{0x00,0x1c,0x22,0x41,0x00},
-{0x00,0x41,0x22,0x1c,0x00},
-{0x14,0x08,0x3e,0x08,0x14},
-{0x08,0x08,0x3e,0x08,0x08},
-{0x00,0x50,0x30,0x00,0x00},
-{0x08,0x08,0x08,0x08,0x08},
-{0x00,0x60,0x60,0x00,0x00},
-{0x20,0x10,0x08,0x04,0x02},
-{0x3e,0x51,0x49,0x45,0x3e},
-{0x00,0x42,0x7f,0x40,0x00},
-{0x42,0x61,0x51,0x49,0x46},
-{0x21,0x41,0x45,0x4b,0x31},
-{0x18,0x14,0x12,0x7f,0x10},
-{0x27,0x45,0x45,0x45,0x39},{0x3c,0x4a,0x49,0x49,0x30},{0x01,0x71,0x09,0x05,0x03},{0x36,0x49,0x49,0x49,0x36},
-{0x06,0x49,0x49,0x29,0x1e},{0x00,0x36,0x36,0x00,0x00},{0x00,0x56,0x36,0x00,0x00},{0x08,0x14,0x22,0x41,0x00},{0x14,0x14,0x14,0x14,0x14},
-{0x00,0x41,0x22,0x14,0x08},{0x02,0x01,0x51,0x09,0x06},{0x32,0x49,0x79,0x41,0x3e},{0x7e,0x11,0x11,0x11,0x7e},{0x7f,0x49,0x49,0x49,0x36},
-{0x3e,0x41,0x41,0x41,0x22},{0x7f,0x41,0x41,0x22,0x1c},{0x7f,0x49,0x49,0x49,0x41},{0x7f,0x09,0x09,0x09,0x01},{0x3e,0x41,0x49,0x49,0x7a},
-{0x7f,0x08,0x08,0x08,0x7f},{0x00,0x41,0x7f,0x41,0x00},{0x20,0x40,0x41,0x3f,0x01},{0x7f,0x08,0x14,0x22,0x41},{0x7f,0x40,0x40,0x40,0x40},
-{0x7f,0x02,0x0c,0x02,0x7f},{0x7f,0x04,0x08,0x10,0x7f},{0x3e,0x41,0x41,0x41,0x3e},
-{0x7f,0x09,0x09,0x09,0x06},
-{0x3e,0x41,0x51,0x21,0x5e}, // Q
-
-{0x7f,0x09,0x19,0x29,0x46}, // R (FIXED)
-
-{0x46,0x49,0x49,0x49,0x31},
-{0x01,0x01,0x7f,0x01,0x01},
-{0x3f,0x40,0x40,0x40,0x3f},
-{0x1f,0x20,0x40,0x20,0x1f},
-{0x3f,0x40,0x38,0x40,0x3f},
-{0x63,0x14,0x08,0x14,0x63},
-{0x07,0x08,0x70,0x08,0x07},
-{0x61,0x51,0x49,0x45,0x43}, // Z
-
-{0x00,0x7f,0x41,0x41,0x00},// '['
-
-{0x02,0x04,0x08,0x10,0x20}, // '\'
-{0x00,0x41,0x41,0x7f,0x00},
-{0x04,0x02,0x01,0x02,0x04},
-{0x40,0x40,0x40,0x40,0x40},
-{0x00,0x01,0x02,0x04,0x00},
-{0x20,0x54,0x54,0x54,0x78},
-{0x7f,0x48,0x44,0x44,0x38},
-{0x38,0x44,0x44,0x44,0x20},
-{0x38,0x44,0x44,0x48,0x7f},
-{0x38,0x54,0x54,0x54,0x18},{0x08,0x7e,0x09,0x01,0x02},
-{0x0c,0x52,0x52,0x52,0x3e},{0x7f,0x08,0x04,0x04,0x78},{0x00,0x44,0x7d,0x40,0x00},{0x20,0x40,0x44,0x3d,0x00},{0x7f,0x10,0x28,0x44,0x00},
-{0x00,0x41,0x7f,0x40,0x00},{0x7c,0x04,0x18,0x04,0x78},{0x7c,0x08,0x04,0x04,0x78},{0x38,0x44,0x44,0x44,0x38},{0x7c,0x14,0x14,0x14,0x08},
-{0x08,0x14,0x14,0x18,0x7c},{0x7c,0x08,0x04,0x04,0x08},{0x48,0x54,0x54,0x54,0x20},{0x04,0x3f,0x44,0x40,0x20},{0x3c,0x40,0x40,0x20,0x7c},
-{0x1c,0x20,0x40,0x20,0x1c},{0x3c,0x40,0x30,0x40,0x3c},{0x44,0x28,0x10,0x28,0x44},{0x0c,0x50,0x50,0x50,0x3c},{0x44,0x64,0x54,0x4c,0x44},
-{0x00,0x08,0x36,0x41,0x00},{0x00,0x00,0x7f,0x00,0x00},{0x00,0x41,0x36,0x08,0x00},{0x10,0x08,0x08,0x10,0x08}
-};
+// ----------------- Allocation counters (--profile) -----------------
+// Counted per thread into t_allocs/t_alloc_bytes (core.h), which StageTimer
+// and ProfileScope read.
+void* operator new(size_t n){ ++t_allocs; t_alloc_bytes += n; if(void* p = std::malloc(n ? n : 1)) return p; throw std::bad_alloc(); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+
+// ----------------- Usage -----------------
+static void usage(){
+    std::cout << "\nDSD Inspector — spectrum, noise-shaping, DR\n\n"              << "Usage: dsd_inspector -i <input.dsf|dff|flac|wav> [--out outdir] [--sr 176400|auto] [--fft 4096] [--hop 2048] [--sec 180 | --sample K:D] [--early-exit S] [--early-exit-check 5] [--threads N] [--png-level 0-9] [--reader native|ffmpeg] [--decimator native|ffmpeg] [--no-simd] [--fft-precision float|double] [--spec-width N] [--spec-agg max|mean] [--spec-freq linear|log] [--compare-decimators] [--check-fft] [--check-sample] [--profile] [--no-pretty] [--no-pipeline]\n"
+              << "       dsd_inspector -i <folder> --album [--include-dff] [--out outdir] [analysis options]\n"
+              << "       dsd_inspector --tree <root> [--out outroot] [--include-dff] [--force] [--hash] [--reclassify] [--album] [--jobs N] [--max-decodes N] [--profile] [analysis options]\n"
+              << "       dsd_inspector --watch <root> [--debounce 5] [--poll S] [tree options]\n"
+              << "       dsd_inspector --find-similar <file> [--index OUTROOT/fingerprints.idx | --out outroot] [--top 10] [analysis options]\n\n";
+}
 
-static_assert(sizeof(FONT5x7)/sizeof(FONT5x7[0]) == 96, "FONT5x7 must have 96 rows");
+// ----------------- Reports -----------------
+// --sr auto: how much the file's rate, FFT size and hop were scaled by (1 otherwise).
+static int rate_scale(const Options& o, const StreamInfo& si){ return (o.adaptive_sr && si.out_sr > o.target_sr) ? si.out_sr / o.target_sr : 1; }
 
-// spot checks for common culprits
-//static_assert(FONT5x7['A' - 32][0] == 0x7e, "'A' glyph wrong");
-//static_assert(FONT5x7['R' - 32][0] == 0x7f, "'R' glyph wrong");
-//static_assert(FONT5x7['S' - 32][0] == 0x46, "'S' glyph wrong");
-//static_assert(FONT5x7['p' - 32][0] == 0x7c, "'p' glyph wrong");
+// "30–50 kHz" for the noise band lo..hi kHz, stretched with --sr auto.
+static std::string noise_band(const Metrics& m, int lo, int hi){
+    return std::to_string((int)std::lround(lo*m.noise_band_scale)) + "–" + std::to_string((int)std::lround(hi*m.noise_band_scale)) + " kHz";
+}
 
-// Replace any non-ASCII bytes with '?' so our 5x7 font never sees UTF-8.
-static std::string ascii_sanitize(const std::string& s){
-    std::string out; out.reserve(s.size());
-    for (unsigned char ch : s){
-        out.push_back((ch >= 32 && ch <= 126) ? char(ch) : '?');
+// Album mode: one line per track; tracks whose verdict (the classification
+// without the compression note) differs from the album's are flagged.
+struct TrackSummary {
+    std::string file;
+    StreamInfo info;
+    Metrics m;
+    std::string cls;
+    std::string error;           // empty when the track was analyzed
+    Fingerprint fp;
+};
+
+static std::string cls_verdict(const std::string& cls){ return cls.substr(0, cls.find(';')); }
+
+static void save_report_tracks(std::ostream& f, const std::vector<TrackSummary>& tracks, const std::string& album_cls){
+    size_t outliers = 0;
+    f << "\nTracks (" << tracks.size() << ", merged with frame-weighted spectra and pooled dynamics blocks; * = classified differently):\n";
+    for(const auto& t : tracks){
+        std::string name = std::filesystem::path(t.file).filename().string();
+        if(!t.error.empty()){ f << "  ! " << name << ": failed: " << t.error << "\n"; continue; }
+        bool out = cls_verdict(t.cls) != cls_verdict(album_cls); outliers += out;
+        f << (out ? "  * " : "    ") << name << ": " << t.info.duration_s() << " s, " << t.info.in_rate << " Hz; cutoff ";
+        if(t.m.cutoff_hz>0) f << t.m.cutoff_hz << " Hz"; else f << "none";
+        f << "; noise rise " << t.m.noise_rise_db << " dB; crest " << t.m.crest_median_db << " dB; DR-like " << t.m.dr_like_db << " dB; true peak " << t.m.true_peak_dbtp << " dBTP";
+        if(t.info.stopped_at_s>0) f << "; stopped after " << t.info.stopped_at_s << " s";
+        f << "\n      " << t.cls << "\n";
     }
-    return out;
+    f << "Outliers: " << outliers << " of " << tracks.size() << " tracks\n";
 }
+// Clip runs: the length histogram, then the first positions (all of them are in report.json).
+static void save_report_clips(std::ostream& f, const ClipStats& c, const std::vector<TrackSummary>* tracks){
+    f << "— Clip runs at or above 0 dBTP (4x oversampled): ";
+    if(!c.runs){ f << "none\n"; return; }
+    f << c.runs << " (" << c.samples << " samples)\n    lengths:";
+    for(int b=0;b<ClipStats::kBins;++b) if(c.hist[b]) f << "  " << ClipStats::bin_label(b) << ": " << c.hist[b];
+    f << "\n";
+    const size_t shown = std::min<size_t>(c.first.size(), 20);
+    for(size_t i=0;i<shown;++i){
+        const ClipRun& r = c.first[i];
+        f << "    " << (r.channel ? "R" : "L") << " at " << r.t_s << " s";
+        if(tracks && r.track < (int)tracks->size()) f << " of " << std::filesystem::path((*tracks)[r.track].file).filename().string();
+        f << ": " << r.samples << " samples, " << r.peak_dbtp << " dBTP\n";
+    }
+    if(c.runs > shown) f << "    … " << (c.runs - shown) << " more\n";
+}
+static void save_report(const std::string& path, const Options& opt, const StreamInfo& si, const Metrics& m, const ClipStats& clips, const std::string& cls, const std::vector<TrackSummary>* tracks=nullptr){ std::ofstream f(path); f << "DSD Inspector Report\n"; f << "Input: " << opt.input << "\n"; f << "Source: " << si.container << ", " << si.channels << " ch, " << si.in_rate << " Hz"; if(si.samples) f << ", " << si.duration_s() << " s"; f << ", decimator: " << si.decimator << "\n"; f << "Resampled to: " << si.out_sr << " Hz mono\n"; f << "FFT: " << opt.fft_size*rate_scale(opt, si) << ", hop: " << opt.hop_size*rate_scale(opt, si); if(opt.adaptive_sr) f << " (--sr auto)"; if(si.windows>0) f << ", sampled: " << si.windows << " x " << opt.sample_seconds << " s spread over the file\n"; else if(opt.sample_windows>0) f << ", analyzed seconds: whole file\n"; else f << ", analyzed seconds: " << opt.seconds << "\n"; if(si.stopped_at_s>0) f << "Early exit: stopped after " << si.stopped_at_s << " s, verdict settled for " << opt.settle_s << " s (margin " << si.stop_margin << ")\n"; f << "\n"; f << "— Brickwall/cutoff: "; if(m.cutoff_hz>0) f << m.cutoff_hz << " Hz (drop " << m.cutoff_drop_db << " dB)\n"; else f << "none\n"; f << "— Noise floor " << noise_band(m, 30, 50) << ": " << m.noise_floor_30_50 << " dBFS\n"; f << "— Noise floor " << noise_band(m, 50, 80) << ": " << m.noise_floor_50_80 << " dBFS\n"; f << "— Ultrasonic noise rise (upper minus lower band): " << m.noise_rise_db << " dB\n"; f << "— Crest factor (median): " << m.crest_median_db << " dB\n"; f << "— DR-like metric: " << m.dr_like_db << " dB\n"; if(m.crest_median_l_db!=0 || m.crest_median_r_db!=0) f << "— Crest / DR-like per channel: L " << m.crest_median_l_db << " / " << m.dr_like_l_db << " dB, R " << m.crest_median_r_db << " / " << m.dr_like_r_db << " dB\n"; f << "— True peak: " << m.true_peak_dbtp << " dBTP (sample peak " << m.sample_peak_dbfs << " dBFS)\n"; save_report_clips(f, clips, tracks); f << "\n"; f << "Classification: " << cls << "\n"; if(tracks) save_report_tracks(f, *tracks, cls); }
+
 
 
-// --- ASCII → glyph (no compensation) ---
-static inline const unsigned char* glyph_for_ascii(char c){
-    unsigned int uc = (unsigned char)c;
-    if (uc < 32 || uc > 127) uc = '?';
-    return FONT5x7[uc - 32];
+// Decodes a DSF/DFF with the native decimator and with libavcodec dsd +
+// swresample, and prints how far apart their average spectra are per band.
+static int compare_decimators(const Options& opt){
+    DsdFile probe;
+    if(!open_dsd_file(opt.input, probe)) throw std::runtime_error("--compare-decimators needs a DSF or uncompressed DFF input");
+    ThreadPool pool(opt.threads);
+    auto run = [&](bool native, StreamInfo& si){
+        Options o = opt; o.native_reader = true; o.native_decimator = native;
+        SpectralAccumulator acc(o.target_sr, o.fft_size, o.hop_size, false, &pool, o.fft_double, o.simd);
+        si = decode_stream(o, [&](const AudioBlock& b){ if(b.discontinuity) acc.gap(); acc.push(b.mono, b.n); });
+        return acc.finish();
+    };
+    StreamInfo si_n, si_f;
+    SpectralOutputs a = run(true, si_n), b = run(false, si_f);
+    std::cout << "native: " << si_n.decimator << "   reference: " << si_f.decimator << "\n";
+    if(a.avg_mag_db.size()!=b.avg_mag_db.size() || a.freq.empty()) throw std::runtime_error("no spectra to compare");
+    const double ny = opt.target_sr*0.5;
+    const double edges[][2] = {{20,20e3},{20e3,50e3},{50e3,80e3},{80e3,0.9*ny}};
+    std::cout << "band [Hz]              max|d| dB   mean d dB\n";
+    for(const auto& e : edges){
+        if(e[0] >= e[1]) continue;
+        double mx=0, sum=0; size_t n=0;
+        for(size_t i=0;i<a.freq.size();++i){ if(a.freq[i]<e[0] || a.freq[i]>=e[1]) continue; double d=a.avg_mag_db[i]-b.avg_mag_db[i]; mx=std::max(mx,std::abs(d)); sum+=d; ++n; }
+        char line[128]; snprintf(line, sizeof line, "%8.0f - %-8.0f     %8.2f   %8.2f\n", e[0], e[1], mx, n? sum/n : 0.0); std::cout << line;
+    }
+    Metrics ma = analyze_metrics(a), mb = analyze_metrics(b);
+    std::cout << "noise 30-50k: " << ma.noise_floor_30_50 << " vs " << mb.noise_floor_30_50
+              << " dBFS, 50-80k: " << ma.noise_floor_50_80 << " vs " << mb.noise_floor_50_80
+              << " dBFS, cutoff: " << ma.cutoff_hz << " vs " << mb.cutoff_hz << " Hz\n";
+    return 0;
 }
 
-// Temporary shim so old calls compile (but ideally unused):
-static inline const unsigned char* glyph_for_scaled(char c){
-    return glyph_for_ascii(c);
+// Runs the float and the double-precision STFT side by side on the mono
+// stream and checks that their average spectra agree within 0.1 dB.
+static int check_fft(const Options& opt){
+    ThreadPool pool(opt.threads);
+    SpectralAccumulator accF(opt.target_sr, opt.fft_size, opt.hop_size, true, &pool, false, opt.simd);
+    SpectralAccumulator accD(opt.target_sr, opt.fft_size, opt.hop_size, true, &pool, true, opt.simd);
+    double tF=0, tD=0;
+    decode_stream(opt, [&](const AudioBlock& b){
+        if(b.discontinuity){ accF.gap(); accD.gap(); }
+        auto t0 = std::chrono::steady_clock::now(); accF.push(b.mono, b.n);
+        auto t1 = std::chrono::steady_clock::now(); accD.push(b.mono, b.n);
+        auto t2 = std::chrono::steady_clock::now();
+        tF += std::chrono::duration<double>(t1-t0).count(); tD += std::chrono::duration<double>(t2-t1).count();
+    });
+    auto t0 = std::chrono::steady_clock::now(); SpectralOutputs f = accF.finish();
+    auto t1 = std::chrono::steady_clock::now(); SpectralOutputs d = accD.finish();
+    auto t2 = std::chrono::steady_clock::now();
+    tF += std::chrono::duration<double>(t1-t0).count(); tD += std::chrono::duration<double>(t2-t1).count();
+    size_t nf = accF.frames();
+    if(nf==0) throw std::runtime_error("input too short for one FFT frame");
+    double mx=0, sum=0, fmx=0;
+    for(size_t k=0;k<f.avg_mag_db.size();++k){ double dd=std::abs(f.avg_mag_db[k]-d.avg_mag_db[k]); sum+=dd; if(dd>mx){ mx=dd; fmx=f.freq[k]; } }
+    char line[160];
+    snprintf(line, sizeof line, "float (%s): %.3f s, %.2f us/frame\ndouble:       %.3f s, %.2f us/frame  (%zu frames, %.1fx)\n",
+             accF.kernel(), tF, 1e6*tF/nf, tD, 1e6*tD/nf, nf, tF>0 ? tD/tF : 0.0);
+    std::cout << line;
+    snprintf(line, sizeof line, "avg_mag_db max|d| %.4f dB at %.0f Hz, mean|d| %.5f dB\n", mx, fmx, sum/f.avg_mag_db.size());
+    std::cout << line;
+    Metrics mf = analyze_metrics(f), md = analyze_metrics(d);
+    std::cout << "cutoff: " << mf.cutoff_hz << " vs " << md.cutoff_hz << " Hz, noise rise: " << mf.noise_rise_db << " vs " << md.noise_rise_db << " dB\n";
+    bool ok = mx <= 0.1;
+    std::cout << (ok ? "OK" : "FAIL") << " (limit 0.1 dB)\n";
+    return ok ? 0 : 1;
 }
 
+// Analyzes the input whole and with --sample K:D, and checks that the sampled
+// metrics stay within fixed tolerances of the full-file ones while reading less.
+static int check_sample(const Options& opt){
+    if(opt.sample_windows<=0) throw std::runtime_error("--check-sample needs --sample K:D");
+    struct Run { Profile prof; Metrics m; std::string cls; StreamInfo si; };
+    auto analyze = [&](const Options& o, Run& r){
+        r.prof.process_cpu = true;
+        ProfileScope profiling(&r.prof);
+        ThreadPool pool(o.threads);
+        SpectralAccumulator acc(o.target_sr, o.fft_size, o.hop_size, false, &pool, o.fft_double, o.simd);
+        DynamicAccumulator dyn(o.target_sr);
+        r.si = decode_stream(o, [&](const AudioBlock& b){ if(b.discontinuity){ acc.gap(); dyn.gap(); } acc.push(b.mono, b.n); dyn.push(b.mono, b.n); });
+        r.m = analyze_metrics(acc.finish()); dyn.finish(r.m); r.cls = classify(r.m);
+    };
+    Options whole = opt; whole.sample_windows = 0; whole.seconds = 0;
+    Run F, S;
+    analyze(whole, F); analyze(opt, S);
+    if(S.si.windows==0) std::cout << "note: the file is shorter than " << opt.sample_windows << " x " << opt.sample_seconds << " s, so it was read whole\n";
+    bool ok = true;
+    char line[160];
+    auto row = [&](const char* name, double a, double b, double tol){
+        bool pass = std::abs(a-b) <= tol; ok = ok && pass;
+        snprintf(line, sizeof line, "%-22s %10.2f %10.2f %8.2f   (tol %.1f) %s\n", name, a, b, b-a, tol, pass ? "" : "FAIL"); std::cout << line;
+    };
+    snprintf(line, sizeof line, "%-22s %10s %10s %8s\n", "metric", "whole", "sampled", "delta"); std::cout << line;
+    bool cut_pass = (F.m.cutoff_hz>0) == (S.m.cutoff_hz>0) && std::abs(F.m.cutoff_hz-S.m.cutoff_hz) <= 1000.0; ok = ok && cut_pass;
+    snprintf(line, sizeof line, "%-22s %10.0f %10.0f %8.0f   (tol 1000) %s\n", "cutoff Hz", F.m.cutoff_hz, S.m.cutoff_hz, S.m.cutoff_hz-F.m.cutoff_hz, cut_pass ? "" : "FAIL"); std::cout << line;
+    row("noise 30-50k dBFS", F.m.noise_floor_30_50, S.m.noise_floor_30_50, 1.5);
+    row("noise 50-80k dBFS", F.m.noise_floor_50_80, S.m.noise_floor_50_80, 1.5);
+    row("noise rise dB", F.m.noise_rise_db, S.m.noise_rise_db, 1.5);
+    row("crest median dB", F.m.crest_median_db, S.m.crest_median_db, 2.0);
+    row("DR-like dB", F.m.dr_like_db, S.m.dr_like_db, 3.0);
+    auto head = [](const std::string& c){ return c.substr(0, c.find(';')); };
+    bool cls_pass = head(F.cls)==head(S.cls); ok = ok && cls_pass;
+    std::cout << "classification: " << (cls_pass ? "same" : "DIFFERENT") << "\n  whole:   " << F.cls << "\n  sampled: " << S.cls << "\n";
+    snprintf(line, sizeof line, "decoded %.1f s vs %.1f s, read %.1f MB vs %.1f MB, %.2f s vs %.2f s wall\n",
+             F.prof.samples_out/(double)opt.target_sr, S.prof.samples_out/(double)opt.target_sr, F.prof.bytes_read/1e6, S.prof.bytes_read/1e6, F.prof.wall, S.prof.wall);
+    std::cout << line << (ok ? "OK" : "FAIL") << "\n";
+    return ok ? 0 : 1;
+}
 
-static void draw_char(ImageRGB& im,int x,int y,char c,
-                      unsigned char r,unsigned char g,unsigned char b){
-    const unsigned char* col = glyph_for_ascii(c);
-    for(int cx=0; cx<5; ++cx){
-        unsigned char bits = col[cx];
-        for(int cy=0; cy<7; ++cy){
-            if(bits & (1u<<cy)) im.set(x+cx, y+cy, r,g,b);
+// ----------------- Machine-readable outputs -----------------
+// report.json carries everything report.txt does, as plain fields; spectra.bin
+// holds the average spectra in a fixed little-endian layout:
+//   0  char[8]  "DSDSPEC" + NUL
+//   8  u32      format version (1)
+//  12  u32      sample rate (Hz)
+//  16  u32      FFT size
+//  20  u32      bins (FFT size/2 + 1)
+//  24  u32      channels: 1 (mono) or 3 (mono, L, R)
+//  28  u32      reserved (0)
+//  32  f32      freq[bins] (Hz)
+//      f32      avg_mag_db[channels][bins] (dBFS)
+// Every array is 4-byte aligned, so readers can use it in place from mmap.
+static const uint32_t REPORT_FORMAT = 1;
+
+static void save_report_json(const std::string& path, const Options& opt, const StreamInfo& si, const Metrics& m, const ClipStats& clips, const std::string& cls,
+                             const std::vector<TrackSummary>* tracks=nullptr){
+    char num[64]; auto f = [&](double v){ if(!std::isfinite(v)) return std::string("null"); snprintf(num, sizeof num, "%.6g", v); return std::string(num); };
+    std::ofstream o(path);
+    o << "{\n  \"format\": " << REPORT_FORMAT << ",\n  \"input\": \"" << json_escape(opt.input) << "\",\n"
+      << "  \"stream\": {\"container\": \"" << json_escape(si.container) << "\", \"channels\": " << si.channels << ", \"in_rate\": " << si.in_rate
+      << ", \"samples\": " << si.samples << ", \"duration_s\": " << f(si.duration_s()) << ", \"out_sr\": " << si.out_sr
+      << ", \"decimator\": \"" << json_escape(si.decimator) << "\", \"windows\": " << si.windows
+      << ", \"stopped_at_s\": " << (si.stopped_at_s>0 ? f(si.stopped_at_s) : "null") << ", \"stop_margin\": " << (si.stopped_at_s>0 ? f(si.stop_margin) : "null") << "},\n"
+      << "  \"options\": {\"target_sr\": " << opt.target_sr << ", \"fft\": " << opt.fft_size << ", \"hop\": " << opt.hop_size << ", \"adaptive_sr\": " << (opt.adaptive_sr ? "true" : "false")
+      << ", \"seconds\": " << opt.seconds << ", \"sample_windows\": " << opt.sample_windows << ", \"sample_seconds\": " << f(opt.sample_seconds)
+      << ", \"reader\": \"" << (opt.native_reader ? "native" : "ffmpeg") << "\", \"decimator\": \"" << (opt.native_decimator ? "native" : "ffmpeg") << "\""
+      << ", \"fft_precision\": \"" << (opt.fft_double ? "double" : "float") << "\", \"spec_width\": " << opt.spec_width
+      << ", \"spec_agg\": \"" << (opt.spec_mean ? "mean" : "max") << "\", \"spec_freq\": \"" << (opt.spec_logf ? "log" : "linear") << "\""
+      << ", \"early_exit_s\": " << f(opt.settle_s) << ", \"early_exit_check_s\": " << f(opt.check_s) << "},\n"
+      << "  \"metrics\": {\"cutoff_hz\": " << f(m.cutoff_hz) << ", \"cutoff_drop_db\": " << f(m.cutoff_drop_db)
+      << ", \"noise_floor_30_50\": " << f(m.noise_floor_30_50) << ", \"noise_floor_50_80\": " << f(m.noise_floor_50_80) << ", \"noise_band_scale\": " << f(m.noise_band_scale)
+      << ", \"noise_rise_db\": " << f(m.noise_rise_db) << ", \"crest_median_db\": " << f(m.crest_median_db) << ", \"dr_like_db\": " << f(m.dr_like_db)
+      << ", \"crest_median_l_db\": " << f(m.crest_median_l_db) << ", \"crest_median_r_db\": " << f(m.crest_median_r_db)
+      << ", \"dr_like_l_db\": " << f(m.dr_like_l_db) << ", \"dr_like_r_db\": " << f(m.dr_like_r_db)
+      << ", \"true_peak_dbtp\": " << f(m.true_peak_dbtp) << ", \"sample_peak_dbfs\": " << f(m.sample_peak_dbfs) << "},\n"
+      << "  \"clips\": {\"level_dbtp\": 0, \"runs\": " << clips.runs << ", \"samples\": " << clips.samples << ", \"histogram\": {";
+    for(int b=0;b<ClipStats::kBins;++b) o << (b ? ", " : "") << "\"" << ClipStats::bin_label(b) << "\": " << clips.hist[b];
+    o << "}, \"positions\": [";
+    for(size_t i=0;i<clips.first.size();++i){
+        const ClipRun& r = clips.first[i];
+        o << (i ? ", " : "") << "{\"t_s\": " << f(r.t_s) << ", \"channel\": \"" << (r.channel ? "R" : "L") << "\", \"samples\": " << r.samples << ", \"peak_dbtp\": " << f(r.peak_dbtp);
+        if(tracks) o << ", \"track\": " << r.track;
+        o << "}";
+    }
+    o << "]},\n"
+      << "  \"classification\": \"" << json_escape(cls) << "\",\n";
+    if(tracks){
+        o << "  \"tracks\": [";
+        for(size_t i=0;i<tracks->size();++i){
+            const TrackSummary& t = (*tracks)[i];
+            o << (i ? ",\n" : "\n") << "    {\"file\": \"" << json_escape(t.file) << "\"";
+            if(!t.error.empty()){ o << ", \"error\": \"" << json_escape(t.error) << "\"}"; continue; }
+            o << ", \"in_rate\": " << t.info.in_rate << ", \"duration_s\": " << f(t.info.duration_s())
+              << ", \"stopped_at_s\": " << (t.info.stopped_at_s>0 ? f(t.info.stopped_at_s) : "null")
+              << ", \"cutoff_hz\": " << f(t.m.cutoff_hz) << ", \"noise_floor_30_50\": " << f(t.m.noise_floor_30_50) << ", \"noise_floor_50_80\": " << f(t.m.noise_floor_50_80)
+              << ", \"noise_rise_db\": " << f(t.m.noise_rise_db) << ", \"crest_median_db\": " << f(t.m.crest_median_db) << ", \"dr_like_db\": " << f(t.m.dr_like_db)
+              << ", \"true_peak_dbtp\": " << f(t.m.true_peak_dbtp)
+              << ", \"classification\": \"" << json_escape(t.cls) << "\", \"outlier\": " << (cls_verdict(t.cls) != cls_verdict(cls) ? "true" : "false") << "}";
         }
+        o << "\n  ],\n";
     }
+    o << "  \"spectra\": \"spectra.bin\"\n}\n";
 }
 
+static void save_spectra_bin(const std::string& path, int sr, int nfft, const SpectralOutputs& mono, const SpectralOutputs& left, const SpectralOutputs& right){
+    std::ofstream f(path, std::ios::binary | std::ios::trunc); if(!f) return;
+    f.write("DSDSPEC\0", 8);
+    BinWriter w(f);
+    std::vector<const SpectralOutputs*> chans = { &mono };
+    if(!left.avg_mag_db.empty() && !right.avg_mag_db.empty()){ chans.push_back(&left); chans.push_back(&right); }
+    const uint32_t bins = (uint32_t)mono.avg_mag_db.size();
+    w.u32(1); w.u32((uint32_t)sr); w.u32((uint32_t)nfft); w.u32(bins); w.u32((uint32_t)chans.size()); w.u32(0);
+    for(uint32_t k=0;k<bins;++k) w.f32((float)(k < mono.freq.size() ? mono.freq[k] : (double)k*sr/nfft));
+    for(const auto* c : chans) for(uint32_t k=0;k<bins;++k) w.f32(k < c->avg_mag_db.size() ? (float)c->avg_mag_db[k] : -120.0f);
+}
 
-static void draw_text(ImageRGB& im, int x, int y, const std::string& s,
-                      unsigned char r, unsigned char g, unsigned char b){
-    int off = 0;
-    for(char c : s){
-        if (c == '\n'){ y += 9; off = 0; continue; }
-        draw_char(im, x+off, y, c, r,g,b);
-        off += 6;
-    }
+// Fills mono (and left/right when present); false if missing or inconsistent.
+static bool load_spectra_bin(const std::string& path, SpectralOutputs* outs[3]){
+    std::ifstream f(path, std::ios::binary); if(!f) return false;
+    char magic[8]={0}; f.read(magic, 8);
+    if(std::memcmp(magic, "DSDSPEC\0", 8)!=0) return false;
+    BinReader rd(f);
+    uint32_t ver=rd.u32(), sr=rd.u32(), nfft=rd.u32(), bins=rd.u32(), nch=rd.u32(); rd.u32();
+    if(!rd.ok() || ver!=1 || sr==0 || nfft==0 || bins!=nfft/2+1 || (nch!=1 && nch!=3)) return false;
+    std::vector<double> freq(bins); for(auto& v : freq) v = rd.f32();
+    for(uint32_t c=0;c<nch;++c){ outs[c]->freq = freq; outs[c]->avg_mag_db.resize(bins); for(auto& v : outs[c]->avg_mag_db) v = rd.f32(); }
+    return rd.ok();
 }
 
+// ----------------- Per-file pipeline -----------------
+// Counting semaphore (C++17 has none) used to cap concurrent decodes.
+class CountingSemaphore {
+public:
+    explicit CountingSemaphore(int n):n_(n){}
+    void acquire(){ std::unique_lock<std::mutex> lk(mu_); cv_.wait(lk, [&]{ return n_>0; }); --n_; }
+    void release(){ { std::lock_guard<std::mutex> lk(mu_); ++n_; } cv_.notify_one(); }
+private:
+    std::mutex mu_; std::condition_variable cv_; int n_;
+};
 
+struct FileResult {
+    StreamInfo info;
+    Metrics m;
+    ClipStats clips;
+    std::string cls;
+    Fingerprint fp;              // invalid for albums
+    uint64_t samples = 0;        // analyzed samples at info.out_sr
+    SpectralOutputs mono, left, right;   // average spectra only (no spectrogram); L/R when pretty
+};
 
-static void draw_line(ImageRGB& im,int x0,int y0,int x1,int y1,unsigned char r,unsigned char g,unsigned char b){
-    int dx=std::abs(x1-x0), sx=x0<x1?1:-1; int dy=-std::abs(y1-y0), sy=y0<y1?1:-1; int err=dx+dy; while(true){ im.set(x0,y0,r,g,b); if(x0==x1 && y0==y1) break; int e2=2*err; if(e2>=dy){ err+=dy; x0+=sx;} if(e2<=dx){ err+=dx; y0+=sy;} }
+static dsdinspect::AnalyzerOptions analyzer_options(const Options& o){
+    dsdinspect::AnalyzerOptions a;
+    a.target_sr = o.target_sr; a.fft_size = o.fft_size; a.hop_size = o.hop_size; a.adaptive_rate = o.adaptive_sr; a.seconds = o.seconds;
+    a.sample_windows = o.sample_windows; a.sample_seconds = o.sample_seconds; a.threads = o.threads;
+    a.native_reader = o.native_reader; a.native_decimator = o.native_decimator; a.simd = o.simd; a.fft_double = o.fft_double;
+    a.spectrogram = !o.album; a.stereo_spectra = o.pretty;
+    a.spec_width = o.spec_width; a.spec_mean = o.spec_mean; a.spec_logf = o.spec_logf;
+    a.settle_s = o.settle_s; a.check_s = o.check_s; a.pipeline = o.pipeline;
+    return a;
 }
 
-static void colormap_turbo(double t, unsigned char& r, unsigned char& g, unsigned char& b){
-    // t in [0,1]  -> r,g,b in [0,255]
-    t = std::clamp(t, 0.0, 1.0);
-    // Simple, good-looking “Turbo-like” polynomial approx that returns 0..255 directly.
-    double rF =  34.61 + t*(1172.69 + t*(-10793.6 + t*(33300.0 + t*(-38394.5 + t*17425.7))));
-    double gF =  23.31 + t*(  557.33 + t*(  1225.0 + t*( -3574.0 + t*(  4095.0 - t* 1550.0))));
-    double bF =  27.20 + t*( 3211.10 + t*(-15328.0 + t*(27814.0 + t*(-22569.0 + t* 6838.0))));
-    r = (unsigned char)std::clamp((int)std::lround(rF), 0, 255);
-    g = (unsigned char)std::clamp((int)std::lround(gF), 0, 255);
-    b = (unsigned char)std::clamp((int)std::lround(bF), 0, 255);
+// One Analyzer per thread (the main thread, or each tree worker), so its FFTW
+// plans and buffers are reused for every file that thread analyzes.
+static dsdinspect::Analyzer& thread_analyzer(const Options& opt){
+    thread_local std::unique_ptr<dsdinspect::Analyzer> an;
+    dsdinspect::AnalyzerOptions ao = analyzer_options(opt);
+    if(!an || an->options() != ao) an.reset(new dsdinspect::Analyzer(ao));
+    return *an;
 }
 
-// Scale-blit a small text bitmap drawn with draw_text (correct glyphs)
-static void draw_text_scaled_nn(ImageRGB& dst, int x, int y, const std::string& s,
-                                unsigned char r, unsigned char g, unsigned char b, int scale)
-{
-    if (scale <= 1){ draw_text(dst, x, y, s, r, g, b); return; }
+// Tree mode: each worker hands the rendering and PNG encoding of a finished
+// file to its own render thread and goes on with the next file, so the
+// encode overlaps that file's decode and STFT. At most one render waits per
+// lane, which bounds the spectrograms held in memory; a lane drains when its
+// worker thread exits. Only run_tree defers (TreeOptions::defer_render): its
+// pool is joined before index.html is written. --watch keeps its pool for
+// the life of the daemon and publishes after each folder, so it renders inline.
+class RenderLane {
+public:
+    RenderLane() : q_(1), th_([this]{ run(); }) {}
+    ~RenderLane(){ q_.close(); th_.join(); }
+    void submit(std::function<void()> job){
+        std::function<void()>* slot = q_.back();
+        if(!slot){ job(); return; }
+        *slot = std::move(job); q_.push();
+    }
+private:
+    void run(){
+        while(std::function<void()>* job = q_.front()){
+            try{ (*job)(); } catch(const std::exception& e){ std::cerr << "[WARN] render failed: " << e.what() << "\n"; }
+            *job = nullptr; q_.pop();
+        }
+    }
+    SpscQueue<std::function<void()>> q_;
+    std::thread th_;
+};
 
-    const int small_h = 9;
-    const int small_w = (int)s.size() * 6; // 5px glyph + 1px spacing
-    if (small_w <= 0) return;
+static RenderLane& render_lane(){ thread_local RenderLane lane; return lane; }
 
-    ImageRGB small(small_w, small_h);
-    small.clear(0,0,0);
-    draw_text(small, 0, 0, s, 255,255,255); // render once at 1×
+// Decode + analyze opt.input and write every per-file output into opt.outdir.
+// decode_slots (optional) is held only while the file is being analyzed; prof
+// (optional) collects per-stage timings. With defer_render the outputs are
+// written on this thread's RenderLane after the function returns; report.txt
+// is removed first and written last, so an interrupted render leaves the file
+// stale for the next --tree run.
+static FileResult process_file(const Options& opt, CountingSemaphore* decode_slots=nullptr, Profile* prof=nullptr, bool defer_render=false){
+    ProfileScope profiling(prof);
+    std::filesystem::create_directories(opt.outdir);
+    dsdinspect::Analyzer& an = thread_analyzer(opt);
+    if(decode_slots){ StageTimer st("decode-wait"); decode_slots->acquire(); }
+    dsdinspect::Result res;
+    try{ res = an.analyze(opt.input); } catch(...){ if(decode_slots) decode_slots->release(); throw; }
+    if(decode_slots) decode_slots->release();
+
+    FileResult r;
+    r.info = std::move(res.info); r.m = res.metrics; r.clips = std::move(res.clips); r.cls = std::move(res.classification); r.fp = res.fingerprint; r.samples = res.samples;
+    r.left = std::move(res.left); r.right = std::move(res.right);
+    r.mono.freq = res.mono.freq; r.mono.avg_mag_db = res.mono.avg_mag_db;
+    if(prof){
+        prof->fft_frames += res.fft_frames;
+        if(r.info.out_sr) prof->audio_s += (double)r.samples / r.info.out_sr;
+    }
+    auto write = [opt, so = std::move(res.mono), r]{
+        int sr = r.info.out_sr;
+        { StageTimer st("render"); save_spectrogram_png(so, opt.outdir+"/spectrogram.png"); save_average_spectrum_png(so, opt.outdir+"/spectrum_avg.png"); }
+        if(opt.pretty){ StageTimer st("render"); save_pretty_spectrogram(so, sr, opt.outdir+"/spectrogram_pretty.png"); save_pretty_spectrum_overlay(r.left, r.right, sr, r.m, r.cls, opt.outdir+"/spectrum_overlay.png"); }
+        StageTimer st("report");
+        save_spectra_bin(opt.outdir+"/spectra.bin", sr, opt.fft_size*rate_scale(opt, r.info), r.mono, r.left, r.right);
+        save_report_json(opt.outdir+"/report.json", opt, r.info, r.m, r.clips, r.cls); save_report(opt.outdir+"/report.txt", opt, r.info, r.m, r.clips, r.cls);
+    };
+    if(defer_render){ std::error_code ec; std::filesystem::remove(opt.outdir+"/report.txt", ec); render_lane().submit(std::move(write)); }
+    else write();
+    return r;
+}
 
-    // Nearest-neighbor expand into dst with desired color
-    for(int sy=0; sy<small_h; ++sy){
-        for(int sx=0; sx<small_w; ++sx){
-            int o = (sy*small.w + sx)*3;
-            if (small.px[o] | small.px[o+1] | small.px[o+2]){
-                for(int dx=0; dx<scale; ++dx)
-                    for(int dy=0; dy<scale; ++dy)
-                        dst.set(x + sx*scale + dx, y + sy*scale + dy, r,g,b);
+// Album mode (--album): every track of the folder is analyzed concurrently,
+// each on its own thread with its own Analyzer, and the results are combined
+// by dsdinspect::merge_album() (frame-weighted average spectra, merged
+// dynamics histograms), so the album costs about the wall time of its longest
+// track. --threads is split between the tracks. The album gets the per-file
+// outputs except the spectrograms; report.txt/json list every track.
+static FileResult process_album(const Options& opt, const std::vector<std::string>& tracks, CountingSemaphore* decode_slots,
+                                Profile* prof, std::vector<TrackSummary>& summaries){
+    ProfileScope profiling(prof);
+    if(tracks.empty()) throw std::runtime_error("no .dsf/.dff tracks in " + opt.input);
+    std::filesystem::create_directories(opt.outdir);
+    const int total = opt.threads > 0 ? opt.threads : (int)std::max(1u, std::thread::hardware_concurrency());
+    const int width = std::min<int>(total, (int)tracks.size());
+    Options to = opt; to.threads = std::max(1, total/width);
+
+    std::vector<dsdinspect::Result> res(tracks.size());
+    summaries.assign(tracks.size(), TrackSummary());
+    std::atomic<size_t> next{0};
+    std::mutex prof_mu;
+    {
+        ThreadPool pool(width);
+        pool.parallel_for((size_t)width, [&](size_t, size_t, int){
+            for(size_t i; (i = next++) < tracks.size(); ){
+                TrackSummary& s = summaries[i]; s.file = tracks[i];
+                Profile tp;
+                {
+                    ProfileScope track_profiling(prof ? &tp : nullptr);
+                    Options o = to; o.input = tracks[i];
+                    dsdinspect::Analyzer& an = thread_analyzer(o);
+                    if(decode_slots){ StageTimer st("decode-wait"); decode_slots->acquire(); }
+                    try{ res[i] = an.analyze(o.input); s.info = res[i].info; s.m = res[i].metrics; s.cls = res[i].classification; s.fp = res[i].fingerprint; }
+                    catch(const std::exception& ex){ s.error = ex.what(); }
+                    if(decode_slots) decode_slots->release();
+                }
+                if(prof){ tp.wall = 0; tp.files = 0; std::lock_guard<std::mutex> lk(prof_mu); prof->merge(tp); }   // wall is the album's
             }
-        }
+        });
     }
+    std::vector<dsdinspect::Result> ok;
+    std::vector<int> ok_track;
+    for(size_t i=0;i<tracks.size();++i) if(summaries[i].error.empty()){ ok.push_back(std::move(res[i])); ok_track.push_back((int)i); }
+    if(ok.empty()) throw std::runtime_error("no track could be analyzed (" + summaries[0].error + ")");
+
+    dsdinspect::Result album;
+    { StageTimer st("metrics"); album = dsdinspect::merge_album(ok); }
+    FileResult r;
+    r.info = std::move(album.info); r.m = album.metrics; r.clips = std::move(album.clips); r.cls = std::move(album.classification); r.samples = album.samples;
+    for(ClipRun& c : r.clips.first) c.track = ok_track[c.track];           // index into summaries
+    r.mono = std::move(album.mono); r.left = std::move(album.left); r.right = std::move(album.right);
+    int sr = r.info.out_sr;
+    std::error_code ec;   // spectrograms of an earlier single-file run would no longer match the report
+    std::filesystem::remove(opt.outdir+"/spectrogram.png", ec); std::filesystem::remove(opt.outdir+"/spectrogram_pretty.png", ec);
+    { StageTimer st("render"); save_average_spectrum_png(r.mono, opt.outdir+"/spectrum_avg.png"); }
+    { StageTimer st("report"); save_report(opt.outdir+"/report.txt", opt, r.info, r.m, r.clips, r.cls, &summaries); save_report_json(opt.outdir+"/report.json", opt, r.info, r.m, r.clips, r.cls, &summaries); }
+    if(opt.pretty){ StageTimer st("render"); save_pretty_spectrum_overlay(r.left, r.right, sr, r.m, r.cls, opt.outdir+"/spectrum_overlay.png"); }
+    if(prof){
+        prof->fft_frames += album.fft_frames;
+        if(r.info.out_sr) prof->audio_s += (double)r.samples / r.info.out_sr;
+    }
+    { StageTimer st("report"); save_spectra_bin(opt.outdir+"/spectra.bin", sr, opt.fft_size*rate_scale(opt, r.info), r.mono, r.left, r.right); }
+    return r;
+}
+
+static std::string host_name(){ char h[256] = {0}; if(gethostname(h, sizeof h - 1) != 0) return "unknown"; return h; }
+
+// <outdir>/profile.json for one analyzed file.
+static void save_profile_json(const std::string& path, const std::string& input, const Profile& p){
+    std::ofstream f(path);
+    f << "{\n  \"input\": \"" << json_escape(input) << "\", \"host\": \"" << json_escape(host_name())
+      << "\", \"hardware_threads\": " << std::thread::hardware_concurrency() << ",\n  \"profile\": ";
+    write_profile_json(f, p, "  ");
+    f << "\n}\n";
 }
 
-// ----------------- App options & usage -----------------
-struct Options {
-    std::string input;
-    std::string outdir = "./out";
-    int target_sr = 176400;   // resample to 176.4 kHz
-    int fft_size  = 4096;
-    int hop_size  = 2048;
-    int seconds   = 180;      // analyze first N seconds (0 = whole file)
+// ----------------- Analysis cache (tree mode) -----------------
+// OUTROOT/.dsd_inspector_manifest records, per analyzed input, its identity
+// (path, size, mtime, optional hash of the first/last 64 KiB), a hash of the
+// analysis options, the stream properties, the Metrics, clip runs and
+// fingerprint. The average
+// spectra are the per-file spectra.bin (earlier versions wrote
+// <outdir>/.spectra.cache, which is still read). A re-run only
+// decodes inputs whose identity or options changed; classification, report
+// and overlay can be regenerated from the cache alone (--reclassify).
+// All integers are little-endian.
+
+// Bump when a change alters analysis results for the same options.
+static const uint32_t ANALYSIS_VERSION = 6;
+
+static uint64_t fnv1a(const void* data, size_t n, uint64_t h=1469598103934665603ull){
+    const uint8_t* p=(const uint8_t*)data; for(size_t i=0;i<n;++i){ h^=p[i]; h*=1099511628211ull; } return h;
+}
+
+// Only options that change analysis results; threads/simd/reader do not.
+static uint64_t options_hash(const Options& o){
+    uint64_t h = fnv1a(&ANALYSIS_VERSION, sizeof ANALYSIS_VERSION);
+    int32_t v[] = { o.target_sr, o.fft_size, o.hop_size, (int32_t)o.adaptive_sr, o.seconds, (int32_t)o.native_reader, (int32_t)o.native_decimator, (int32_t)o.pretty, (int32_t)o.fft_double,
+                    o.sample_windows, (int32_t)std::lround(o.sample_seconds*1000), o.spec_width, (int32_t)o.spec_mean, (int32_t)o.spec_logf, (int32_t)o.album };
+    h = fnv1a(v, sizeof v, h);
+    if(o.settle_s > 0){ int32_t e[] = { (int32_t)std::lround(o.settle_s*1000), (int32_t)std::lround(o.check_s*1000) }; h = fnv1a(e, sizeof e, h); }   // off: caches stay valid
+    return h;
+}
+
+struct FileIdentity { uint64_t size=0; int64_t mtime_ns=0; uint64_t content_hash=0; };
+
+static bool stat_identity(const std::string& path, bool with_hash, FileIdentity& id){
+    struct stat st; if(::stat(path.c_str(), &st)!=0) return false;
+    id.size = (uint64_t)st.st_size;
+    id.mtime_ns = (int64_t)st.st_mtim.tv_sec*1000000000ll + st.st_mtim.tv_nsec;
+    id.content_hash = 0;
+    if(with_hash){
+        const size_t K = 64*1024;
+        std::ifstream f(path, std::ios::binary); std::vector<char> buf(K);
+        f.read(buf.data(), K); uint64_t h = fnv1a(buf.data(), (size_t)f.gcount());
+        if(id.size > K){ f.clear(); f.seekg((std::streamoff)(id.size - std::min<uint64_t>(id.size-K, K))); f.read(buf.data(), K); h = fnv1a(buf.data(), (size_t)f.gcount(), h); }
+        id.content_hash = h ? h : 1;
+    }
+    return true;
+}
+
+struct ManifestEntry {
+    std::string path, rel_dir;
+    FileIdentity id;
+    uint64_t options_hash = 0;
+    StreamInfo info;
+    Metrics m;
+    std::string cls;
+    ClipStats clips;
+    Fingerprint fp;
 };
 
-static void usage(){
-    std::cout << "\nDSD Inspector — spectrum, noise-shaping, DR\n\n"              << "Usage: dsd_inspector -i <input.dsf|dff|flac|wav> [--out outdir] [--sr 176400] [--fft 4096] [--hop 2048] [--sec 180] [--no-pretty]\n\n";
-}
-
-// ----------------- Decode helpers -----------------
-static std::vector<float> decode_to_mono(const Options& opt, int& sr_out){
-    std::vector<float> mono;
-    AVFormatContext* fmt = nullptr;
-    if (avformat_open_input(&fmt, opt.input.c_str(), nullptr, nullptr) < 0)
-        throw std::runtime_error("Failed to open input");
-    if (avformat_find_stream_info(fmt, nullptr) < 0)
-        throw std::runtime_error("Failed to find stream info");
-
-    int astream = av_find_best_stream(fmt, AVMEDIA_TYPE_AUDIO, -1, -1, nullptr, 0);
-    if (astream < 0) throw std::runtime_error("No audio stream");
-
-    AVStream* st = fmt->streams[astream];
-    const AVCodec* dec = avcodec_find_decoder(st->codecpar->codec_id);
-    if (!dec) throw std::runtime_error("No decoder");
-
-    AVCodecContext* ctx = avcodec_alloc_context3(dec);
-    if (!ctx) throw std::runtime_error("No codec ctx");
-    if (avcodec_parameters_to_context(ctx, st->codecpar) < 0)
-        throw std::runtime_error("param->ctx failed");
-
-    if (avcodec_open2(ctx, dec, nullptr) < 0)
-        throw std::runtime_error("open decoder failed");
-
-    int in_channels = ctx->ch_layout.nb_channels ? ctx->ch_layout.nb_channels : ctx->channels;
-    int64_t in_layout = ctx->ch_layout.nb_channels ? av_get_default_channel_layout(ctx->ch_layout.nb_channels)
-                                                   : av_get_default_channel_layout(in_channels);
-
-    SwrContext* swr = swr_alloc_set_opts(nullptr,
-        AV_CH_LAYOUT_MONO, AV_SAMPLE_FMT_FLT, opt.target_sr,
-        in_layout, ctx->sample_fmt, ctx->sample_rate, 0, nullptr);
-    if (!swr || swr_init(swr) < 0) throw std::runtime_error("swr init failed");
-
-    AVPacket* pkt = av_packet_alloc();
-    AVFrame*  frm = av_frame_alloc();
-
-    int64_t max_samples = (opt.seconds>0) ? (int64_t)opt.target_sr*opt.seconds : INT64_MAX;
-    int64_t written=0;
-
-    while (av_read_frame(fmt, pkt) >= 0){
-        if (pkt->stream_index != astream){ av_packet_unref(pkt); continue; }
-        if (avcodec_send_packet(ctx, pkt) < 0){ av_packet_unref(pkt); break; }
-        av_packet_unref(pkt);
-        while (avcodec_receive_frame(ctx, frm) >= 0){
-            const uint8_t** in = (const uint8_t**)frm->extended_data;
-            int outcount = av_rescale_rnd(swr_get_delay(swr, ctx->sample_rate) + frm->nb_samples, opt.target_sr, ctx->sample_rate, AV_ROUND_UP);
-            std::vector<float> tmp(outcount);
-            uint8_t* outptr = (uint8_t*)tmp.data();
-            int conv = swr_convert(swr, &outptr, outcount, in, frm->nb_samples);
-            if (conv>0){
-                int ns = conv; tmp.resize(ns);
-                int64_t can = std::min<int64_t>(ns, max_samples - written);
-                if (can<=0){ av_frame_unref(frm); goto done; }
-                mono.insert(mono.end(), tmp.begin(), tmp.begin()+can);
-                written += can;
+static void put_metrics(BinWriter& w, const Metrics& m){
+    for(double v : {m.cutoff_hz, m.cutoff_drop_db, m.noise_floor_30_50, m.noise_floor_50_80, m.noise_rise_db, m.crest_median_db, m.dr_like_db,
+                    m.crest_median_l_db, m.crest_median_r_db, m.dr_like_l_db, m.dr_like_r_db, m.true_peak_dbtp, m.sample_peak_dbfs, m.noise_band_scale}) w.f64(v);
+}
+// Manifests before version 4 have no per-channel crest/DR, before 5 no peaks, before 7 no noise band scale.
+static Metrics get_metrics(BinReader& r, uint32_t version){
+    Metrics m;
+    for(double* v : {&m.cutoff_hz, &m.cutoff_drop_db, &m.noise_floor_30_50, &m.noise_floor_50_80, &m.noise_rise_db, &m.crest_median_db, &m.dr_like_db}) *v = r.f64();
+    if(version >= 4) for(double* v : {&m.crest_median_l_db, &m.crest_median_r_db, &m.dr_like_l_db, &m.dr_like_r_db}) *v = r.f64();
+    if(version >= 5) for(double* v : {&m.true_peak_dbtp, &m.sample_peak_dbfs}) *v = r.f64();
+    if(version >= 7) m.noise_band_scale = r.f64();
+    return m;
+}
+static void put_clips(BinWriter& w, const ClipStats& c){
+    w.u64(c.runs); w.u64(c.samples);
+    for(uint64_t h : c.hist) w.u64(h);
+    w.u32((uint32_t)c.first.size());
+    for(const ClipRun& r : c.first){ w.f64(r.t_s); w.u32(r.samples); w.u32((uint32_t)r.channel); w.f64(r.peak_dbtp); w.u32((uint32_t)r.track); }
+}
+static ClipStats get_clips(BinReader& r){
+    ClipStats c;
+    c.runs = r.u64(); c.samples = r.u64();
+    for(uint64_t& h : c.hist) h = r.u64();
+    uint32_t n = std::min<uint32_t>(r.u32(), (uint32_t)ClipStats::kMaxRuns);
+    for(uint32_t i=0;i<n && r.ok();++i){ ClipRun x; x.t_s = r.f64(); x.samples = r.u32(); x.channel = (int)r.u32(); x.peak_dbtp = r.f64(); x.track = (int)r.u32(); c.first.push_back(x); }
+    return c;
+}
+
+static void put_fingerprint(BinWriter& w, const Fingerprint& fp){
+    w.u32(fp.valid ? 1 : 0);
+    for(int i=0;i<Fingerprint::kWords;++i){ w.u64(fp.bits[i]); w.u64(fp.mask[i]); }
+    for(int b=0;b<Fingerprint::kBands;b+=4) w.u32((uint8_t)fp.profile[b] | (uint8_t)fp.profile[b+1]<<8 | (uint8_t)fp.profile[b+2]<<16 | (uint32_t)(uint8_t)fp.profile[b+3]<<24);
+}
+static Fingerprint get_fingerprint(BinReader& r){
+    Fingerprint fp;
+    fp.valid = r.u32() != 0;
+    for(int i=0;i<Fingerprint::kWords;++i){ fp.bits[i] = r.u64(); fp.mask[i] = r.u64(); }
+    for(int b=0;b<Fingerprint::kBands;b+=4){ uint32_t v = r.u32(); for(int j=0;j<4;++j) fp.profile[b+j] = (int8_t)(uint8_t)(v>>(8*j)); }
+    return fp;
+}
+
+class Manifest {
+public:
+    static const uint32_t VERSION = 7;     // 3: early-exit point and margin after windows; 4: L/R crest and DR; 5: peaks and clip runs; 6: fingerprint; 7: noise band scale
+
+    void load(const std::string& path){
+        path_ = path;
+        std::ifstream f(path, std::ios::binary); if(!f) return;
+        char magic[8]={0}; f.read(magic, 8);
+        BinReader r(f);
+        uint32_t ver = 0;
+        if(std::memcmp(magic, "DSDIMAN", 7)!=0 || ((ver = r.u32())<2 || ver>VERSION)) return;   // unknown format: start over
+        uint32_t n = r.u32();
+        for(uint32_t i=0;i<n && r.ok();++i){
+            ManifestEntry e;
+            e.path = r.str(); e.rel_dir = r.str();
+            e.id.size = r.u64(); e.id.mtime_ns = (int64_t)r.u64(); e.id.content_hash = r.u64();
+            e.options_hash = r.u64();
+            e.info.container = r.str(); e.info.channels = (int)r.u32(); e.info.in_rate = (int)r.u32();
+            e.info.samples = r.u64(); e.info.out_sr = (int)r.u32(); e.info.decimator = r.str(); e.info.windows = (int)r.u32();
+            if(ver>=3){ e.info.stopped_at_s = r.f64(); e.info.stop_margin = r.f64(); }
+            e.m = get_metrics(r, ver); e.cls = r.str();
+            if(ver>=5) e.clips = get_clips(r);
+            if(ver>=6) e.fp = get_fingerprint(r);
+            if(r.ok()) entries_[e.path] = std::move(e);
+        }
+    }
+
+    // Written to a temp file and renamed so a crash never leaves it truncated.
+    void save(){
+        std::lock_guard<std::mutex> lk(mu_);
+        std::string tmp = path_ + ".tmp";
+        {
+            std::ofstream f(tmp, std::ios::binary | std::ios::trunc); if(!f) return;
+            f.write("DSDIMAN\x01", 8);
+            BinWriter w(f); w.u32(VERSION); w.u32((uint32_t)entries_.size());
+            for(const auto& kv : entries_){
+                const ManifestEntry& e = kv.second;
+                w.str(e.path); w.str(e.rel_dir);
+                w.u64(e.id.size); w.u64((uint64_t)e.id.mtime_ns); w.u64(e.id.content_hash);
+                w.u64(e.options_hash);
+                w.str(e.info.container); w.u32((uint32_t)e.info.channels); w.u32((uint32_t)e.info.in_rate);
+                w.u64(e.info.samples); w.u32((uint32_t)e.info.out_sr); w.str(e.info.decimator); w.u32((uint32_t)e.info.windows);
+                w.f64(e.info.stopped_at_s); w.f64(e.info.stop_margin);
+                put_metrics(w, e.m); w.str(e.cls); put_clips(w, e.clips); put_fingerprint(w, e.fp);
             }
-            av_frame_unref(frm);
+            if(!f) return;
         }
-        if (written>=max_samples) break;
-    }
- done:
-    sr_out = opt.target_sr;
-    av_frame_free(&frm); av_packet_free(&pkt); swr_free(&swr); avcodec_free_context(&ctx); avformat_close_input(&fmt);
-    return mono;
-}
-
-static std::vector<float> decode_to_stereo(const Options& opt, int& sr_out){
-    std::vector<float> out;
-    AVFormatContext* fmt = nullptr; if (avformat_open_input(&fmt, opt.input.c_str(), nullptr, nullptr) < 0) throw std::runtime_error("Failed to open input");
-    if (avformat_find_stream_info(fmt, nullptr) < 0) throw std::runtime_error("Failed to find stream info");
-    int astream = av_find_best_stream(fmt, AVMEDIA_TYPE_AUDIO, -1, -1, nullptr, 0); if (astream < 0) throw std::runtime_error("No audio stream");
-    AVStream* st = fmt->streams[astream]; const AVCodec* dec = avcodec_find_decoder(st->codecpar->codec_id); if(!dec) throw std::runtime_error("No decoder");
-    AVCodecContext* ctx = avcodec_alloc_context3(dec); if(!ctx) throw std::runtime_error("No codec ctx"); if (avcodec_parameters_to_context(ctx, st->codecpar) < 0) throw std::runtime_error("param->ctx failed"); if (avcodec_open2(ctx, dec, nullptr) < 0) throw std::runtime_error("open decoder failed");
-    int in_channels = ctx->ch_layout.nb_channels ? ctx->ch_layout.nb_channels : ctx->channels; int64_t in_layout = ctx->ch_layout.nb_channels ? av_get_default_channel_layout(ctx->ch_layout.nb_channels) : av_get_default_channel_layout(in_channels);
-    
-    SwrContext* swr = swr_alloc_set_opts(nullptr, AV_CH_LAYOUT_STEREO,
-    AV_SAMPLE_FMT_FLT,                     // <-- correct
-    opt.target_sr, in_layout, ctx->sample_fmt, ctx->sample_rate, 0, nullptr);
-    
-    //SwrContext* swr = swr_alloc_set_opts(nullptr, AV_CH_LAYOUT_STEREO, AV_SAMPLE_FORMAT(AV_SAMPLE_FMT_FLT), opt.target_sr, in_layout, ctx->sample_fmt, ctx->sample_rate, 0, nullptr); 
-    if(!swr || swr_init(swr)<0) throw std::runtime_error("swr init failed");
-    AVPacket* pkt = av_packet_alloc(); AVFrame* frm = av_frame_alloc(); int64_t max_samples = (opt.seconds>0) ? (int64_t)opt.target_sr*opt.seconds : INT64_MAX; int64_t written=0;
-    while (av_read_frame(fmt, pkt) >= 0){ if (pkt->stream_index != astream){ av_packet_unref(pkt); continue; } if (avcodec_send_packet(ctx, pkt) < 0){ av_packet_unref(pkt); break; } av_packet_unref(pkt); while (avcodec_receive_frame(ctx, frm) >= 0){ const uint8_t** in = (const uint8_t**)frm->extended_data; int outcount = av_rescale_rnd(swr_get_delay(swr, ctx->sample_rate)+frm->nb_samples, opt.target_sr, ctx->sample_rate, AV_ROUND_UP); std::vector<float> tmp(outcount*2); uint8_t* outptr = (uint8_t*)tmp.data(); int conv = swr_convert(swr, &outptr, outcount, in, frm->nb_samples); if(conv>0){ int ns=conv; tmp.resize(ns*2); int64_t can = std::min<int64_t>(ns, (max_samples - written)); if(can<=0){ av_frame_unref(frm); goto done2; } out.insert(out.end(), tmp.begin(), tmp.begin()+can*2); written+=can; } av_frame_unref(frm);} if(written>=max_samples) break; }
- done2:
-    sr_out=opt.target_sr; av_frame_free(&frm); av_packet_free(&pkt); swr_free(&swr); avcodec_free_context(&ctx); avformat_close_input(&fmt); return out; }
-
-// ----------------- Spectral analysis -----------------
-struct SpectralOutputs{
-    std::vector<double> freq;       // Hz
-    std::vector<double> avg_mag_db; // dBFS
-    std::vector<unsigned char> spectrogram_png; // grayscale heat
-    int spec_w=0, spec_h=0;
+        std::rename(tmp.c_str(), path_.c_str());
+        dirty_ = false;
+    }
+
+    bool find(const std::string& path, ManifestEntry& out){
+        std::lock_guard<std::mutex> lk(mu_);
+        auto it = entries_.find(path); if(it==entries_.end()) return false;
+        out = it->second; return true;
+    }
+    void put(ManifestEntry e){ std::lock_guard<std::mutex> lk(mu_); entries_[e.path] = std::move(e); dirty_ = true; }
+    // Drops inputs that are no longer part of the scan.
+    void retain(const std::set<std::string>& paths){
+        std::lock_guard<std::mutex> lk(mu_);
+        for(auto it=entries_.begin(); it!=entries_.end(); ) if(!paths.count(it->first)){ it=entries_.erase(it); dirty_=true; } else ++it;
+    }
+    bool dirty(){ std::lock_guard<std::mutex> lk(mu_); return dirty_; }
+    // Calls fn on every entry, in path order, with the manifest locked.
+    template <class F> void for_each(F fn){ std::lock_guard<std::mutex> lk(mu_); for(const auto& kv : entries_) fn(kv.second); }
+
+private:
+    std::string path_;
+    std::mutex mu_;
+    std::map<std::string, ManifestEntry> entries_;
+    bool dirty_ = false;
 };
 
-static SpectralOutputs compute_spectrum_and_spectrogram(const std::vector<float>& x, int sr, int Nfft, int hop, const std::string&){
-    SpectralOutputs out; int H = Nfft/2+1;
-    std::vector<double> window(Nfft); make_hann(window);
-    std::vector<double> in(Nfft);
-    fftw_complex* cplx = (fftw_complex*)fftw_malloc(sizeof(fftw_complex)*H);
-    fftw_plan plan = fftw_plan_dft_r2c_1d(Nfft, in.data(), cplx, FFTW_ESTIMATE);
-
-    size_t frames = (x.size()>= (size_t)Nfft) ? (x.size()-Nfft)/hop + 1 : 0;
-    std::vector<double> avg(H, 0.0);
-    int W = (int)frames; int IMG_H = 512; std::vector<unsigned char> img(W*IMG_H, 0);
-    auto magdb = [&](double re, double im){ double m = std::sqrt(re*re+im*im) / (Nfft/2.0); double db = 20.0*std::log10(m + 1e-12); return std::clamp(db, -120.0, 0.0); };
-
-    for(size_t f=0; f<frames; ++f){
-        size_t off = f*hop;
-        for(int n=0;n<Nfft;++n){ in[n] = (double)x[off+n] * window[n]; }
-        fftw_execute(plan);
-        double maxbin= -1e9, minbin=1e9; std::vector<double> frame_db(H);
-        for(int k=0;k<H;++k){ double db = magdb(cplx[k][0], cplx[k][1]); frame_db[k]=db; avg[k] += db; if(db>maxbin) maxbin=db; if(db<minbin) minbin=db; }
-        double span = std::max(10.0, maxbin - minbin);
-        for(int y=0;y<IMG_H;++y){ int k = (int)((double)y/IMG_H * (H-1)); double v = (frame_db[k]-minbin)/span; unsigned char g = (unsigned char)std::clamp((int)(v*255.0),0,255); img[(IMG_H-1-y)*W + (int)f] = g; }
-    }
-
-    if(frames>0){ for(int k=0;k<H;++k) avg[k]/= (double)frames; }
-    out.freq.resize(H); for(int k=0;k<H;++k) out.freq[k] = (double)k * sr / (double)Nfft;
-    out.avg_mag_db = std::move(avg); out.spectrogram_png = std::move(img); out.spec_w = W; out.spec_h = IMG_H;
-
-    fftw_destroy_plan(plan); fftw_free(cplx); return out;
-}
-
-static void save_spectrogram_png(const SpectralOutputs& so, const std::string& path){ if(so.spec_w<=0 || so.spec_h<=0) return; write_png_gray(path.c_str(), so.spec_w, so.spec_h, so.spectrogram_png); }
-
-static void save_average_spectrum_png(const SpectralOutputs& so, const std::string& path){
-    const int W=1200, H=600; std::vector<unsigned char> img(W*H, 255);
-    auto put = [&](int x,int y,unsigned char v){ if(x>=0&&x<W&&y>=0&&y<H) img[y*W+x]=v; }; auto line = [&](int x0,int y0,int x1,int y1){ int dx=std::abs(x1-x0), sx=x0<x1?1:-1; int dy=-std::abs(y1-y0), sy=y0<y1?1:-1; int err=dx+dy; while(true){ put(x0,y0,0); if(x0==x1&&y0==y1) break; int e2=2*err; if(e2>=dy){ err+=dy; x0+=sx;} if(e2<=dx){ err+=dx; y0+=sy;} } };
-    for(int x=50;x<W-20;++x) put(x,H-40,0); for(int y=20;y<H-40;++y) put(50,y,0);
-    double fmin=20.0, fmax = so.freq.back(); auto xmap = [&](double f){ double t = std::log10(std::max(f, fmin)/fmin) / std::log10(fmax/fmin); return 50 + (int)(t*(W-70)); }; auto ymap = [&](double db){ double t = (db+120.0)/120.0; t=std::clamp(t,0.0,1.0); return 20 + (int)((1.0-t)*(H-60)); };
-    int prevx=-1, prevy=-1; for(size_t i=1;i<so.freq.size();++i){ int x = xmap(so.freq[i]); int y = ymap(so.avg_mag_db[i]); if(prevx>=0) line(prevx,prevy,x,y); prevx=x; prevy=y; }
-    write_png_gray(path.c_str(), W, H, img);
-}
-
-// ----------------- Metrics & classification -----------------
-struct Metrics { double cutoff_hz=0.0, cutoff_drop_db=0.0, noise_floor_30_50=0.0, noise_floor_50_80=0.0, noise_rise_db=0.0, crest_median_db=0.0, dr_like_db=0.0; };
-
-static double band_avg(const SpectralOutputs& so, double f0, double f1){ size_t i0 = std::lower_bound(so.freq.begin(), so.freq.end(), f0) - so.freq.begin(); size_t i1 = std::lower_bound(so.freq.begin(), so.freq.end(), f1) - so.freq.begin(); i1 = std::min(i1, so.freq.size()); if(i0>=i1) return -120.0; double s=0; size_t n=0; for(size_t i=i0;i<i1;++i){ s+=so.avg_mag_db[i]; ++n; } return (n? s/n : -120.0); }
-
-static Metrics analyze_metrics(const SpectralOutputs& so){ Metrics m; double min_db=0, min_f=0; for(size_t i=1;i<so.freq.size();++i){ double f=so.freq[i]; if(f<15000) continue; size_t j = i + (size_t)(1000.0 * so.freq.size()/so.freq.back()); if(j>=so.freq.size()) break; double drop = so.avg_mag_db[j]-so.avg_mag_db[i]; if(drop<min_db){ min_db=drop; min_f=f; } } if(min_db<-18.0){ m.cutoff_hz=min_f; m.cutoff_drop_db=min_db; } m.noise_floor_30_50=band_avg(so,30e3,50e3); m.noise_floor_50_80=band_avg(so,50e3,80e3); m.noise_rise_db=m.noise_floor_50_80-m.noise_floor_30_50; return m; }
-
-static void compute_dynamic_metrics(const std::vector<float>& x, int sr, Metrics& m){ int W = std::max(1,3*sr); std::vector<double> crest_db; crest_db.reserve(x.size()/W+1); for(size_t off=0;off<x.size();off+=W){ size_t n=std::min<size_t>(W,x.size()-off); if(n<1000) break; double peak=0,sum2=0; for(size_t i=0;i<n;++i){ double v=x[off+i]; if(std::abs(v)>peak) peak=std::abs(v); sum2+=v*v; } double rms=std::sqrt(sum2/n); if(rms>0 && peak>0) crest_db.push_back(20*std::log10(peak/rms)); } if(!crest_db.empty()){ std::sort(crest_db.begin(), crest_db.end()); m.crest_median_db=crest_db[crest_db.size()/2]; } size_t B=sr; std::vector<double> peaks,rmses; for(size_t off=0; off<x.size(); off+=B){ size_t n=std::min<size_t>(B,x.size()-off); if(n<1000) break; double pk=0,s2=0; for(size_t i=0;i<n;++i){ double v=x[off+i]; if(std::abs(v)>pk) pk=std::abs(v); s2+=v*v;} peaks.push_back(20*std::log10(pk+1e-12)); double rms=std::sqrt(s2/n); rmses.push_back(20*std::log10(rms+1e-12)); } auto perc=[&](std::vector<double>& v,double p){ if(v.empty()) return -120.0; std::sort(v.begin(), v.end()); size_t idx=(size_t)std::clamp(p*(v.size()-1),0.0,(double)(v.size()-1)); return v[idx]; }; double p95=perc(peaks,0.95), p50=perc(rmses,0.50); m.dr_like_db=p95-p50; }
-
-static std::string classify(const Metrics& m){ 
-	std::string cls;
-	
-	if (m.cutoff_hz>21000 && m.cutoff_hz<23500) cls = "Likely 44.1 kHz PCM source (brickwall ~22 kHz)";
-	else if (m.cutoff_hz>=23500 && m.cutoff_hz<26500) cls = "Likely 48 kHz PCM source (brickwall ~24 kHz)";
-	else {
-		if (m.noise_rise_db>6.0) cls = "Likely native DSD (rising ultrasonic noise 30-80 kHz)";
-		else if (m.noise_floor_30_50>-60 && m.noise_rise_db>=-3 && m.noise_rise_db<=3)
-			cls = "Likely Hi-Res PCM -> DSD (extended HF but flat ultrasonic noise)";
-		else cls = "Inconclusive - could be carefully filtered hi-res or processed";
-	}
-	if (m.dr_like_db<=7.5 || m.crest_median_db<=7.0)
-		cls += "; Note: probable heavy dynamic compression (loudness-war).";
-
-	
-	return cls; 
-}
-
-static void save_report(const std::string& path, const Options& opt, int sr, const Metrics& m, const std::string& cls){ std::ofstream f(path); f << "DSD Inspector Report\n"; f << "Input: " << opt.input << "\n"; f << "Resampled to: " << sr << " Hz mono\n"; f << "FFT: " << opt.fft_size << ", hop: " << opt.hop_size << ", analyzed seconds: " << opt.seconds << "\n\n"; f << "— Brickwall/cutoff: "; if(m.cutoff_hz>0) f << m.cutoff_hz << " Hz (drop " << m.cutoff_drop_db << " dB)\n"; else f << "none\n"; f << "— Noise floor 30–50 kHz: " << m.noise_floor_30_50 << " dBFS\n"; f << "— Noise floor 50–80 kHz: " << m.noise_floor_50_80 << " dBFS\n"; f << "— Ultrasonic noise rise (50–80 minus 30–50): " << m.noise_rise_db << " dB\n"; f << "— Crest factor (median): " << m.crest_median_db << " dB\n"; f << "— DR-like metric: " << m.dr_like_db << " dB\n\n"; f << "Classification: " << cls << "\n"; }
-
-// ----------------- Pretty renderers -----------------
-//static void save_pretty_spectrogram(const SpectralOutputs& so, int sr, const std::string& path){
-    //int W = so.spec_w, H = so.spec_h; if(W<=0||H<=0) return; int PADL=60, PADB=40, PADR=10, PADT=10; ImageRGB im(W+PADL+PADR,H+PADT+PADB); im.clear(10,10,10);
-    //for(int x=0;x<W;++x){ 
-		//for(int y=0;y<H;++y){ 
-			//unsigned char g = so.spectrogram_png[y*W + x];
-			//// brighten midtones: gamma 0.75
-			//double t = std::pow(g / 255.0, 0.75);
-			//unsigned char r,gc,b;
-			//colormap_turbo(t, r, gc, b);
-			//im.set(PADL+x, PADT+y, r, gc, b);
-		//}}
-    //std::vector<int> gridk={1,2,5,10,15,20,25,30,35,40}; auto xmap=[&](double f){ double t = std::log10(std::max(20.0,f)/20.0)/std::log10((sr*0.5)/20.0); return PADL + (int)std::round(t*W); };
-    //for(int k: gridk){ int x=xmap(k*1000.0); for(int y=PADT;y<PADT+H;++y) im.set(x,y,40,40,40);
-		//draw_text(im,x-10,H+PADT+5,std::to_string(k)+"k",180,180,180); 
-	//}
-    //auto ymap=[&](double db){ double t=(db+120.0)/120.0; return PADT + (int)std::round((1.0-t)*H); };
-    //for(int db=-108; db<=0; db+=12){ int y=ymap(db); for(int x=PADL;x<PADL+W;++x) im.set(x,y,40,40,40); draw_text(im,5,y-3,std::to_string(db),180,180,180); }
-    //draw_text(im, (PADL+W)/2 - 10, PADT+H+20, "Hz", 220,220,220); draw_text(im, 5, PADT-5, "dB", 220,220,220);
-    //write_png_rgb(path.c_str(), im.w, im.h, im.px);
-//}
-
-static void save_pretty_spectrogram(const SpectralOutputs& so, int sr, const std::string& path){
-    int W = so.spec_w, H = so.spec_h;
-    if (W <= 0 || H <= 0) return;
-
-    int PADL = 60, PADB = 40, PADR = 10, PADT = 10;
-    ImageRGB im(W + PADL + PADR, H + PADT + PADB);
-    im.clear(10, 10, 10);
-
-    // draw colormapped spectrogram (brighten with gamma)
-    for (int x = 0; x < W; ++x) {
-        for (int y = 0; y < H; ++y) {
-            unsigned char g = so.spectrogram_png[y * W + x];
-            double t = std::pow(g / 255.0, 0.75);   // brighten
-            unsigned char r, gc, b;
-            colormap_turbo(t, r, gc, b);
-            im.set(PADL + x, PADT + y, r, gc, b);
-        }
+// Legacy <outdir>/.spectra.cache. Fills mono (and left/right when present);
+// false if missing or inconsistent.
+static bool load_spectra_cache(const std::string& path, FileResult& r){
+    std::ifstream f(path, std::ios::binary); if(!f) return false;
+    char magic[8]={0}; f.read(magic, 8);
+    if(std::memcmp(magic, "DSDISPC\x01", 8)!=0) return false;
+    BinReader rd(f);
+    uint32_t sr=rd.u32(), nfft=rd.u32(), bins=rd.u32(), nch=rd.u32();
+    if(!rd.ok() || nfft==0 || bins!=nfft/2+1 || (nch!=1 && nch!=3)) return false;
+    SpectralOutputs* outs[3] = { &r.mono, &r.left, &r.right };
+    for(uint32_t c=0;c<nch;++c){
+        SpectralOutputs& so = *outs[c];
+        so.freq.resize(bins); so.avg_mag_db.resize(bins);
+        for(uint32_t k=0;k<bins;++k){ so.freq[k] = (double)k*sr/(double)nfft; so.avg_mag_db[k] = rd.f32(); }
     }
+    return rd.ok();
+}
 
-    // grid (log-f on x)
-    std::vector<int> gridk = {1,2,5,10,15,20,25,30,35,40};
-    auto xmap = [&](double f){
-        double t = std::log10(std::max(20.0, f)/20.0) / std::log10((sr*0.5)/20.0);
-        return PADL + (int)std::round(t * W);
-    };
-    for (int k : gridk) {
-        int x = xmap(k * 1000.0);
-        for (int y = PADT; y < PADT + H; ++y) im.set(x, y, 40, 40, 40);
-        // big tick label on x
-		// x tick
-		draw_text_scaled_nn(im, x - 12, PADT + H + 10,
-							ascii_sanitize(std::to_string(k) + "k"),
-							200, 200, 200, 2);
-    }
-
-    // y grid (dB)
-    auto ymap = [&](double db){
-        double t = (db + 120.0) / 120.0;
-        return PADT + (int)std::round((1.0 - t) * H);
+// <outdir>/spectra.bin, or the .spectra.cache of a tree analyzed by an earlier version.
+static bool load_spectra(const std::string& outdir, FileResult& r){
+    SpectralOutputs* outs[3] = { &r.mono, &r.left, &r.right };
+    return load_spectra_bin(outdir + "/spectra.bin", outs) || load_spectra_cache(outdir + "/.spectra.cache", r);
+}
+
+// ----------------- Fingerprint index (--find-similar) -----------------
+// OUTROOT/fingerprints.idx is rebuilt from the manifest whenever the manifest
+// is saved, in a layout a query maps and scans in place:
+//   0  char[8]  "DSDIFPX" + NUL
+//   8  u32      format version (1)
+//  12  u32      records
+//  16  u32      record size (144)
+//  20  u32      reserved (0)
+//  24  u64      offset of the path strings
+//  32  FingerprintRecord[records] (core.h, little-endian hosts)
+//      char     paths (UTF-8, not terminated)
+// Album folders have no fingerprint of their own; with --album their tracks are indexed.
+static const uint32_t FP_INDEX_FORMAT = 1;
+
+static void write_fingerprint_index(const std::string& outroot, Manifest& manifest){
+    std::vector<FingerprintRecord> recs; std::string paths;
+    manifest.for_each([&](const ManifestEntry& e){
+        if(!e.fp.valid) return;
+        FingerprintRecord r = fingerprint_record(e.fp, e.info.duration_s());
+        r.path_off = (uint32_t)paths.size(); r.path_len = (uint32_t)e.path.size();
+        paths += e.path; recs.push_back(r);
+    });
+    std::string tmp = outroot + "/fingerprints.idx.tmp";
+    {
+        std::ofstream f(tmp, std::ios::binary | std::ios::trunc); if(!f) return;
+        f.write("DSDIFPX\0", 8);
+        BinWriter w(f);
+        w.u32(FP_INDEX_FORMAT); w.u32((uint32_t)recs.size()); w.u32((uint32_t)sizeof(FingerprintRecord)); w.u32(0);
+        w.u64(32 + recs.size()*sizeof(FingerprintRecord));
+        f.write((const char*)recs.data(), (std::streamsize)(recs.size()*sizeof(FingerprintRecord)));
+        f.write(paths.data(), (std::streamsize)paths.size());
+        if(!f) return;
+    }
+    std::rename(tmp.c_str(), (outroot + "/fingerprints.idx").c_str());
+}
+
+// --find-similar: the indexed files closest to opt.input. Its own entry is
+// used when it is indexed, otherwise it is analyzed with the current options.
+// Entries are ranked by the share of differing fingerprint bits; those with
+// fewer than 64 bits measured in common (sampled or very short analyses)
+// follow, ranked by the correlation of their spectral profiles.
+static int find_similar(const Options& opt, const std::string& index_path, int top){
+    namespace fs = std::filesystem;
+    const int kMinCommon = 64;
+    const double kSameBer = 0.25, kSameCorr = 0.98;
+    MappedFile idx;
+    if(!idx.open(index_path) || idx.size() < 32 || std::memcmp(idx.data(), "DSDIFPX\0", 8)!=0)
+        throw std::runtime_error("no fingerprint index at " + index_path + " (run --tree first)");
+    const uint8_t* p = idx.data();
+    const uint32_t n = rd_le32(p+12);
+    const uint64_t soff = rd_le64(p+24);
+    if(rd_le32(p+8)!=FP_INDEX_FORMAT || rd_le32(p+16)!=sizeof(FingerprintRecord) || soff != 32 + (uint64_t)n*sizeof(FingerprintRecord) || soff > idx.size())
+        throw std::runtime_error("unsupported fingerprint index: " + index_path);
+    const FingerprintRecord* recs = (const FingerprintRecord*)(p + 32);   // page-aligned mapping: records are 8-byte aligned
+    const char* strs = (const char*)p + soff; const size_t slen = idx.size() - soff;
+    auto path_of = [&](const FingerprintRecord& r){ return (size_t)r.path_off + r.path_len <= slen ? std::string(strs + r.path_off, r.path_len) : std::string(); };
+
+    std::error_code ec;
+    const std::string query = fs::weakly_canonical(fs::absolute(opt.input), ec).string();
+    FingerprintRecord q{}; long self = -1;
+    for(uint32_t i=0;i<n && self<0;++i) if(path_of(recs[i]) == query){ q = recs[i]; self = i; }
+    if(self < 0){
+        dsdinspect::Result res = thread_analyzer(opt).analyze(opt.input);
+        if(!res.fingerprint.valid) throw std::runtime_error("no fingerprint for " + opt.input);
+        q = fingerprint_record(res.fingerprint, res.info.duration_s());
+    }
+    int qbits = 0; for(uint64_t m : q.mask) qbits += __builtin_popcountll(m);
+
+    std::vector<uint16_t> diff(n), common(n); std::vector<int32_t> dot(n);
+    auto t0 = std::chrono::steady_clock::now();
+    select_fingerprint_scan(opt.simd)(recs, n, q, diff.data(), common.data(), dot.data());
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+
+    struct Hit { uint32_t i; bool timed; double ber, corr; };
+    std::vector<Hit> hits; hits.reserve(n);
+    for(uint32_t i=0;i<n;++i){
+        if((long)i == self) continue;
+        double nn = (double)recs[i].norm * q.norm;
+        hits.push_back({i, common[i] >= kMinCommon, common[i] ? (double)diff[i]/common[i] : 1.0, nn>0 ? dot[i]/nn : 0.0});
+    }
+    auto better = [](const Hit& a, const Hit& b){
+        if(a.timed != b.timed) return a.timed;
+        if(a.timed && a.ber != b.ber) return a.ber < b.ber;
+        return a.corr > b.corr;
     };
-    for (int db = -108; db <= 0; db += 12) {
-        int y = ymap(db);
-        for (int x = PADL; x < PADL + W; ++x) im.set(x, y, 40, 40, 40);
-        // big tick label on y
-		// y tick
-		draw_text_scaled_nn(im, 8, y - 5,
-							ascii_sanitize(std::to_string(db)),
-							200, 200, 200, 2);
+    size_t k = std::min(hits.size(), (size_t)std::max(0, top));
+    std::partial_sort(hits.begin(), hits.begin()+k, hits.end(), better);
+
+    std::cout << "Query: " << query << " (" << (self >= 0 ? "indexed" : "analyzed") << ", " << qbits << " fingerprint bits, " << q.duration_s << " s)\n";
+    char line[96];
+    snprintf(line, sizeof line, "%4s %7s %7s %9s  %s\n", "", "BER", "corr", "duration", "path"); std::cout << line;
+    for(size_t j=0;j<k;++j){
+        const Hit& h = hits[j];
+        char ber[16]; if(h.timed) snprintf(ber, sizeof ber, "%.1f%%", 100*h.ber); else snprintf(ber, sizeof ber, "n/a");
+        snprintf(line, sizeof line, "%3zu. %7s %7.3f %8.1fs  ", j+1, ber, h.corr, recs[h.i].duration_s);
+        std::cout << line << path_of(recs[h.i]);
+        if(h.timed && h.ber <= kSameBer) std::cout << (h.corr >= kSameCorr ? "  [duplicate]" : "  [same recording, different spectrum]");
+        std::cout << "\n";
+    }
+    std::cerr << "scanned " << n << " fingerprints in " << ms << " ms\n";
+    return 0;
+}
+
+// ----------------- Library scan (--tree) -----------------
+// Work-stealing pool for album jobs of very uneven length: each worker pops
+// its own deque from the back and steals from the front of the others.
+class WorkStealingPool {
+public:
+    explicit WorkStealingPool(int n){
+        if(n<=0) n = (int)std::max(1u, std::thread::hardware_concurrency());
+        for(int i=0;i<n;++i) queues_.emplace_back(new Queue);
+        for(int i=0;i<n;++i) threads_.emplace_back([this,i]{ worker(i); });
+    }
+    ~WorkStealingPool(){
+        { std::lock_guard<std::mutex> lk(mu_); stop_=true; }
+        cv_.notify_all();
+        for(auto& t : threads_) t.join();
+    }
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    void submit(std::function<void()> task){
+        Queue& q = *queues_[rr_++ % queues_.size()];
+        { std::lock_guard<std::mutex> lk(q.mu); q.tasks.push_back(std::move(task)); }
+        { std::lock_guard<std::mutex> lk(mu_); ++queued_; ++pending_; }
+        cv_.notify_one();
+    }
+    // Blocks until every submitted task has finished.
+    void wait(){ std::unique_lock<std::mutex> lk(mu_); idle_cv_.wait(lk, [&]{ return pending_==0; }); }
+
+private:
+    struct Queue { std::mutex mu; std::deque<std::function<void()>> tasks; };
+
+    bool try_pop(size_t self, std::function<void()>& out){
+        for(size_t k=0;k<queues_.size();++k){
+            Queue& q = *queues_[(self+k) % queues_.size()];
+            std::lock_guard<std::mutex> lk(q.mu);
+            if(q.tasks.empty()) continue;
+            if(k==0){ out = std::move(q.tasks.back()); q.tasks.pop_back(); }
+            else    { out = std::move(q.tasks.front()); q.tasks.pop_front(); }
+            return true;
+        }
+        return false;
+    }
+    void worker(size_t self){
+        for(;;){
+            {
+                std::unique_lock<std::mutex> lk(mu_);
+                cv_.wait(lk, [&]{ return stop_ || queued_>0; });
+                if(stop_ && queued_==0) return;
+            }
+            std::function<void()> task;
+            if(!try_pop(self, task)) continue;
+            { std::lock_guard<std::mutex> lk(mu_); --queued_; }
+            task();
+            { std::lock_guard<std::mutex> lk(mu_); if(--pending_==0) idle_cv_.notify_all(); }
+        }
     }
 
-	// axis labels
-	draw_text_scaled_nn(im, (PADL + W) / 2 - 10, PADT + H + 20, ascii_sanitize("Hz"), 220,220,220, 2);
-	draw_text_scaled_nn(im, 8,                   PADT -  2,     ascii_sanitize("dB"), 220,220,220, 2);
+    std::vector<std::unique_ptr<Queue>> queues_;
+    std::vector<std::thread> threads_;
+    std::mutex mu_; std::condition_variable cv_, idle_cv_;
+    size_t queued_=0, pending_=0, rr_=0; bool stop_=false;
+};
 
-    write_png_rgb(path.c_str(), im.w, im.h, im.px);
-}
-static void draw_text_bold(ImageRGB& im, int x, int y, const std::string& s,
-                           unsigned char r, unsigned char g, unsigned char b,
-                           int thickness = 2)
-{
-    for (int dx = 0; dx < thickness; ++dx)
-        for (int dy = 0; dy < thickness; ++dy)
-            draw_text(im, x + dx, y + dy, s, r, g, b);
+struct TreeOptions {
+    std::string root;
+    bool include_dff = false;
+    bool force = false;          // re-analyze even if the manifest says the outputs are current
+    bool hash = false;           // also compare a hash of each file's first/last 64 KiB
+    bool reclassify = false;     // rewrite report/overlay of cached entries from cached metrics/spectra
+    int jobs = 0;                // concurrent albums (0 = all cores)
+    int max_decodes = 4;         // concurrent files being read
+    bool watch = false;          // --watch: keep running and pick up new/changed files
+    double debounce_s = 5;       // quiet time before a changed folder is analyzed
+    double poll_s = 0;           // re-list the tree every N s instead of inotify (0 = inotify)
+    bool defer_render = true;    // hand renders to the worker's RenderLane (run_tree only; --watch renders inline)
+};
+
+static bool has_ext_ci(const std::filesystem::path& p, const char* ext){
+    std::string e = p.extension().string();
+    std::transform(e.begin(), e.end(), e.begin(), [](unsigned char c){ return (char)std::tolower(c); });
+    return e == ext;
 }
 
+static bool file_nonempty(const std::filesystem::path& p){ std::error_code ec; auto n = std::filesystem::file_size(p, ec); return !ec && n > 0; }
 
+static std::string html_escape(const std::string& s){
+    std::string o; o.reserve(s.size());
+    for(char c : s){ switch(c){ case '&': o+="&amp;"; break; case '<': o+="&lt;"; break; case '>': o+="&gt;"; break; case '"': o+="&quot;"; break; default: o+=c; } }
+    return o;
+}
 
+struct AlbumEntry {
+    std::string file;            // analyzed file
+    std::string rel_dir;         // folder relative to the scan root
+    std::string cls;
+    bool have = false;           // info and m are set (analyzed now or cached)
+    StreamInfo info;
+    Metrics m;
+    uint64_t clip_runs = 0;
+};
 
+static std::string csv_field(const std::string& s){
+    if(s.find_first_of(",\"\r\n") == std::string::npos) return s;
+    std::string o = "\""; for(char c : s){ if(c=='"') o += '"'; o += c; } return o + "\"";
+}
 
-static void save_pretty_spectrum_overlay(const SpectralOutputs& L, const SpectralOutputs& R,
-                                         int sr, const Metrics& m, const std::string& cls,
-                                         const std::string& path)
-{
+// OUTROOT/summary.csv: one row per album with the stream properties, every
+// metric and the classification, for spreadsheets and library-wide statistics.
+static void write_summary_csv(const std::string& outroot, const std::vector<AlbumEntry>& albums){
+    std::ofstream f(outroot + "/summary.csv.tmp");
+    f << "rel_dir,file,container,channels,in_rate,duration_s,out_sr,decimator,cutoff_hz,cutoff_drop_db,noise_floor_30_50,noise_floor_50_80,noise_rise_db,crest_median_db,dr_like_db,crest_median_l_db,crest_median_r_db,dr_like_l_db,dr_like_r_db,true_peak_dbtp,sample_peak_dbfs,clip_runs,classification\n";
+    char num[64]; auto n = [&](double v){ snprintf(num, sizeof num, "%.6g", v); return std::string(num); };
+    for(const auto& a : albums){
+        if(!a.have) continue;
+        const StreamInfo& si = a.info; const Metrics& m = a.m;
+        f << csv_field(a.rel_dir) << ',' << csv_field(a.file) << ',' << csv_field(si.container) << ',' << si.channels << ',' << si.in_rate << ','
+          << n(si.duration_s()) << ',' << si.out_sr << ',' << csv_field(si.decimator) << ',' << n(m.cutoff_hz) << ',' << n(m.cutoff_drop_db) << ','
+          << n(m.noise_floor_30_50) << ',' << n(m.noise_floor_50_80) << ',' << n(m.noise_rise_db) << ',' << n(m.crest_median_db) << ','
+          << n(m.dr_like_db) << ',' << n(m.crest_median_l_db) << ',' << n(m.crest_median_r_db) << ',' << n(m.dr_like_l_db) << ',' << n(m.dr_like_r_db) << ','
+          << n(m.true_peak_dbtp) << ',' << n(m.sample_peak_dbfs) << ',' << a.clip_runs << ',' << csv_field(a.cls) << '\n';
+    }
+    f.close();
+    std::rename((outroot + "/summary.csv.tmp").c_str(), (outroot + "/summary.csv").c_str());
+}
 
-	const std::string TITLE = ascii_sanitize("Spectrum (log-f) - L (magenta) / R (cyan)");
-	const std::string BAND  = ascii_sanitize("DSD noise-shaping band");
-	std::string cls_ascii   = ascii_sanitize(cls);
+// Same layout and markup as dsd_tree_to_html.sh.
+static void write_index_html(const std::string& outroot, const std::string& root, const std::vector<AlbumEntry>& albums){
+    namespace fs = std::filesystem;
+    std::ofstream f(outroot + "/index.html.tmp");   // renamed at the end, so --watch never serves half a page
+    f << "<!doctype html>\n<html lang=\"en\"><meta charset=\"utf-8\">\n<title>DSD Inspector — summary</title>\n"
+         "<style>\n"
+         "  body { font-family: system-ui, sans-serif; margin: 24px; background:#0b0b0b; color:#f0f0f0; }\n"
+         "  h1 { margin: 0 0 12px 0; font-weight: 600; }\n"
+         "  .meta { color:#aaa; font-size: 12px; margin-bottom: 6px; }\n"
+         "  .grid { display: grid; grid-template-columns: repeat(auto-fit, minmax(480px, 1fr)); gap: 24px; }\n"
+         "  .card { background:#131313; border:1px solid #2a2a2a; border-radius:14px; padding:16px; }\n"
+         "  .card h2 { font-size: 16px; margin: 0 0 6px 0; font-weight:600; word-break: break-all; }\n"
+         "  .imgs { display:flex; gap:12px; flex-wrap:wrap; }\n"
+         "  .imgs img { max-width: 100%; height:auto; border:1px solid #2a2a2a; border-radius:10px; }\n"
+         "  a { color:#88c9ff; text-decoration:none; }\n"
+         "  a:hover { text-decoration:underline; }\n"
+         "  code { color:#ddd; }\n"
+         "</style>\n"
+      << "<h1>DSD Inspector — summary</h1>\n<p>Scanned root: <code>" << html_escape(root) << "</code></p>\n<div class=\"grid\">\n";
+    for(const auto& a : albums){
+        fs::path od = fs::path(outroot) / a.rel_dir;
+        std::string rel = html_escape(a.rel_dir), base = html_escape(fs::path(a.file).filename().string());
+        f << "<div class=\"card\">\n<h2>" << base << "</h2>\n<div class=\"meta\">" << rel << "</div>\n";
+        if(!a.cls.empty()) f << "<p><strong>Classification:</strong> " << html_escape(a.cls) << "</p>\n";
+        f << "<div class=\"imgs\">\n";
+        if(file_nonempty(od/"spectrum_overlay.png"))   f << "<img src=\"" << rel << "/spectrum_overlay.png\" alt=\"spectrum_overlay for " << base << "\">\n";
+        if(file_nonempty(od/"spectrogram_pretty.png")) f << "<img src=\"" << rel << "/spectrogram_pretty.png\" alt=\"spectrogram_pretty for " << base << "\">\n";
+        f << "</div>\n<p><a href=\"" << rel << "/report.txt\">report.txt</a>";
+        if(file_nonempty(od/"report.json")) f << " &middot; <a href=\"" << rel << "/report.json\">report.json</a>";
+        if(file_nonempty(od/"spectrogram.png")) f << " &middot; <a href=\"" << rel << "/spectrogram.png\">spectrogram.png</a>";
+        if(file_nonempty(od/"spectrum_avg.png")) f << " &middot; <a href=\"" << rel << "/spectrum_avg.png\">spectrum_avg.png</a>";
+        f << "</p>\n</div>\n";
+    }
+    f << "</div></html>\n";
+    f.close();
+    std::rename((outroot + "/index.html.tmp").c_str(), (outroot + "/index.html").c_str());
+}
 
-    const int W=1400, H=700;
-    ImageRGB im(W,H); im.clear(0,0,0);
+// Re-runs classify() on cached metrics and rewrites report.txt and the
+// overlay (which prints the classification) without decoding.
+// In album mode, tracks (from the per-track manifest entries) are reclassified too.
+static void regenerate_from_cache(const Options& opt, ManifestEntry& e, std::vector<TrackSummary>* tracks=nullptr){
+    e.cls = classify(e.m);
+    if(tracks) for(auto& t : *tracks) if(t.error.empty()) t.cls = classify(t.m);
+    save_report(opt.outdir+"/report.txt", opt, e.info, e.m, e.clips, e.cls, tracks);
+    save_report_json(opt.outdir+"/report.json", opt, e.info, e.m, e.clips, e.cls, tracks);
+    FileResult r;
+    if(opt.pretty && load_spectra(opt.outdir, r) && !r.left.avg_mag_db.empty())
+        save_pretty_spectrum_overlay(r.left, r.right, e.info.out_sr, e.m, e.cls, opt.outdir+"/spectrum_overlay.png");
+}
 
-    const int PADL=70, PADB=60, PADR=15, PADT=15;
-    const int PW=W-PADL-PADR, PH=H-PADT-PADB;
+// Outputs added after a tree was analyzed (report.json, spectra.bin) are
+// written from the manifest entry and the legacy spectra cache, without decoding.
+static void backfill_outputs(const Options& opt, const ManifestEntry& e){
+    if(!file_nonempty(opt.outdir + "/report.json")) save_report_json(opt.outdir + "/report.json", opt, e.info, e.m, e.clips, e.cls);
+    FileResult r;
+    if(!file_nonempty(opt.outdir + "/spectra.bin") && load_spectra_cache(opt.outdir + "/.spectra.cache", r))
+        save_spectra_bin(opt.outdir + "/spectra.bin", e.info.out_sr, opt.fft_size*rate_scale(opt, e.info), r.mono, r.left, r.right);
+}
 
-    // text scales (NN upscaled for larger labels)
-    const int SCALE_TITLE = 2;
-    const int SCALE_AXIS  = 2;
-    const int MIN_DX_LABEL = 34;  // min x-spacing between x-axis labels (pixels)
+// Folder -> chosen file for every folder under root with a .dsf (or .dff):
+// the lexicographically smallest name, as dsd_tree_to_html.sh picks it.
+static std::map<std::filesystem::path, std::filesystem::path> find_albums(const std::filesystem::path& root, bool include_dff){
+    namespace fs = std::filesystem;
+    std::error_code ec;
+    std::map<fs::path, fs::path> first;
+    for(auto it = fs::recursive_directory_iterator(root, fs::directory_options::skip_permission_denied, ec);
+        it != fs::recursive_directory_iterator(); it.increment(ec)){
+        if(ec){ ec.clear(); continue; }
+        if(!it->is_regular_file(ec)) continue;
+        const fs::path& p = it->path();
+        if(!(has_ext_ci(p, ".dsf") || (include_dff && has_ext_ci(p, ".dff")))) continue;
+        auto f = first.find(p.parent_path());
+        if(f == first.end()) first.emplace(p.parent_path(), p);
+        else if(p.filename() < f->second.filename()) f->second = p;
+    }
+    return first;
+}
 
-    auto xmap=[&](double f){
-        double t = std::log10(std::max(20.0, f)/20.0) / std::log10((sr*0.5)/20.0);
-        return PADL + (int)std::round(t*PW);
-    };
-    auto ymap=[&](double db){
-        double t = (db+120.0)/120.0;
-        return PADT + (int)std::round((1.0-t)*PH);
-    };
+// Every .dsf (and .dff) directly in dir, by name; the first is the one
+// find_albums() picks.
+static std::vector<std::string> list_tracks(const std::filesystem::path& dir, bool include_dff){
+    namespace fs = std::filesystem;
+    std::error_code ec;
+    std::vector<fs::path> v;
+    for(auto it = fs::directory_iterator(dir, ec); !ec && it != fs::directory_iterator(); it.increment(ec)){
+        if(!it->is_regular_file(ec)) continue;
+        const fs::path& p = it->path();
+        if(has_ext_ci(p, ".dsf") || (include_dff && has_ext_ci(p, ".dff"))) v.push_back(p);
+    }
+    std::sort(v.begin(), v.end(), [](const fs::path& a, const fs::path& b){ return a.filename() < b.filename(); });
+    std::vector<std::string> out; for(const auto& p : v) out.push_back(p.string());
+    return out;
+}
 
-    // ----- horizontal grid + dB tick labels
-    for(int db=-108; db<=0; db+=12){
-        int y=ymap(db);
-        for(int x=PADL; x<PADL+PW; ++x) im.set(x,y,40,40,40);
-        draw_text(im, 8, y-5, ascii_sanitize(std::to_string(db)), 200,200,200);  // small font = crisp, no scaling
+// Album mode: the folder's identity is the total size, the newest mtime and a
+// hash over every track's name, size, mtime (and content hash with --hash),
+// so adding, removing or changing any track makes the album stale.
+static bool album_identity(const std::vector<std::string>& tracks, bool with_hash, FileIdentity& id){
+    id = FileIdentity();
+    uint64_t h = fnv1a("album", 5);
+    for(const auto& p : tracks){
+        FileIdentity t; if(!stat_identity(p, with_hash, t)) return false;
+        id.size += t.size; id.mtime_ns = std::max(id.mtime_ns, t.mtime_ns);
+        h = fnv1a(p.data(), p.size(), h); h = fnv1a(&t, sizeof t, h);
     }
+    id.content_hash = h ? h : 1;
+    return !tracks.empty();
+}
 
-    // ----- vertical grid on log-f; auto-thin labels
-    std::vector<double> xticks;
-    double ny = sr * 0.5;
-    for(double decade=1e3; decade<=ny*1.01; decade*=10.0){
-        for(double m : {1.0,2.0,5.0}){
-            double f = m*decade;
-            if(f<=ny*1.001) xticks.push_back(f);
+// Brings one album's outputs in OUTROOT/<rel_dir> up to date. The file is
+// analyzed when it is new or changed, when the options changed, or with
+// --force; otherwise report and overlay are regenerated (--reclassify) or
+// missing outputs are backfilled from the manifest. Returns true when the
+// file was decoded (secs = analyzed audio); failures are returned in note.
+// With --album, a.file is the folder: all its tracks are analyzed and merged,
+// the manifest keeps one entry for the folder plus one per track.
+static bool update_album(const Options& base, const TreeOptions& t, const std::filesystem::path& outroot, uint64_t ohash,
+                         Manifest& manifest, CountingSemaphore& decode_slots, AlbumEntry& a, Profile* prof, double& secs, std::string& note){
+    Options opt = base;
+    opt.input = a.file;
+    opt.outdir = (outroot / a.rel_dir).string();
+    bool ran = false;
+    std::vector<std::string> tracks;
+    if(opt.album) tracks = list_tracks(a.file, t.include_dff);
+    FileIdentity id; ManifestEntry e;
+    bool have = (opt.album ? album_identity(tracks, t.hash, id) : stat_identity(opt.input, t.hash, id)) && manifest.find(opt.input, e);
+    bool fresh = have && e.id.size==id.size && e.id.mtime_ns==id.mtime_ns && e.options_hash==ohash
+              && (!(t.hash || opt.album) || e.id.content_hash==id.content_hash)
+              && file_nonempty(opt.outdir + "/report.txt")
+              && (!opt.pretty || file_nonempty(opt.outdir + "/spectrum_overlay.png"));
+    if(t.force || !fresh){
+        try{
+            FileResult r;
+            if(opt.album){
+                std::vector<TrackSummary> ts;
+                r = process_album(opt, tracks, &decode_slots, prof, ts);
+                for(const auto& s : ts){
+                    if(!s.error.empty()) continue;
+                    ManifestEntry te; te.path = s.file; te.rel_dir = a.rel_dir; stat_identity(s.file, t.hash, te.id); te.options_hash = ohash;
+                    te.info = s.info; te.m = s.m; te.cls = s.cls; te.fp = s.fp;
+                    manifest.put(std::move(te));
+                }
+            } else r = process_file(opt, &decode_slots, prof, t.defer_render && !prof);   // --profile renders inline so the file's profile covers it
+            if(prof) save_profile_json(opt.outdir + "/profile.json", opt.input, *prof);
+            e = ManifestEntry(); e.path = opt.input; e.rel_dir = a.rel_dir; e.id = id; e.options_hash = ohash;
+            e.info = r.info; e.m = r.m; e.cls = r.cls; e.clips = r.clips; e.fp = r.fp;
+            manifest.put(e);
+            a.cls = r.cls; a.info = r.info; a.m = r.m; a.clip_runs = r.clips.runs; a.have = true; ran = true; secs = r.info.out_sr ? (double)r.samples/r.info.out_sr : 0.0;
+        } catch(const std::exception& ex){ note = std::string(" [WARN] failed: ") + ex.what(); }
+    } else if(t.reclassify){
+        std::vector<TrackSummary> ts;
+        for(const auto& p : tracks){
+            ManifestEntry te; TrackSummary s; s.file = p;
+            if(manifest.find(p, te)){ s.info = te.info; s.m = te.m; } else s.error = "not in the manifest";
+            ts.push_back(std::move(s));
+        }
+        regenerate_from_cache(opt, e, opt.album ? &ts : nullptr);
+        manifest.put(e);
+        for(const auto& s : ts){
+            ManifestEntry te;
+            if(s.error.empty() && manifest.find(s.file, te)){ te.cls = s.cls; manifest.put(std::move(te)); }
         }
+        a.cls = e.cls; a.info = e.info; a.m = e.m; a.clip_runs = e.clips.runs; a.have = true;
+    } else {
+        backfill_outputs(opt, e);
+        a.cls = e.cls; a.info = e.info; a.m = e.m; a.clip_runs = e.clips.runs; a.have = true;
     }
-    xticks.push_back(22050.0);
-    xticks.push_back(24000.0);
-    std::sort(xticks.begin(), xticks.end());
-    xticks.erase(std::unique(xticks.begin(), xticks.end()), xticks.end());
+    return ran;
+}
 
-    int last_label_x = -100000;
-    auto fmt_khz = [](double f){
-        if (f >= 1000.0) { int k = (int)std::round(f/1000.0); return std::to_string(k) + "k"; }
-        return std::to_string((int)std::round(f));
-    };
+// OUTROOT/profile.json: totals over the analyzed files plus one line per file,
+// slowest (lowest realtime factor) first. The totals table goes to stderr.
+static void save_tree_profile(const std::string& path, const std::string& root, double elapsed_s, const Profile& total,
+                              std::vector<std::pair<std::string, Profile>>& files){
+    auto rt = [](const Profile& p){ return p.wall>0 ? p.audio_s/p.wall : 0.0; };
+    std::sort(files.begin(), files.end(), [&](const auto& a, const auto& b){ return rt(a.second) < rt(b.second); });
+    std::cerr << "\nProfile over " << files.size() << " files (stage times summed across parallel albums):\n";
+    print_profile(std::cerr, total);
+    std::cerr << "slowest:\n";
+    char num[64]; auto f = [&](double v){ snprintf(num, sizeof num, "%.6g", v); return std::string(num); };
+    auto top_stage = [](const Profile& p){ std::string n; double w=-1; for(const auto& kv : p.stages) if(kv.second.wall > w){ w = kv.second.wall; n = kv.first; } return n; };
+    for(size_t i=0;i<files.size() && i<5;++i)
+        std::cerr << "  " << f(rt(files[i].second)) << "x realtime, " << f(files[i].second.wall) << " s (mostly " << top_stage(files[i].second) << ")  " << files[i].first << "\n";
+    std::ofstream o(path);
+    o << "{\n  \"root\": \"" << json_escape(root) << "\", \"host\": \"" << json_escape(host_name())
+      << "\", \"hardware_threads\": " << std::thread::hardware_concurrency() << ", \"elapsed_s\": " << f(elapsed_s) << ",\n  \"total\": ";
+    write_profile_json(o, total, "  ");
+    o << ",\n  \"files\": [";
+    for(size_t i=0;i<files.size();++i){
+        const Profile& p = files[i].second;
+        o << (i ? ",\n" : "\n") << "    {\"input\": \"" << json_escape(files[i].first) << "\", \"wall_s\": " << f(p.wall) << ", \"cpu_s\": " << f(p.cpu)
+          << ", \"audio_s\": " << f(p.audio_s) << ", \"realtime\": " << f(rt(p)) << ", \"bytes_read\": " << p.bytes_read
+          << ", \"top_stage\": \"" << top_stage(p) << "\"}";
+    }
+    o << "\n  ]\n}\n";
+}
 
-    for(double f : xticks){
-        int x = xmap(f);
-        for(int y=PADT; y<PADT+PH; ++y) im.set(x,y,40,40,40); // grid line
-
-        if (x - last_label_x >= MIN_DX_LABEL) {
-            std::string lab = ascii_sanitize(fmt_khz(f));
-            int lab_w = (int)lab.size() * 6;  // small font width
-            int lx = x - lab_w/2;
-            if (lx < 2) lx = 2;
-            if (lx + lab_w > W-2) lx = W-2 - lab_w;
-            draw_text(im, lx, PADT+PH+10, lab, 200,200,200);
-            last_label_x = x;
+// Picks one file per folder the way dsd_tree_to_html.sh does (first .dsf,
+// optionally .dff; "first" = lexicographically smallest name so runs are
+// reproducible), or the whole folder with --album, and processes the folders
+// on a work-stealing pool.
+// albums_out (--watch) receives the album list the index was written from.
+static int run_tree(const Options& base, const TreeOptions& t, std::vector<AlbumEntry>* albums_out = nullptr){
+    namespace fs = std::filesystem;
+    std::error_code ec;
+    fs::path root = fs::weakly_canonical(fs::absolute(t.root), ec);
+    fs::path outroot = fs::weakly_canonical(fs::absolute(base.outdir), ec);
+    if(!fs::is_directory(root)) throw std::runtime_error("--tree: not a directory: " + root.string());
+    fs::create_directories(outroot);
+
+    std::vector<AlbumEntry> albums;
+    for(const auto& kv : find_albums(root, t.include_dff)){
+        AlbumEntry a; a.file = base.album ? kv.first.string() : kv.second.string();
+        a.rel_dir = kv.first.lexically_relative(root).string();
+        if(a.rel_dir.empty()) a.rel_dir = ".";
+        albums.push_back(a);
+    }
+    std::cerr << "Found " << albums.size() << " folders under " << root.string() << "\n";
+
+    Manifest manifest;
+    manifest.load((outroot / ".dsd_inspector_manifest").string());
+    const uint64_t ohash = options_hash(base);
+    {
+        std::set<std::string> inputs;
+        for(const auto& a : albums){
+            inputs.insert(a.file);
+            if(base.album) for(auto& p : list_tracks(a.file, t.include_dff)) inputs.insert(std::move(p));
         }
+        manifest.retain(inputs);
     }
 
-    // ----- shade the DSD noise-shaping band (22.05k..50k)
-int x22 = xmap(22050.0), x50 = xmap(50000.0);
-int xL = std::max(0, std::min(x22, W-1));
-int xR = std::max(0, std::min(x50, W-1));
-if (xL > xR) std::swap(xL, xR);
-
-for (int x = xL; x <= xR; ++x){
-    for (int y = PADT; y < PADT + PH; ++y){
-        int o = (y*W + x) * 3;                // now guaranteed in range
-        unsigned char r = im.px[o+0];
-        unsigned char g = im.px[o+1];
-        unsigned char b = im.px[o+2];
-        im.set(x, y,
-               (unsigned char)((r*3+20)/4),
-               (unsigned char)((g*3+10)/4),
-               (unsigned char)((b*3+ 0)/4));
-    }
-}
-
-    // band label
-    draw_text_scaled_nn(im, x22-280, PADT+11, BAND, 180,200,255, 2);
-    
-//// Center the band label horizontally between xL..xR, and 10 px lower than before
-//const int SCALE_BAND = 2;
-//int band_text_w = (int)BAND.size() * 6 * SCALE_BAND;   // 6 px per char at 1x
-//int band_x = (xL + xR - band_text_w) / 2;              // center inside shaded band
-//band_x = std::max(PADL + 4, std::min(band_x, W - 4 - band_text_w));
-//int band_y = PADT + 15;                                 // was PADT + 5 → 10 px lower
-//draw_text_scaled_nn(im, band_x, band_y, BAND, 180,200,255, SCALE_BAND);
-
-
-    // ----- draw curves
-    auto draw_curve=[&](const SpectralOutputs& S,unsigned char r,unsigned char g,unsigned char b){
-        int prevx=-1, prevy=-1;
-        for(size_t i=1;i<S.freq.size();++i){
-            int x=xmap(S.freq[i]);
-            int y=ymap(S.avg_mag_db[i]);
-            if(prevx>=0){
-                int dx=std::abs(x-prevx), sx=prevx<x?1:-1;
-                int dy=-std::abs(y-prevy), sy=prevy<y?1:-1;
-                int err=dx+dy; int x0=prevx,y0=prevy;
-                while(true){
-                    im.set(x0,y0,r,g,b);
-                    if(x0==x && y0==y) break;
-                    int e2=2*err;
-                    if(e2>=dy){ err+=dy; x0+=sx; }
-                    if(e2<=dx){ err+=dx; y0+=sy; }
+    CountingSemaphore decode_slots(std::max(1, t.max_decodes));
+    std::mutex log_mu;
+    auto last_save = std::chrono::steady_clock::now();
+    size_t done = 0, analyzed = 0, failed = 0; double audio_s = 0;
+    Profile total;                                         // --profile: sum over analyzed files
+    std::vector<std::pair<std::string, Profile>> file_profiles;
+    auto t0 = std::chrono::steady_clock::now();
+    {
+        WorkStealingPool pool(t.jobs);
+        for(auto& a : albums){
+            pool.submit([&, pa=&a]{
+                std::string note; double secs = 0;
+                Profile prof;
+                bool ran = update_album(base, t, outroot, ohash, manifest, decode_slots, *pa, base.profile ? &prof : nullptr, secs, note);
+
+                std::lock_guard<std::mutex> lk(log_mu);
+                ++done; if(ran) ++analyzed; if(!note.empty()) ++failed; audio_s += secs;
+                if(ran && base.profile){ total.merge(prof); file_profiles.emplace_back(pa->file, std::move(prof)); }
+                double el = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+                char line[160];
+                snprintf(line, sizeof line, "[%zu/%zu] %.2f albums/s, %.0fx realtime ", done, albums.size(),
+                         el>0 ? analyzed/el : 0.0, el>0 ? audio_s/el : 0.0);
+                std::cerr << line << (ran ? ">>> " : "cached ") << pa->file << note << "\n";
+                if(manifest.dirty() && std::chrono::steady_clock::now() - last_save > std::chrono::seconds(30)){
+                    manifest.save(); last_save = std::chrono::steady_clock::now();
                 }
+            });
+        }
+        pool.wait();
+    }
+
+    if(manifest.dirty()) manifest.save();
+    write_fingerprint_index(outroot.string(), manifest);
+    write_index_html(outroot.string(), root.string(), albums);
+    write_summary_csv(outroot.string(), albums);
+    double el = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    if(base.profile && !file_profiles.empty()) save_tree_profile((outroot / "profile.json").string(), root.string(), el, total, file_profiles);
+    std::cerr << "Analyzed " << analyzed << ", cached " << (albums.size()-analyzed-failed) << ", failed " << failed
+              << " in " << el << " s\n";
+    std::cout << "\nAll outputs are in:\n  " << outroot.string() << "\nOpen the summary:\n  " << (outroot / "index.html").string() << "\n";
+    if(albums_out) *albums_out = std::move(albums);
+    return failed ? 3 : 0;
+}
+
+// ----------------- Watch mode (--watch) -----------------
+// After a normal --tree pass the root stays watched for new or modified
+// .dsf/.dff files. An event only marks its folder dirty; the folder is picked
+// up once it has had no events for --debounce seconds and its chosen file's
+// (with --album, every track's) mtime is at least that old, so files still being copied or downloaded are
+// not read half-written. Ready folders go through update_album() on a fixed
+// pool of --jobs workers, and index.html, summary.csv and the manifest are
+// rewritten after each one. inotify watches every directory under the root;
+// without it (no inotify, watch limit reached, or --poll S) the tree is
+// re-listed every S seconds instead. Idle, the process sleeps in poll(2).
+
+static int g_watch_stop_fd = -1;   // write end of the self-pipe that SIGINT/SIGTERM end the loop with
+static void watch_signal(int){ char c = 1; if(g_watch_stop_fd >= 0){ ssize_t r = ::write(g_watch_stop_fd, &c, 1); (void)r; } }
+
+static bool path_under(const std::filesystem::path& p, const std::filesystem::path& base){
+    std::filesystem::path r = p.lexically_relative(base);
+    return !r.empty() && r.native().compare(0, 2, "..") != 0;
+}
+
+// inotify over a directory tree. Directories created or moved in later are
+// added by the caller through add_tree(); everything under `skip` (the output
+// root, when it lives inside the library) is left alone.
+class TreeWatcher {
+public:
+    static constexpr uint32_t kMask = IN_CREATE | IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE | IN_DELETE_SELF;
+
+    explicit TreeWatcher(std::filesystem::path skip) : skip_(std::move(skip)) {}
+    ~TreeWatcher(){ if(fd_ >= 0) ::close(fd_); }
+    TreeWatcher(const TreeWatcher&) = delete;
+    TreeWatcher& operator=(const TreeWatcher&) = delete;
+
+    bool open(){ fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC); return fd_ >= 0; }
+    int fd() const { return fd_; }
+    size_t size() const { return dirs_.size(); }
+
+    // Watches dir and every directory below it; added (if given) receives them.
+    // false once the kernel refuses a watch (fs.inotify.max_user_watches).
+    bool add_tree(const std::filesystem::path& dir, std::vector<std::filesystem::path>* added = nullptr){
+        namespace fs = std::filesystem;
+        std::error_code ec;
+        if(!add(dir)) return false;
+        if(added) added->push_back(dir);
+        for(auto it = fs::recursive_directory_iterator(dir, fs::directory_options::skip_permission_denied, ec);
+            it != fs::recursive_directory_iterator(); it.increment(ec)){
+            if(ec){ ec.clear(); continue; }
+            if(!it->is_directory(ec) || it->is_symlink(ec)) continue;
+            if(path_under(it->path(), skip_)){ it.disable_recursion_pending(); continue; }
+            if(!add(it->path())) return false;
+            if(added) added->push_back(it->path());
+        }
+        return true;
+    }
+
+    // Drops the watches of a directory that was deleted or moved away.
+    void forget(const std::filesystem::path& dir){
+        for(auto it = dirs_.begin(); it != dirs_.end(); ){
+            if(path_under(it->second, dir)){ inotify_rm_watch(fd_, it->first); it = dirs_.erase(it); } else ++it;
+        }
+    }
+
+    // Drains the queued events into fn(dir, name, mask). false when the kernel
+    // queue overflowed and events were lost.
+    template<class F> bool read_events(F&& fn){
+        alignas(inotify_event) char buf[16384];
+        bool complete = true;
+        for(;;){
+            ssize_t n = ::read(fd_, buf, sizeof buf);
+            if(n <= 0) break;
+            for(char* p = buf; p < buf + n; ){
+                const inotify_event* ev = (const inotify_event*)p;
+                p += sizeof(inotify_event) + ev->len;
+                if(ev->mask & IN_Q_OVERFLOW){ complete = false; continue; }
+                auto it = dirs_.find(ev->wd);
+                if(it == dirs_.end()) continue;
+                if(ev->mask & IN_IGNORED){ dirs_.erase(it); continue; }
+                fn(it->second, ev->len ? std::string(ev->name) : std::string(), ev->mask);
             }
-            prevx=x; prevy=y;
         }
-    };
-    draw_curve(L,255,100,220); // magenta-ish (Left)
-    draw_curve(R,120,200,255); // cyan-ish (Right)
+        return complete;
+    }
 
-    // ----- special markers at 22.05k & 24k
-    for(double mk : {22050.0, 24000.0}){
-        int x = xmap(mk);
-        for(int y=PADT; y<PADT+PH; ++y) im.set(x,y,100,100,100);
-        std::string lab = (mk==22050.0) ? "22.05k" : "24k";
-        int lab_w = (int)lab.size()*6;
-        int lx = std::min(std::max(x+3, 2), W-2-lab_w);
-        // special markers
-        std::string lab2 = ascii_sanitize(mk==22050.0 ? "22.05k" : "24k");
-        draw_text(im, lx, (mk==22050.0)?(PADT+15):(PADT+28), lab2, 200,200,200);
+private:
+    bool add(const std::filesystem::path& dir){
+        if(path_under(dir, skip_)) return true;
+        int wd = inotify_add_watch(fd_, dir.c_str(), kMask | IN_ONLYDIR);
+        if(wd < 0) return errno != ENOSPC && errno != ENOMEM;   // vanished or unreadable: skip it
+        dirs_[wd] = dir;
+        return true;
     }
 
-		// title / axes / classification
-	draw_text_scaled_nn(im, PADL,  6,    TITLE,    230,230,230, 2);
-	draw_text_scaled_nn(im, PADL,  H-24, ascii_sanitize("Hz"),  220,220,220, 2);
-	draw_text_scaled_nn(im, 8,     PADT-2, ascii_sanitize("dB"),220,220,220, 2);
-	draw_text_scaled_nn(im, std::max(PADL, W - 10 - (int)cls_ascii.size()*6*2),
-                    6, cls_ascii, 255,210,120, 2);
+    int fd_ = -1;
+    std::filesystem::path skip_;
+    std::map<int, std::filesystem::path> dirs_;
+};
 
+static int run_watch(const Options& base, const TreeOptions& t){
+    namespace fs = std::filesystem;
+    using Clock = std::chrono::steady_clock;
+    std::error_code ec;
+
+    std::vector<AlbumEntry> initial;
+    run_tree(base, t, &initial);           // catch up first; failures there are retried on the next change
+
+    fs::path root = fs::weakly_canonical(fs::absolute(t.root), ec);
+    fs::path outroot = fs::weakly_canonical(fs::absolute(base.outdir), ec);
+    std::map<fs::path, AlbumEntry> albums;  // folder -> card, in index order
+    for(auto& a : initial) albums[fs::path(a.file).parent_path()] = std::move(a);
+
+    Manifest manifest;
+    manifest.load((outroot / ".dsd_inspector_manifest").string());
+    const uint64_t ohash = options_hash(base);
+    TreeOptions wt = t; wt.force = false; wt.reclassify = false;   // only the initial pass honours these
+    wt.defer_render = false;   // the pool lives as long as the daemon, so lanes would never drain before publish()
+    CountingSemaphore decode_slots(std::max(1, t.max_decodes));
+
+    int stop_pipe[2];
+    if(pipe2(stop_pipe, O_CLOEXEC | O_NONBLOCK) != 0) throw std::runtime_error("--watch: pipe failed");
+    g_watch_stop_fd = stop_pipe[1];
+    auto old_int = std::signal(SIGINT, watch_signal), old_term = std::signal(SIGTERM, watch_signal);
+
+    const auto debounce = std::chrono::milliseconds((int64_t)(std::max(0.0, t.debounce_s) * 1000));
+    const auto poll_every = std::chrono::milliseconds((int64_t)((t.poll_s > 0 ? t.poll_s : 30.0) * 1000));
+    TreeWatcher watcher(outroot);
+    bool inotify = t.poll_s <= 0 && watcher.open() && watcher.add_tree(root);
+    if(t.poll_s <= 0 && !inotify) std::cerr << "[watch] inotify unavailable or out of watches, polling every " << poll_every.count()/1000.0 << " s\n";
+
+    // Polling: per folder, the chosen file's (with --album, every track's) name, size and mtime.
+    auto snapshot = [&]{
+        std::map<fs::path, std::string> s;
+        for(const auto& kv : find_albums(root, t.include_dff)){
+            std::vector<std::string> files = base.album ? list_tracks(kv.first, t.include_dff) : std::vector<std::string>{ kv.second.string() };
+            std::string& v = s[kv.first];
+            for(const auto& p : files){
+                struct stat st{};
+                if(::stat(p.c_str(), &st) != 0) continue;
+                v += fs::path(p).filename().string() + "|" + std::to_string((long long)st.st_size) + "|"
+                   + std::to_string((long long)st.st_mtim.tv_sec) + "." + std::to_string((long long)st.st_mtim.tv_nsec) + "\n";
+            }
+        }
+        return s;
+    };
+    std::map<fs::path, std::string> snap;
+    if(!inotify) snap = snapshot();
+    auto next_poll = Clock::now() + poll_every;
+
+    std::map<fs::path, Clock::time_point> pending;   // dirty folder -> earliest time to look at it
+    std::set<fs::path> running;
+    std::mutex mu;                                    // albums, running, index/csv writes, log
+    auto mark = [&](const fs::path& dir){ pending[dir] = Clock::now() + debounce; };
+    auto publish = [&]{                               // with mu held
+        std::vector<AlbumEntry> v; v.reserve(albums.size());
+        for(const auto& kv : albums) v.push_back(kv.second);
+        write_index_html(outroot.string(), root.string(), v);
+        write_summary_csv(outroot.string(), v);
+        if(manifest.dirty()){ manifest.save(); write_fingerprint_index(outroot.string(), manifest); }
+    };
+    auto rescan = [&]{
+        for(const auto& kv : find_albums(root, t.include_dff)) mark(kv.first);
+        std::lock_guard<std::mutex> lk(mu);
+        for(const auto& kv : albums) mark(kv.first);
+    };
 
-    write_png_rgb(path.c_str(), W, H, im.px);
-}
+    std::cerr << "[watch] watching " << root.string() << (inotify ? " (inotify, " + std::to_string(watcher.size()) + " directories)" : " (polling)")
+              << ", Ctrl-C to stop\n";
+    {
+        WorkStealingPool pool(t.jobs);
+        for(;;){
+            Clock::time_point wake = Clock::time_point::max();
+            for(const auto& kv : pending) wake = std::min(wake, kv.second);
+            if(!inotify) wake = std::min(wake, next_poll);
+            int timeout = -1;
+            if(wake != Clock::time_point::max()){
+                auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(wake - Clock::now()).count() + 1;
+                timeout = (int)std::clamp<int64_t>(ms, 0, 24*3600*1000);
+            }
+            pollfd fds[2] = {{stop_pipe[0], POLLIN, 0}, {watcher.fd(), POLLIN, 0}};
+            int rc = ::poll(fds, inotify ? 2 : 1, timeout);
+            if(rc < 0 && errno != EINTR) break;
+            if(rc > 0 && (fds[0].revents & POLLIN)) break;
+
+            if(inotify && rc > 0 && (fds[1].revents & POLLIN)){
+                bool out_of_watches = false;
+                bool complete = watcher.read_events([&](const fs::path& dir, const std::string& name, uint32_t mask){
+                    fs::path p = name.empty() ? dir : dir / name;
+                    if(path_under(p, outroot)) return;
+                    if(mask & IN_ISDIR){
+                        if(mask & (IN_CREATE | IN_MOVED_TO)){
+                            std::vector<fs::path> added;
+                            if(!watcher.add_tree(p, &added)) out_of_watches = true;
+                            for(const auto& d : added) mark(d);   // a moved-in album brings its files without events
+                        } else if(mask & (IN_DELETE | IN_MOVED_FROM)){ watcher.forget(p); mark(p); }
+                        return;
+                    }
+                    if(mask & IN_DELETE_SELF) return;
+                    if(has_ext_ci(p, ".dsf") || (t.include_dff && has_ext_ci(p, ".dff"))) mark(dir);
+                });
+                if(!complete){ std::cerr << "[watch] inotify queue overflowed, rescanning\n"; rescan(); }
+                if(out_of_watches){
+                    std::cerr << "[watch] out of inotify watches (fs.inotify.max_user_watches), polling every " << poll_every.count()/1000.0 << " s\n";
+                    inotify = false; snap = snapshot(); next_poll = Clock::now() + poll_every; rescan();
+                }
+            }
+            if(!inotify && Clock::now() >= next_poll){
+                auto s = snapshot();
+                for(const auto& kv : s){ auto it = snap.find(kv.first); if(it == snap.end() || it->second != kv.second) mark(kv.first); }
+                for(const auto& kv : snap) if(!s.count(kv.first)) mark(kv.first);
+                snap = std::move(s);
+                next_poll = Clock::now() + poll_every;
+            }
 
+            auto now = Clock::now();
+            for(auto it = pending.begin(); it != pending.end(); ){
+                if(it->second > now){ ++it; continue; }
+                const fs::path dir = it->first;
+                {
+                    std::lock_guard<std::mutex> lk(mu);
+                    if(running.count(dir)){ it->second = now + debounce; ++it; continue; }   // look again after this run
+                }
+                // the chosen file, or with --album every track, must have been quiet for the debounce time
+                std::vector<std::string> tracks = list_tracks(dir, t.include_dff);
+                fs::path file = tracks.empty() ? fs::path() : fs::path(tracks.front());
+                if(!base.album && tracks.size() > 1) tracks.resize(1);
+                int64_t newest = 0;
+                for(const auto& p : tracks){ struct stat st{}; if(::stat(p.c_str(), &st) == 0) newest = std::max<int64_t>(newest, (int64_t)st.st_mtim.tv_sec*1000000000ll + st.st_mtim.tv_nsec); }
+                if(newest){
+                    auto mtime = std::chrono::system_clock::time_point(std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::nanoseconds(newest)));
+                    auto age = std::chrono::system_clock::now() - mtime;
+                    if(age < debounce){ it->second = now + std::chrono::duration_cast<Clock::duration>(debounce - age); ++it; continue; }
+                }
+                it = pending.erase(it);
+
+                if(file.empty()){
+                    // Folder emptied or gone: drop its card, and those below it if it was removed. Outputs stay on disk.
+                    std::lock_guard<std::mutex> lk(mu);
+                    bool gone = !fs::exists(dir, ec);
+                    size_t before = albums.size();
+                    for(auto a = albums.begin(); a != albums.end(); ){
+                        if(a->first == dir || (gone && path_under(a->first, dir))){ std::cerr << "[watch] removed " << a->second.file << "\n"; a = albums.erase(a); }
+                        else ++a;
+                    }
+                    if(albums.size() != before) publish();
+                    continue;
+                }
+
+                { std::lock_guard<std::mutex> lk(mu); running.insert(dir); }
+                pool.submit([&, dir, file]{
+                    AlbumEntry a; a.file = base.album ? dir.string() : file.string();
+                    a.rel_dir = dir.lexically_relative(root).string();
+                    if(a.rel_dir.empty()) a.rel_dir = ".";
+                    std::string note; double secs = 0;
+                    Profile prof;
+                    auto t0 = Clock::now();
+                    bool ran = update_album(base, wt, outroot, ohash, manifest, decode_slots, a, base.profile ? &prof : nullptr, secs, note);
+                    double el = std::chrono::duration<double>(Clock::now() - t0).count();
+
+                    std::lock_guard<std::mutex> lk(mu);
+                    running.erase(dir);
+                    auto old = albums.find(dir);
+                    bool changed = ran || old == albums.end() || old->second.file != a.file || old->second.cls != a.cls;
+                    albums[dir] = a;
+                    if(ran || !note.empty()){
+                        char line[96]; snprintf(line, sizeof line, "[watch] %.1f s, %.0fx realtime ", el, el>0 ? secs/el : 0.0);
+                        std::cerr << line << (ran ? ">>> " : "") << a.file << note << "\n";
+                    }
+                    if(changed || manifest.dirty()) publish();
+                });
+            }
+        }
+        { std::lock_guard<std::mutex> lk(mu); std::cerr << "[watch] stopping, waiting for " << running.size() << " running album(s)\n"; }
+        pool.wait();
+    }
 
-static SpectralOutputs compute_avg_spectrum_of_channel(const std::vector<float>& stereo, int sr, int Nfft, int hop, int ch){ std::vector<float> x; x.reserve(stereo.size()/2); for(size_t i=ch;i<stereo.size(); i+=2) x.push_back(stereo[i]); return compute_spectrum_and_spectrogram(x, sr, Nfft, hop, ""); }
+    if(manifest.dirty()){ manifest.save(); write_fingerprint_index(outroot.string(), manifest); }
+    std::signal(SIGINT, old_int); std::signal(SIGTERM, old_term);
+    g_watch_stop_fd = -1;
+    ::close(stop_pipe[0]); ::close(stop_pipe[1]);
+    return 0;
+}
 
 // ----------------- main -----------------
 int main(int argc, char** argv){
     av_log_set_level(AV_LOG_ERROR);
-    Options opt; bool pretty=true;
+    Options opt; TreeOptions tree; bool compare=false, checkfft=false, checksample=false, out_given=false, threads_given=false, similar=false;
+    std::string index_path; int top = 10;
     for(int i=1;i<argc;++i){ std::string a=argv[i];
         if(a=="-i" && i+1<argc){ opt.input=argv[++i]; }
-        else if(a=="--out" && i+1<argc){ opt.outdir=argv[++i]; }
-        else if(a=="--sr" && i+1<argc){ opt.target_sr=std::stoi(argv[++i]); }
+        else if(a=="--out" && i+1<argc){ opt.outdir=argv[++i]; out_given=true; }
+        else if(a=="--tree" && i+1<argc){ tree.root=argv[++i]; }
+        else if(a=="--watch" && i+1<argc){ tree.root=argv[++i]; tree.watch=true; }
+        else if(a=="--debounce" && i+1<argc){ tree.debounce_s=std::stod(argv[++i]); }
+        else if(a=="--poll" && i+1<argc){ tree.poll_s=std::stod(argv[++i]); }
+        else if(a=="--include-dff"){ tree.include_dff=true; }
+        else if(a=="--force"){ tree.force=true; }
+        else if(a=="--hash"){ tree.hash=true; }
+        else if(a=="--reclassify"){ tree.reclassify=true; }
+        else if(a=="--jobs" && i+1<argc){ tree.jobs=std::stoi(argv[++i]); }
+        else if(a=="--max-decodes" && i+1<argc){ tree.max_decodes=std::stoi(argv[++i]); }
+        else if(a=="--sr" && i+1<argc){ std::string v = argv[++i]; if(v=="auto") opt.adaptive_sr=true; else { opt.target_sr=std::stoi(v); opt.adaptive_sr=false; } }
         else if(a=="--fft" && i+1<argc){ opt.fft_size=std::stoi(argv[++i]); }
         else if(a=="--hop" && i+1<argc){ opt.hop_size=std::stoi(argv[++i]); }
         else if(a=="--sec" && i+1<argc){ opt.seconds=std::stoi(argv[++i]); }
-        else if(a=="--no-pretty"){ pretty=false; }
+        else if(a=="--sample" && i+1<argc){
+            std::string v = argv[++i]; size_t c = v.find(':');
+            if(c==std::string::npos){ std::cerr << "--sample expects K:D (windows:seconds)\n"; return 1; }
+            opt.sample_windows = std::stoi(v.substr(0,c)); opt.sample_seconds = std::stod(v.substr(c+1));
+        }
+        else if(a=="--check-sample"){ checksample=true; }
+        else if(a=="--early-exit" && i+1<argc){ opt.settle_s=std::max(0.0, std::stod(argv[++i])); }
+        else if(a=="--early-exit-check" && i+1<argc){ opt.check_s=std::max(0.1, std::stod(argv[++i])); }
+        else if(a=="--threads" && i+1<argc){ opt.threads=std::stoi(argv[++i]); threads_given=true; }
+        else if(a=="--png-level" && i+1<argc){ opt.png_level=std::clamp(std::stoi(argv[++i]), 0, 9); }
+        else if(a=="--reader" && i+1<argc){ opt.native_reader = std::string(argv[++i])!="ffmpeg"; }
+        else if(a=="--decimator" && i+1<argc){ opt.native_decimator = std::string(argv[++i])!="ffmpeg"; }
+        else if(a=="--no-simd"){ opt.simd=false; }
+        else if(a=="--fft-precision" && i+1<argc){ opt.fft_double = std::string(argv[++i])=="double"; }
+        else if(a=="--spec-width" && i+1<argc){ opt.spec_width=std::max(0, std::stoi(argv[++i])); }
+        else if(a=="--spec-agg" && i+1<argc){ opt.spec_mean = std::string(argv[++i])=="mean"; }
+        else if(a=="--spec-freq" && i+1<argc){ opt.spec_logf = std::string(argv[++i])=="log"; }
+        else if(a=="--compare-decimators"){ compare=true; }
+        else if(a=="--check-fft"){ checkfft=true; }
+        else if(a=="--profile"){ opt.profile=true; }
+        else if(a=="--no-pretty"){ opt.pretty=false; }
+        else if(a=="--no-pipeline"){ opt.pipeline=false; }
+        else if(a=="--album"){ opt.album=true; }
+        else if(a=="--find-similar" && i+1<argc){ opt.input=argv[++i]; similar=true; }
+        else if(a=="--index" && i+1<argc){ index_path=argv[++i]; }
+        else if(a=="--top" && i+1<argc){ top=std::stoi(argv[++i]); }
         else { if(a=="-h"||a=="--help"){ usage(); return 0; } }
     }
+    if(!tree.root.empty()){
+        // albums run in parallel, so each one gets a single STFT thread unless asked otherwise
+        if(!threads_given) opt.threads = 1;
+        g_png.level = opt.png_level; g_png.threads = opt.threads;
+        if(!out_given) opt.outdir = "./dsd_inspector_out";
+        try{ return tree.watch ? run_watch(opt, tree) : run_tree(opt, tree); } catch(const std::exception& e){ std::cerr << "Error: " << e.what() << "\n"; return 2; }
+    }
     if(opt.input.empty()){ usage(); return 1; }
+    g_png.level = opt.png_level; g_png.threads = opt.threads;
+    if(compare){ try{ return compare_decimators(opt); } catch(const std::exception& e){ std::cerr << "Error: " << e.what() << "\n"; return 2; } }
+    if(checksample){ try{ return check_sample(opt); } catch(const std::exception& e){ std::cerr << "Error: " << e.what() << "\n"; return 2; } }
+    if(checkfft){ try{ return check_fft(opt); } catch(const std::exception& e){ std::cerr << "Error: " << e.what() << "\n"; return 2; } }
+    if(similar){
+        if(index_path.empty()) index_path = (out_given ? opt.outdir : std::string("./dsd_inspector_out")) + "/fingerprints.idx";
+        try{ return find_similar(opt, index_path, top); } catch(const std::exception& e){ std::cerr << "Error: " << e.what() << "\n"; return 2; }
+    }
 
-    std::filesystem::create_directories(opt.outdir);
+    if(opt.album){
+        try{
+            if(!std::filesystem::is_directory(opt.input)) throw std::runtime_error("--album expects -i <folder>");
+            Profile prof; prof.process_cpu = true;
+            std::vector<TrackSummary> tracks;
+            FileResult r = process_album(opt, list_tracks(opt.input, tree.include_dff), nullptr, opt.profile ? &prof : nullptr, tracks);
+            if(opt.profile){ print_profile(std::cerr, prof); save_profile_json(opt.outdir + "/profile.json", opt.input, prof); }
+            size_t outliers = 0; for(const auto& t : tracks) outliers += t.error.empty() && cls_verdict(t.cls) != cls_verdict(r.cls);
+            std::cout << tracks.size() << " tracks, " << outliers << " outliers: " << r.cls << "\n";
+            std::cout << "Done. Wrote:\n " << opt.outdir << "/spectrum_avg.png\n " << opt.outdir << "/report.txt\n " << opt.outdir << "/report.json\n " << opt.outdir << "/spectra.bin\n"; if(opt.pretty){ std::cout << " " << opt.outdir << "/spectrum_overlay.png\n"; }
+            return 0;
+        } catch(const std::exception& e){ std::cerr << "Error: " << e.what() << "\n"; return 2; }
+    }
 
     try{
-        int sr=0; auto mono = decode_to_mono(opt, sr);
-        auto so = compute_spectrum_and_spectrogram(mono, sr, opt.fft_size, opt.hop_size, opt.outdir);
-        save_spectrogram_png(so, opt.outdir+"/spectrogram.png");
-        save_average_spectrum_png(so, opt.outdir+"/spectrum_avg.png");
-        Metrics m = analyze_metrics(so); compute_dynamic_metrics(mono, sr, m);
-        auto cls = classify(m); save_report(opt.outdir+"/report.txt", opt, sr, m, cls);
-
-        if(pretty){ int sr2=0; auto stereo = decode_to_stereo(opt, sr2); auto soL = compute_avg_spectrum_of_channel(stereo, sr2, opt.fft_size, opt.hop_size, 0); auto soR = compute_avg_spectrum_of_channel(stereo, sr2, opt.fft_size, opt.hop_size, 1); save_pretty_spectrogram(so, sr2, opt.outdir+"/spectrogram_pretty.png"); save_pretty_spectrum_overlay(soL, soR, sr2, m, cls, opt.outdir+"/spectrum_overlay.png"); }
-
-        std::cout << "Done. Wrote:\n " << opt.outdir << "/spectrogram.png\n " << opt.outdir << "/spectrum_avg.png\n " << opt.outdir << "/report.txt\n"; if(pretty){ std::cout << "  " << opt.outdir << "/spectrogram_pretty.png\n " << opt.outdir << "/spectrum_overlay.png\n"; }
+        Profile prof; prof.process_cpu = true;             // nothing else runs: the process clock covers the STFT workers
+        process_file(opt, nullptr, opt.profile ? &prof : nullptr);
+        if(opt.profile){ print_profile(std::cerr, prof); save_profile_json(opt.outdir + "/profile.json", opt.input, prof); }
+        std::cout << "Done. Wrote:\n " << opt.outdir << "/spectrogram.png\n " << opt.outdir << "/spectrum_avg.png\n " << opt.outdir << "/report.txt\n " << opt.outdir << "/report.json\n " << opt.outdir << "/spectra.bin\n"; if(opt.pretty){ std::cout << "  " << opt.outdir << "/spectrogram_pretty.png\n " << opt.outdir << "/spectrum_overlay.png\n"; }
         return 0;
     } catch(const std::exception& e){ std::cerr << "Error: " << e.what() << "\n"; return 2; }
 }
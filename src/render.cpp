@@ -0,0 +1,619 @@
+// PNG output and the spectrum/spectrogram renderers shared by dsd_inspector
+// and dsd_bench (src/render.cpp).
+#include <cmath>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <zlib.h>
+
+#include "render.h"
+
+// ----------------- Tiny PNG writers (grayscale & RGB) -----------------
+// Rows are filtered one at a time (None/Sub/Up/Paeth, whichever leaves the
+// lowest byte entropy; libpng's sum-of-residuals heuristic picks Sub/Up on the
+// noisy heat maps, where None compresses far better) and fed straight to
+// deflate, so no filtered copy of the image is made. The image is cut into
+// row segments of ~PNG_SEGMENT_BYTES compressed independently, pigz style:
+// each is a raw deflate stream primed with the 32 KiB of filtered data in
+// front of it and closed with Z_SYNC_FLUSH (the last with Z_FINISH), so the
+// concatenation is one valid stream; the zlib header and the combined adler32
+// are written around it. Segments depend only on the image, so the file is
+// byte-identical for any thread count.
+PngSettings g_png;
+static const size_t PNG_SEGMENT_BYTES = 1u << 20;
+
+static inline int png_paeth(int a, int b, int c){ int p=a+b-c, pa=std::abs(p-a), pb=std::abs(p-b), pc=std::abs(p-c); return (pa<=pb && pa<=pc) ? a : (pb<=pc ? b : c); }
+
+// Filters one row of n bytes into out[0..n] (filter type byte first); prev is
+// the row above, all zeros for the top row. The entropy is estimated on at
+// most ~4K bytes of the row.
+static void png_filter_row(const uint8_t* cur, const uint8_t* prev, size_t n, int bpp, uint8_t* out){
+    const size_t step = std::max<size_t>(1, n >> 12), m = std::min(n, (size_t)bpp);
+    uint32_t hist[4][256] = {};                      // None, Sub, Up, Paeth
+    for(size_t i=0;i<n;i+=step){
+        int x = cur[i], b = prev[i], a = 0, c = 0; if(i >= m){ a = cur[i-bpp]; c = prev[i-bpp]; }
+        ++hist[0][x]; ++hist[1][(uint8_t)(x-a)]; ++hist[2][(uint8_t)(x-b)]; ++hist[3][(uint8_t)(x-png_paeth(a,b,c))];
+    }
+    // lowest entropy = largest sum of c*log2(c)
+    double best = -1; int f = 0;
+    for(int k=0;k<4;++k){ double e = 0; for(uint32_t c : hist[k]) if(c > 1) e += c*std::log2((double)c); if(e > best){ best = e; f = k; } }
+    out[0] = (uint8_t)(f==3 ? 4 : f);
+    uint8_t* o = out+1;
+    switch(f){
+    case 0: std::memcpy(o, cur, n); break;
+    case 1: std::memcpy(o, cur, m); for(size_t i=m;i<n;++i) o[i] = (uint8_t)(cur[i] - cur[i-bpp]); break;
+    case 2: for(size_t i=0;i<n;++i) o[i] = (uint8_t)(cur[i] - prev[i]); break;
+    default:
+        for(size_t i=0;i<m;++i) o[i] = (uint8_t)(cur[i] - prev[i]);       // paeth(0, b, 0) == b
+        for(size_t i=m;i<n;++i) o[i] = (uint8_t)(cur[i] - png_paeth(cur[i-bpp], prev[i], prev[i-bpp]));
+    }
+}
+
+struct PngSegment { std::vector<uint8_t> z; uLong adler = 1; size_t len = 0; };
+
+// Deflates rows [y0, y1) of px (stride bytes per row) as one raw segment; sink
+// receives the compressed bytes as they are produced.
+static void png_deflate_rows(const uint8_t* px, size_t stride, int bpp, int y0, int y1, bool last, int level,
+                             const std::function<void(const uint8_t*, size_t)>& sink, uLong& adler, size_t& len){
+    z_stream zs{}; if(deflateInit2(&zs, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) throw std::runtime_error("deflateInit2 failed");
+    std::vector<uint8_t> row(stride+1), out(1u << 16), zero(stride, 0);
+    if(y0 > 0){
+        // prime with the filtered tail of the previous segment, as its own deflate saw it
+        int r0 = y0; size_t need = 32768; while(r0 > 0 && (size_t)(y0-r0)*(stride+1) < need) --r0;
+        std::vector<uint8_t> dict; dict.reserve((size_t)(y0-r0)*(stride+1));
+        for(int y=r0;y<y0;++y){ png_filter_row(px+(size_t)y*stride, y ? px+(size_t)(y-1)*stride : zero.data(), stride, bpp, row.data()); dict.insert(dict.end(), row.begin(), row.end()); }
+        size_t dn = std::min(dict.size(), need);
+        deflateSetDictionary(&zs, dict.data()+dict.size()-dn, (uInt)dn);
+    }
+    auto drain = [&](int flush){
+        do{
+            zs.next_out = out.data(); zs.avail_out = (uInt)out.size();
+            int rc = deflate(&zs, flush);
+            if(rc == Z_STREAM_ERROR){ deflateEnd(&zs); throw std::runtime_error("deflate failed"); }
+            size_t got = out.size() - zs.avail_out; if(got) sink(out.data(), got);
+        } while(zs.avail_out == 0);
+    };
+    adler = adler32(0L, Z_NULL, 0); len = 0;
+    for(int y=y0;y<y1;++y){
+        png_filter_row(px+(size_t)y*stride, y ? px+(size_t)(y-1)*stride : zero.data(), stride, bpp, row.data());
+        adler = adler32(adler, row.data(), (uInt)row.size()); len += row.size();
+        zs.next_in = row.data(); zs.avail_in = (uInt)row.size();
+        drain(Z_NO_FLUSH);
+    }
+    drain(last ? Z_FINISH : Z_SYNC_FLUSH);
+    deflateEnd(&zs);
+}
+
+// color: 0 grayscale, 2 RGB (PNG colour type)
+bool write_png(const char* filename, int w, int h, int color, const uint8_t* px){
+    StageTimer st("png");
+    FILE* f = fopen(filename, "wb");
+    if(!f) return false;
+    const int bpp = color==2 ? 3 : 1;
+    const size_t stride = (size_t)w*bpp;
+    auto wr32 = [&](uint32_t v){ unsigned char b[4]={(unsigned char)(v>>24),(unsigned char)(v>>16),(unsigned char)(v>>8),(unsigned char)v}; fwrite(b,1,4,f); };
+    auto chunk = [&](const char* type, const uint8_t* d, size_t n){
+        wr32((uint32_t)n); fwrite(type,1,4,f); if(n) fwrite(d,1,n,f);
+        uLong c=crc32(0L,Z_NULL,0); c=crc32(c,(const Bytef*)type,4); if(n) c=crc32(c,d,(uInt)n); wr32((uint32_t)c);
+    };
+    const unsigned char sig[8] = {137,80,78,71,13,10,26,10}; fwrite(sig,1,8,f);
+    unsigned char ihdr[13];
+    ihdr[0]= (w>>24)&255; ihdr[1]=(w>>16)&255; ihdr[2]=(w>>8)&255; ihdr[3]=w&255;
+    ihdr[4]= (h>>24)&255; ihdr[5]=(h>>16)&255; ihdr[6]=(h>>8)&255; ihdr[7]=h&255;
+    ihdr[8]=8; ihdr[9]=(unsigned char)color; ihdr[10]=0; ihdr[11]=0; ihdr[12]=0;
+    chunk("IHDR", ihdr, 13);
+
+    // IDAT payload goes out in 64 KiB chunks as it arrives
+    const size_t IDAT_BYTES = 1u << 16;
+    std::vector<uint8_t> idat; idat.reserve(IDAT_BYTES);
+    auto put = [&](const uint8_t* d, size_t n){
+        while(n){
+            size_t k = std::min(n, IDAT_BYTES - idat.size());
+            idat.insert(idat.end(), d, d+k); d += k; n -= k;
+            if(idat.size() == IDAT_BYTES){ chunk("IDAT", idat.data(), idat.size()); idat.clear(); }
+        }
+    };
+
+    const int level = std::clamp(g_png.level, 0, 9);
+    const uint8_t flevel = level < 2 ? 0 : level < 6 ? 1 : level == 6 ? 2 : 3;
+    uint8_t zh[2] = {0x78, (uint8_t)(flevel << 6)}; zh[1] += (uint8_t)(31 - (zh[0]*256 + zh[1]) % 31);
+    put(zh, 2);
+
+    const int rows_per_seg = (int)std::max<size_t>(1, PNG_SEGMENT_BYTES / (stride+1));
+    const int nseg = std::max(1, (h + rows_per_seg - 1) / rows_per_seg);
+    uLong adler = adler32(0L, Z_NULL, 0);
+    bool ok = true;
+    try{
+        int T = g_png.threads > 0 ? g_png.threads : (int)std::max(1u, std::thread::hardware_concurrency());
+        T = std::min(T, nseg);
+        if(T <= 1){
+            for(int s=0;s<nseg;++s){
+                uLong a; size_t n;
+                png_deflate_rows(px, stride, bpp, s*rows_per_seg, std::min(h, (s+1)*rows_per_seg), s==nseg-1, level, put, a, n);
+                adler = adler32_combine(adler, a, (z_off_t)n);
+            }
+        } else {
+            std::vector<PngSegment> segs(nseg);
+            std::atomic<int> next{0};
+            std::exception_ptr err; std::mutex err_mu;
+            auto work = [&]{
+                for(int s; (s = next.fetch_add(1)) < nseg; ){
+                    try{
+                        PngSegment& g = segs[s];
+                        png_deflate_rows(px, stride, bpp, s*rows_per_seg, std::min(h, (s+1)*rows_per_seg), s==nseg-1, level,
+                                         [&g](const uint8_t* d, size_t n){ g.z.insert(g.z.end(), d, d+n); }, g.adler, g.len);
+                    } catch(...){ std::lock_guard<std::mutex> lk(err_mu); if(!err) err = std::current_exception(); }
+                }
+            };
+            std::vector<std::thread> th; for(int t=1;t<T;++t) th.emplace_back(work);
+            work();
+            for(auto& t : th) t.join();
+            if(err) std::rethrow_exception(err);
+            for(const PngSegment& g : segs){ put(g.z.data(), g.z.size()); adler = adler32_combine(adler, g.adler, (z_off_t)g.len); }
+        }
+    } catch(const std::exception&){ ok = false; }
+    if(!ok){ fclose(f); return false; }
+    uint8_t tail[4] = {(uint8_t)(adler>>24),(uint8_t)(adler>>16),(uint8_t)(adler>>8),(uint8_t)adler};
+    put(tail, 4);
+    if(!idat.empty()) chunk("IDAT", idat.data(), idat.size());
+    chunk("IEND", nullptr, 0);
+    ok = !ferror(f);
+    fclose(f); return ok;
+}
+
+bool write_png_gray(const char* filename, int w, int h, const std::vector<unsigned char>& gray){ return write_png(filename, w, h, 0, gray.data()); }
+bool write_png_rgb(const char* filename, int w, int h, const std::vector<unsigned char>& rgb){ return write_png(filename, w, h, 2, rgb.data()); }
+// ----------------------------------------------------------------------
+
+// ----------------- Minimal RGB drawing helpers -----------------
+struct ImageRGB {
+    int w=0,h=0; std::vector<unsigned char> px; // RGB
+    ImageRGB(){}
+    ImageRGB(int W,int H):w(W),h(H),px(W*H*3,0){}
+    void resize(int W,int H){ w=W; h=H; px.assign(W*H*3,0); }
+    void clear(unsigned char r,unsigned char g,unsigned char b){ if(w<=0 || h<=0) return; hspan(0,w,0,r,g,b); for(int y=1;y<h;++y) std::memcpy(row(y), row(0), (size_t)w*3); }
+    inline void set(int x,int y,unsigned char r,unsigned char g,unsigned char b){ if((unsigned)x<(unsigned)w && (unsigned)y<(unsigned)h){ int o=(y*w+x)*3; px[o]=r; px[o+1]=g; px[o+2]=b; }}
+    inline unsigned char* row(int y){ return &px[(size_t)y*w*3]; }
+    // Clipped fills along the row-major layout; x1/y1 are exclusive.
+    void hspan(int x0,int x1,int y,unsigned char r,unsigned char g,unsigned char b){
+        if((unsigned)y>=(unsigned)h) return; x0=std::max(x0,0); x1=std::min(x1,w); if(x0>=x1) return;
+        unsigned char* p = row(y) + x0*3; for(int x=x0;x<x1;++x,p+=3){ p[0]=r; p[1]=g; p[2]=b; }
+    }
+    void vspan(int x,int y0,int y1,unsigned char r,unsigned char g,unsigned char b){
+        if((unsigned)x>=(unsigned)w) return; y0=std::max(y0,0); y1=std::min(y1,h);
+        for(int y=y0;y<y1;++y){ unsigned char* p = row(y) + x*3; p[0]=r; p[1]=g; p[2]=b; }
+    }
+    // px += (colour - px) * alpha/256 over [x0,x1) x [y0,y1)
+    void blend(int x0,int y0,int x1,int y1,unsigned char r,unsigned char g,unsigned char b,int alpha){
+        x0=std::max(x0,0); x1=std::min(x1,w); y0=std::max(y0,0); y1=std::min(y1,h); if(x0>=x1) return;
+        const int ia = 256-alpha, cr = r*alpha, cg = g*alpha, cb = b*alpha;
+        for(int y=y0;y<y1;++y){ unsigned char* p = row(y) + x0*3; for(int x=x0;x<x1;++x,p+=3){ p[0]=(unsigned char)((p[0]*ia+cr)>>8); p[1]=(unsigned char)((p[1]*ia+cg)>>8); p[2]=(unsigned char)((p[2]*ia+cb)>>8); } }
+    }
+};
+
+// tiny 5x7 bitmap font (ASCII 32..127)
+static const unsigned char FONT5x7[96][5]={
+{0,0,0,0,0},{0x00,0x00,0x5f,0x00,0x00},{0x00,0x07,0x00,0x07,0x00},{0x14,0x7f,0x14,0x7f,0x14},{0x24,0x2a,0x7f,0x2a,0x12},
+{0x23,0x13,0x08,0x64,0x62},
+{0x36,0x49,0x55,0x22,0x50},
+{0x00,0x05,0x03,0x00,0x00},
+{0x00,0x1c,0x22,0x41,0x00},
+{0x00,0x41,0x22,0x1c,0x00},
+{0x14,0x08,0x3e,0x08,0x14},
+{0x08,0x08,0x3e,0x08,0x08},
+{0x00,0x50,0x30,0x00,0x00},
+{0x08,0x08,0x08,0x08,0x08},
+{0x00,0x60,0x60,0x00,0x00},
+{0x20,0x10,0x08,0x04,0x02},
+{0x3e,0x51,0x49,0x45,0x3e},
+{0x00,0x42,0x7f,0x40,0x00},
+{0x42,0x61,0x51,0x49,0x46},
+{0x21,0x41,0x45,0x4b,0x31},
+{0x18,0x14,0x12,0x7f,0x10},
+{0x27,0x45,0x45,0x45,0x39},{0x3c,0x4a,0x49,0x49,0x30},{0x01,0x71,0x09,0x05,0x03},{0x36,0x49,0x49,0x49,0x36},
+{0x06,0x49,0x49,0x29,0x1e},{0x00,0x36,0x36,0x00,0x00},{0x00,0x56,0x36,0x00,0x00},{0x08,0x14,0x22,0x41,0x00},{0x14,0x14,0x14,0x14,0x14},
+{0x00,0x41,0x22,0x14,0x08},{0x02,0x01,0x51,0x09,0x06},{0x32,0x49,0x79,0x41,0x3e},{0x7e,0x11,0x11,0x11,0x7e},{0x7f,0x49,0x49,0x49,0x36},
+{0x3e,0x41,0x41,0x41,0x22},{0x7f,0x41,0x41,0x22,0x1c},{0x7f,0x49,0x49,0x49,0x41},{0x7f,0x09,0x09,0x09,0x01},{0x3e,0x41,0x49,0x49,0x7a},
+{0x7f,0x08,0x08,0x08,0x7f},{0x00,0x41,0x7f,0x41,0x00},{0x20,0x40,0x41,0x3f,0x01},{0x7f,0x08,0x14,0x22,0x41},{0x7f,0x40,0x40,0x40,0x40},
+{0x7f,0x02,0x0c,0x02,0x7f},{0x7f,0x04,0x08,0x10,0x7f},{0x3e,0x41,0x41,0x41,0x3e},
+{0x7f,0x09,0x09,0x09,0x06},
+{0x3e,0x41,0x51,0x21,0x5e}, // Q
+
+{0x7f,0x09,0x19,0x29,0x46}, // R (FIXED)
+
+{0x46,0x49,0x49,0x49,0x31},
+{0x01,0x01,0x7f,0x01,0x01},
+{0x3f,0x40,0x40,0x40,0x3f},
+{0x1f,0x20,0x40,0x20,0x1f},
+{0x3f,0x40,0x38,0x40,0x3f},
+{0x63,0x14,0x08,0x14,0x63},
+{0x07,0x08,0x70,0x08,0x07},
+{0x61,0x51,0x49,0x45,0x43}, // Z
+
+{0x00,0x7f,0x41,0x41,0x00},// '['
+
+{0x02,0x04,0x08,0x10,0x20}, // '\'
+{0x00,0x41,0x41,0x7f,0x00},
+{0x04,0x02,0x01,0x02,0x04},
+{0x40,0x40,0x40,0x40,0x40},
+{0x00,0x01,0x02,0x04,0x00},
+{0x20,0x54,0x54,0x54,0x78},
+{0x7f,0x48,0x44,0x44,0x38},
+{0x38,0x44,0x44,0x44,0x20},
+{0x38,0x44,0x44,0x48,0x7f},
+{0x38,0x54,0x54,0x54,0x18},{0x08,0x7e,0x09,0x01,0x02},
+{0x0c,0x52,0x52,0x52,0x3e},{0x7f,0x08,0x04,0x04,0x78},{0x00,0x44,0x7d,0x40,0x00},{0x20,0x40,0x44,0x3d,0x00},{0x7f,0x10,0x28,0x44,0x00},
+{0x00,0x41,0x7f,0x40,0x00},{0x7c,0x04,0x18,0x04,0x78},{0x7c,0x08,0x04,0x04,0x78},{0x38,0x44,0x44,0x44,0x38},{0x7c,0x14,0x14,0x14,0x08},
+{0x08,0x14,0x14,0x18,0x7c},{0x7c,0x08,0x04,0x04,0x08},{0x48,0x54,0x54,0x54,0x20},{0x04,0x3f,0x44,0x40,0x20},{0x3c,0x40,0x40,0x20,0x7c},
+{0x1c,0x20,0x40,0x20,0x1c},{0x3c,0x40,0x30,0x40,0x3c},{0x44,0x28,0x10,0x28,0x44},{0x0c,0x50,0x50,0x50,0x3c},{0x44,0x64,0x54,0x4c,0x44},
+{0x00,0x08,0x36,0x41,0x00},{0x00,0x00,0x7f,0x00,0x00},{0x00,0x41,0x36,0x08,0x00},{0x10,0x08,0x08,0x10,0x08}
+};
+
+static_assert(sizeof(FONT5x7)/sizeof(FONT5x7[0]) == 96, "FONT5x7 must have 96 rows");
+
+// spot checks for common culprits
+//static_assert(FONT5x7['A' - 32][0] == 0x7e, "'A' glyph wrong");
+//static_assert(FONT5x7['R' - 32][0] == 0x7f, "'R' glyph wrong");
+//static_assert(FONT5x7['S' - 32][0] == 0x46, "'S' glyph wrong");
+//static_assert(FONT5x7['p' - 32][0] == 0x7c, "'p' glyph wrong");
+
+// Replace any non-ASCII bytes with '?' so our 5x7 font never sees UTF-8.
+static std::string ascii_sanitize(const std::string& s){
+    std::string out; out.reserve(s.size());
+    for (unsigned char ch : s){
+        out.push_back((ch >= 32 && ch <= 126) ? char(ch) : '?');
+    }
+    return out;
+}
+
+
+// --- ASCII → glyph (no compensation) ---
+static inline int glyph_index(char c){
+    unsigned int uc = (unsigned char)c;
+    if (uc < 32 || uc > 127) uc = '?';
+    return (int)uc - 32;
+}
+static inline const unsigned char* glyph_for_ascii(char c){
+    return FONT5x7[glyph_index(c)];
+}
+
+// Temporary shim so old calls compile (but ideally unused):
+static inline const unsigned char* glyph_for_scaled(char c){
+    return glyph_for_ascii(c);
+}
+
+
+// FONT5x7 pre-rasterized per scale as horizontal runs of each pixel row, so
+// a label is a handful of hspan() fills with no scratch image.
+struct GlyphAtlas {
+    struct Run { uint8_t y, x0, x1; };          // scaled pixel row, [x0, x1)
+    std::vector<Run> runs;
+    uint32_t first[97] = {};                    // glyph g: runs[first[g] .. first[g+1])
+};
+static const int MAX_TEXT_SCALE = 8;
+
+static const GlyphAtlas& glyph_atlas(int scale){
+    static const std::vector<GlyphAtlas> atlases = []{
+        std::vector<GlyphAtlas> v(MAX_TEXT_SCALE+1);
+        for(int sc=1; sc<=MAX_TEXT_SCALE; ++sc){
+            GlyphAtlas& A = v[sc];
+            for(int g=0; g<96; ++g){
+                A.first[g] = (uint32_t)A.runs.size();
+                for(int cy=0; cy<7; ++cy)
+                    for(int cx=0; cx<5; ){
+                        if(!(FONT5x7[g][cx] & (1u<<cy))){ ++cx; continue; }
+                        int e = cx; while(e<5 && (FONT5x7[g][e] & (1u<<cy))) ++e;
+                        for(int dy=0; dy<sc; ++dy) A.runs.push_back({(uint8_t)(cy*sc+dy), (uint8_t)(cx*sc), (uint8_t)(e*sc)});
+                        cx = e;
+                    }
+            }
+            A.first[96] = (uint32_t)A.runs.size();
+        }
+        return v;
+    }();
+    return atlases[std::clamp(scale, 1, MAX_TEXT_SCALE)];
+}
+
+// 6*scale px per character (5 px glyph + 1 px spacing), 9*scale px per line.
+static void draw_glyphs(ImageRGB& im, int x, int y, const std::string& s,
+                        unsigned char r, unsigned char g, unsigned char b, int scale){
+    scale = std::clamp(scale, 1, MAX_TEXT_SCALE);
+    const GlyphAtlas& A = glyph_atlas(scale);
+    int off = 0;
+    for(char c : s){
+        if (c == '\n'){ y += 9*scale; off = 0; continue; }
+        int gi = glyph_index(c);
+        for(uint32_t k=A.first[gi]; k<A.first[gi+1]; ++k){ const GlyphAtlas::Run& R = A.runs[k]; im.hspan(x+off+R.x0, x+off+R.x1, y+R.y, r,g,b); }
+        off += 6*scale;
+    }
+}
+
+static void draw_text(ImageRGB& im, int x, int y, const std::string& s,
+                      unsigned char r, unsigned char g, unsigned char b){
+    draw_glyphs(im, x, y, s, r, g, b, 1);
+}
+
+
+
+static void draw_line(ImageRGB& im,int x0,int y0,int x1,int y1,unsigned char r,unsigned char g,unsigned char b){
+    int dx=std::abs(x1-x0), sx=x0<x1?1:-1; int dy=-std::abs(y1-y0), sy=y0<y1?1:-1; int err=dx+dy; while(true){ im.set(x0,y0,r,g,b); if(x0==x1 && y0==y1) break; int e2=2*err; if(e2>=dy){ err+=dy; x0+=sx;} if(e2<=dx){ err+=dx; y0+=sy;} }
+}
+
+static void colormap_turbo(double t, unsigned char& r, unsigned char& g, unsigned char& b){
+    // t in [0,1]  -> r,g,b in [0,255]
+    t = std::clamp(t, 0.0, 1.0);
+    // Simple, good-looking “Turbo-like” polynomial approx that returns 0..255 directly.
+    double rF =  34.61 + t*(1172.69 + t*(-10793.6 + t*(33300.0 + t*(-38394.5 + t*17425.7))));
+    double gF =  23.31 + t*(  557.33 + t*(  1225.0 + t*( -3574.0 + t*(  4095.0 - t* 1550.0))));
+    double bF =  27.20 + t*( 3211.10 + t*(-15328.0 + t*(27814.0 + t*(-22569.0 + t* 6838.0))));
+    r = (unsigned char)std::clamp((int)std::lround(rF), 0, 255);
+    g = (unsigned char)std::clamp((int)std::lround(gF), 0, 255);
+    b = (unsigned char)std::clamp((int)std::lround(bF), 0, 255);
+}
+
+// 256-entry palette: colormap_turbo(pow(v/255, gamma)) for every byte v.
+struct Palette { unsigned char rgb[256][3]; };
+static Palette make_turbo_palette(double gamma){
+    Palette p;
+    for(int v=0; v<256; ++v) colormap_turbo(std::pow(v/255.0, gamma), p.rgb[v][0], p.rgb[v][1], p.rgb[v][2]);
+    return p;
+}
+
+// Nearest-neighbour scaled text, from the glyph atlas
+static void draw_text_scaled_nn(ImageRGB& dst, int x, int y, const std::string& s,
+                                unsigned char r, unsigned char g, unsigned char b, int scale)
+{
+    draw_glyphs(dst, x, y, s, r, g, b, scale);
+}
+
+// ----------------- Spectral outputs -----------------
+void save_spectrogram_png(const SpectralOutputs& so, const std::string& path){ if(so.spec_w<=0 || so.spec_h<=0) return; write_png_gray(path.c_str(), so.spec_w, so.spec_h, so.spectrogram_png); }
+
+void save_average_spectrum_png(const SpectralOutputs& so, const std::string& path){
+    const int W=1200, H=600; std::vector<unsigned char> img(W*H, 255);
+    auto put = [&](int x,int y,unsigned char v){ if(x>=0&&x<W&&y>=0&&y<H) img[y*W+x]=v; }; auto line = [&](int x0,int y0,int x1,int y1){ int dx=std::abs(x1-x0), sx=x0<x1?1:-1; int dy=-std::abs(y1-y0), sy=y0<y1?1:-1; int err=dx+dy; while(true){ put(x0,y0,0); if(x0==x1&&y0==y1) break; int e2=2*err; if(e2>=dy){ err+=dy; x0+=sx;} if(e2<=dx){ err+=dx; y0+=sy;} } };
+    for(int x=50;x<W-20;++x) put(x,H-40,0); for(int y=20;y<H-40;++y) put(50,y,0);
+    double fmin=20.0, fmax = so.freq.back(); auto xmap = [&](double f){ double t = std::log10(std::max(f, fmin)/fmin) / std::log10(fmax/fmin); return 50 + (int)(t*(W-70)); }; auto ymap = [&](double db){ double t = (db+120.0)/120.0; t=std::clamp(t,0.0,1.0); return 20 + (int)((1.0-t)*(H-60)); };
+    int prevx=-1, prevy=-1; for(size_t i=1;i<so.freq.size();++i){ int x = xmap(so.freq[i]); int y = ymap(so.avg_mag_db[i]); if(prevx>=0) line(prevx,prevy,x,y); prevx=x; prevy=y; }
+    write_png_gray(path.c_str(), W, H, img);
+}
+
+
+// ----------------- Pretty renderers -----------------
+//static void save_pretty_spectrogram(const SpectralOutputs& so, int sr, const std::string& path){
+    //int W = so.spec_w, H = so.spec_h; if(W<=0||H<=0) return; int PADL=60, PADB=40, PADR=10, PADT=10; ImageRGB im(W+PADL+PADR,H+PADT+PADB); im.clear(10,10,10);
+    //for(int x=0;x<W;++x){ 
+		//for(int y=0;y<H;++y){ 
+			//unsigned char g = so.spectrogram_png[y*W + x];
+			//// brighten midtones: gamma 0.75
+			//double t = std::pow(g / 255.0, 0.75);
+			//unsigned char r,gc,b;
+			//colormap_turbo(t, r, gc, b);
+			//im.set(PADL+x, PADT+y, r, gc, b);
+		//}}
+    //std::vector<int> gridk={1,2,5,10,15,20,25,30,35,40}; auto xmap=[&](double f){ double t = std::log10(std::max(20.0,f)/20.0)/std::log10((sr*0.5)/20.0); return PADL + (int)std::round(t*W); };
+    //for(int k: gridk){ int x=xmap(k*1000.0); for(int y=PADT;y<PADT+H;++y) im.set(x,y,40,40,40);
+		//draw_text(im,x-10,H+PADT+5,std::to_string(k)+"k",180,180,180); 
+	//}
+    //auto ymap=[&](double db){ double t=(db+120.0)/120.0; return PADT + (int)std::round((1.0-t)*H); };
+    //for(int db=-108; db<=0; db+=12){ int y=ymap(db); for(int x=PADL;x<PADL+W;++x) im.set(x,y,40,40,40); draw_text(im,5,y-3,std::to_string(db),180,180,180); }
+    //draw_text(im, (PADL+W)/2 - 10, PADT+H+20, "Hz", 220,220,220); draw_text(im, 5, PADT-5, "dB", 220,220,220);
+    //write_png_rgb(path.c_str(), im.w, im.h, im.px);
+//}
+
+void save_pretty_spectrogram(const SpectralOutputs& so, int sr, const std::string& path){
+    int W = so.spec_w, H = so.spec_h;
+    if (W <= 0 || H <= 0) return;
+
+    int PADL = 60, PADB = 40, PADR = 10, PADT = 10;
+    ImageRGB im(W + PADL + PADR, H + PADT + PADB);
+    im.clear(10, 10, 10);
+
+    // draw colormapped spectrogram (brighten with gamma), one palette lookup per pixel
+    static const Palette pal = make_turbo_palette(0.75);
+    for (int y = 0; y < H; ++y) {
+        const unsigned char* src = &so.spectrogram_png[(size_t)y * W];
+        unsigned char* dst = im.row(PADT + y) + PADL * 3;
+        for (int x = 0; x < W; ++x, dst += 3) { const unsigned char* c = pal.rgb[src[x]]; dst[0] = c[0]; dst[1] = c[1]; dst[2] = c[2]; }
+    }
+
+    std::vector<int> gridk = {1,2,5,10,15,20,25,30,35,40};
+    if (so.spec_logf) {
+        // rows follow logf_pos(): the same log-f grid, on y (labels thinned where it gets dense)
+        int lasty = 1 << 30;
+        for (int k : gridk) {
+            int y = PADT + H - 1 - (int)std::round(logf_pos(k * 1000.0, sr) * (H - 1));
+            im.hspan(PADL, PADL + W, y, 40, 40, 40);
+            if (lasty - y < 14) continue;
+            draw_text_scaled_nn(im, 8, y - 5, ascii_sanitize(std::to_string(k) + "k"), 200, 200, 200, 2);
+            lasty = y;
+        }
+        draw_text_scaled_nn(im, 8, PADT - 2, ascii_sanitize("Hz"), 220,220,220, 2);
+        write_png_rgb(path.c_str(), im.w, im.h, im.px);
+        return;
+    }
+
+    // grid (log-f on x)
+    auto xmap = [&](double f){ return PADL + (int)std::round(logf_pos(f, sr) * W); };
+    for (int k : gridk) {
+        int x = xmap(k * 1000.0);
+        im.vspan(x, PADT, PADT + H, 40, 40, 40);
+        // big tick label on x
+		// x tick
+		draw_text_scaled_nn(im, x - 12, PADT + H + 10,
+							ascii_sanitize(std::to_string(k) + "k"),
+							200, 200, 200, 2);
+    }
+
+    // y grid (dB)
+    auto ymap = [&](double db){
+        double t = (db + 120.0) / 120.0;
+        return PADT + (int)std::round((1.0 - t) * H);
+    };
+    for (int db = -108; db <= 0; db += 12) {
+        int y = ymap(db);
+        im.hspan(PADL, PADL + W, y, 40, 40, 40);
+        // big tick label on y
+		// y tick
+		draw_text_scaled_nn(im, 8, y - 5,
+							ascii_sanitize(std::to_string(db)),
+							200, 200, 200, 2);
+    }
+
+	// axis labels
+	draw_text_scaled_nn(im, (PADL + W) / 2 - 10, PADT + H + 20, ascii_sanitize("Hz"), 220,220,220, 2);
+	draw_text_scaled_nn(im, 8,                   PADT -  2,     ascii_sanitize("dB"), 220,220,220, 2);
+
+    write_png_rgb(path.c_str(), im.w, im.h, im.px);
+}
+static void draw_text_bold(ImageRGB& im, int x, int y, const std::string& s,
+                           unsigned char r, unsigned char g, unsigned char b,
+                           int thickness = 2)
+{
+    for (int dx = 0; dx < thickness; ++dx)
+        for (int dy = 0; dy < thickness; ++dy)
+            draw_text(im, x + dx, y + dy, s, r, g, b);
+}
+
+
+
+
+
+void save_pretty_spectrum_overlay(const SpectralOutputs& L, const SpectralOutputs& R,
+                                  int sr, const Metrics& m, const std::string& cls,
+                                  const std::string& path)
+{
+
+	const std::string TITLE = ascii_sanitize("Spectrum (log-f) - L (magenta) / R (cyan)");
+	const std::string BAND  = ascii_sanitize("DSD noise-shaping band");
+	std::string cls_ascii   = ascii_sanitize(cls);
+
+    const int W=1400, H=700;
+    ImageRGB im(W,H); im.clear(0,0,0);
+
+    const int PADL=70, PADB=60, PADR=15, PADT=15;
+    const int PW=W-PADL-PADR, PH=H-PADT-PADB;
+
+    // text scales (NN upscaled for larger labels)
+    const int SCALE_TITLE = 2;
+    const int SCALE_AXIS  = 2;
+    const int MIN_DX_LABEL = 34;  // min x-spacing between x-axis labels (pixels)
+
+    auto xmap=[&](double f){
+        double t = std::log10(std::max(20.0, f)/20.0) / std::log10((sr*0.5)/20.0);
+        return PADL + (int)std::round(t*PW);
+    };
+    auto ymap=[&](double db){
+        double t = (db+120.0)/120.0;
+        return PADT + (int)std::round((1.0-t)*PH);
+    };
+
+    // ----- horizontal grid + dB tick labels
+    for(int db=-108; db<=0; db+=12){
+        int y=ymap(db);
+        im.hspan(PADL, PADL+PW, y, 40,40,40);
+        draw_text(im, 8, y-5, ascii_sanitize(std::to_string(db)), 200,200,200);  // small font = crisp, no scaling
+    }
+
+    // ----- vertical grid on log-f; auto-thin labels
+    std::vector<double> xticks;
+    double ny = sr * 0.5;
+    for(double decade=1e3; decade<=ny*1.01; decade*=10.0){
+        for(double m : {1.0,2.0,5.0}){
+            double f = m*decade;
+            if(f<=ny*1.001) xticks.push_back(f);
+        }
+    }
+    xticks.push_back(22050.0);
+    xticks.push_back(24000.0);
+    std::sort(xticks.begin(), xticks.end());
+    xticks.erase(std::unique(xticks.begin(), xticks.end()), xticks.end());
+
+    int last_label_x = -100000;
+    auto fmt_khz = [](double f){
+        if (f >= 1000.0) { int k = (int)std::round(f/1000.0); return std::to_string(k) + "k"; }
+        return std::to_string((int)std::round(f));
+    };
+
+    for(double f : xticks){
+        int x = xmap(f);
+        im.vspan(x, PADT, PADT+PH, 40,40,40); // grid line
+
+        if (x - last_label_x >= MIN_DX_LABEL) {
+            std::string lab = ascii_sanitize(fmt_khz(f));
+            int lab_w = (int)lab.size() * 6;  // small font width
+            int lx = x - lab_w/2;
+            if (lx < 2) lx = 2;
+            if (lx + lab_w > W-2) lx = W-2 - lab_w;
+            draw_text(im, lx, PADT+PH+10, lab, 200,200,200);
+            last_label_x = x;
+        }
+    }
+
+    // ----- shade the DSD noise-shaping band (22.05k..50k, stretched with --sr auto)
+int x22 = xmap(22050.0*m.noise_band_scale), x50 = xmap(50000.0*m.noise_band_scale);
+int xL = std::max(0, std::min(x22, W-1));
+int xR = std::max(0, std::min(x50, W-1));
+if (xL > xR) std::swap(xL, xR);
+
+im.blend(xL, PADT, xR+1, PADT+PH, 20,10,0, 64);   // 1/4 towards dark amber
+
+    // band label
+    draw_text_scaled_nn(im, x22-280, PADT+11, BAND, 180,200,255, 2);
+    
+//// Center the band label horizontally between xL..xR, and 10 px lower than before
+//const int SCALE_BAND = 2;
+//int band_text_w = (int)BAND.size() * 6 * SCALE_BAND;   // 6 px per char at 1x
+//int band_x = (xL + xR - band_text_w) / 2;              // center inside shaded band
+//band_x = std::max(PADL + 4, std::min(band_x, W - 4 - band_text_w));
+//int band_y = PADT + 15;                                 // was PADT + 5 → 10 px lower
+//draw_text_scaled_nn(im, band_x, band_y, BAND, 180,200,255, SCALE_BAND);
+
+
+    // ----- draw curves
+    auto draw_curve=[&](const SpectralOutputs& S,unsigned char r,unsigned char g,unsigned char b){
+        int prevx=-1, prevy=-1;
+        for(size_t i=1;i<S.freq.size();++i){
+            int x=xmap(S.freq[i]);
+            int y=ymap(S.avg_mag_db[i]);
+            if(prevx>=0){
+                int dx=std::abs(x-prevx), sx=prevx<x?1:-1;
+                int dy=-std::abs(y-prevy), sy=prevy<y?1:-1;
+                int err=dx+dy; int x0=prevx,y0=prevy;
+                while(true){
+                    im.set(x0,y0,r,g,b);
+                    if(x0==x && y0==y) break;
+                    int e2=2*err;
+                    if(e2>=dy){ err+=dy; x0+=sx; }
+                    if(e2<=dx){ err+=dx; y0+=sy; }
+                }
+            }
+            prevx=x; prevy=y;
+        }
+    };
+    draw_curve(L,255,100,220); // magenta-ish (Left)
+    draw_curve(R,120,200,255); // cyan-ish (Right)
+
+    // ----- special markers at 22.05k & 24k
+    for(double mk : {22050.0, 24000.0}){
+        int x = xmap(mk);
+        im.vspan(x, PADT, PADT+PH, 100,100,100);
+        std::string lab = (mk==22050.0) ? "22.05k" : "24k";
+        int lab_w = (int)lab.size()*6;
+        int lx = std::min(std::max(x+3, 2), W-2-lab_w);
+        // special markers
+        std::string lab2 = ascii_sanitize(mk==22050.0 ? "22.05k" : "24k");
+        draw_text(im, lx, (mk==22050.0)?(PADT+15):(PADT+28), lab2, 200,200,200);
+    }
+
+		// title / axes / classification
+	draw_text_scaled_nn(im, PADL,  6,    TITLE,    230,230,230, 2);
+	draw_text_scaled_nn(im, PADL,  H-24, ascii_sanitize("Hz"),  220,220,220, 2);
+	draw_text_scaled_nn(im, 8,     PADT-2, ascii_sanitize("dB"),220,220,220, 2);
+	draw_text_scaled_nn(im, std::max(PADL, W - 10 - (int)cls_ascii.size()*6*2),
+                    6, cls_ascii, 255,210,120, 2);
+
+
+    write_png_rgb(path.c_str(), W, H, im.px);
+}
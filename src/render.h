@@ -0,0 +1,34 @@
+// PNG output and the spectrum/spectrogram renderers (src/render.cpp), shared
+// by dsd_inspector and dsd_bench.
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <zlib.h>
+
+#include "core.h"
+
+// ----------------- PNG writers -----------------
+// Streaming, row-filtered encoder; large images are deflated in parallel
+// segments and come out byte-identical for any thread count.
+struct PngSettings { int level = Z_BEST_SPEED; int threads = 0; };   // threads: 0 = all cores
+extern PngSettings g_png;
+
+// color: 0 = 8-bit gray, 2 = 8-bit RGB; px is h rows of w pixels.
+bool write_png(const char* filename, int w, int h, int color, const uint8_t* px);
+bool write_png_gray(const char* filename, int w, int h, const std::vector<unsigned char>& gray);
+bool write_png_rgb(const char* filename, int w, int h, const std::vector<unsigned char>& rgb);
+
+// ----------------- Spectral outputs -----------------
+// spectrogram.png (so's heat map as is) and spectrum_avg.png.
+void save_spectrogram_png(const SpectralOutputs& so, const std::string& path);
+void save_average_spectrum_png(const SpectralOutputs& so, const std::string& path);
+
+// spectrogram_pretty.png: the heat map in colour on kHz/dB axes, sr the analysis rate.
+void save_pretty_spectrogram(const SpectralOutputs& so, int sr, const std::string& path);
+// spectrum_overlay.png: L/R average spectra with the noise-shaping band shaded,
+// the metrics and the classification.
+void save_pretty_spectrum_overlay(const SpectralOutputs& L, const SpectralOutputs& R,
+                                  int sr, const Metrics& m, const std::string& cls,
+                                  const std::string& path);